@@ -0,0 +1,190 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * block_cache.hpp
+ *
+ *  Bounded buffer cache over a region of a file, for the strings kept on disk (semi-external mode, see
+ *  dna_string_n::load_paged). The region is read in pages of BLOCK_CACHE_PAGE bytes with pread, into at most
+ *  budget/BLOCK_CACHE_PAGE frames: the memory used never exceeds the budget, whatever the size of the file.
+ *
+ *  Pages are distributed over shards (page number modulo the number of shards), each with its own frames, lock and
+ *  CLOCK replacement, so that threads reading different pages rarely wait for each other. read_block copies a
+ *  block out of its page while holding the lock of the shard: the caller never holds a pointer into a frame that
+ *  could be replaced.
+ *
+ *  The cache pays off when accesses are ordered by position (e.g. the sorted rank queries of the level-synchronous
+ *  traversal): each page is then read from disk once per sweep.
+ *
+ */
+
+#ifndef INTERNAL_BLOCK_CACHE_HPP_
+#define INTERNAL_BLOCK_CACHE_HPP_
+
+#include "include.hpp"
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BLOCK_CACHE_PAGE 1048576	//bytes read from disk at once (1 MB)
+#define BLOCK_CACHE_SHARDS 64		//maximum number of shards
+
+class block_cache{
+
+public:
+
+	/*
+	 * cache the 'size' bytes of the file at path starting at 'offset', in at most budget bytes
+	 */
+	block_cache(string path, uint64_t offset, uint64_t size, uint64_t budget) : offset(offset), size(size){
+
+		fd = open(path.c_str(), O_RDONLY);
+
+		if(fd < 0){
+
+			throw make_error("cannot open file ", path);
+
+		}
+
+		uint64_t frames = std::max(uint64_t(1), budget / BLOCK_CACHE_PAGE);
+
+		n_shards = std::min(uint64_t(BLOCK_CACHE_SHARDS), frames);
+		shards = std::unique_ptr<shard[]>(new shard[n_shards]);
+
+		for(uint64_t s = 0; s < n_shards; ++s){
+
+			//frames are split evenly; the first frames % n_shards shards get one more
+			uint64_t f = frames / n_shards + (s < frames % n_shards);
+
+			shards[s].memory = std::unique_ptr<uint8_t[]>(new uint8_t[f*BLOCK_CACHE_PAGE]);
+			shards[s].page = vector<uint64_t>(f, NO_PAGE);
+			shards[s].referenced = vector<bool>(f, false);
+
+		}
+
+		frame = vector<uint64_t>((size + BLOCK_CACHE_PAGE - 1)/BLOCK_CACHE_PAGE, NO_PAGE);
+
+	}
+
+	~block_cache(){
+
+		close(fd);
+
+	}
+
+	block_cache(const block_cache&) = delete;
+	block_cache& operator=(const block_cache&) = delete;
+
+	/*
+	 * copy the len bytes at position pos of the region (not crossing a page) to out. Thread-safe
+	 */
+	inline void read_block(uint64_t pos, uint8_t* out, uint64_t len = 64){
+
+		assert(pos + len <= size and pos / BLOCK_CACHE_PAGE == (pos + len - 1) / BLOCK_CACHE_PAGE);
+
+		uint64_t p = pos / BLOCK_CACHE_PAGE;
+		shard & s = shards[p % n_shards];
+
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		uint64_t f = frame[p];
+
+		if(f == NO_PAGE) f = load(s, p);
+
+		s.referenced[f] = true;
+
+		memcpy(out, s.memory.get() + f*BLOCK_CACHE_PAGE + pos % BLOCK_CACHE_PAGE, len);
+
+	}
+
+	//pages read from disk so far
+	uint64_t misses(){
+		return n_misses;
+	}
+
+	//bytes of the frames
+	uint64_t bytes(){
+
+		uint64_t b = 0;
+		for(uint64_t s = 0; s < n_shards; ++s) b += shards[s].page.size()*BLOCK_CACHE_PAGE;
+
+		return b;
+
+	}
+
+private:
+
+	enum : uint64_t { NO_PAGE = ~uint64_t(0) };	//free frame, or page not cached
+
+	struct shard{
+
+		std::mutex mutex;
+		std::unique_ptr<uint8_t[]> memory;			//the frames
+		vector<uint64_t> page;						//page in each frame
+		vector<bool> referenced;					//CLOCK bits
+		uint64_t hand = 0;
+
+	};
+
+	//read page p into a frame of s, chosen by CLOCK. Returns the frame. The lock of s is held
+	uint64_t load(shard & s, uint64_t p){
+
+		while(s.referenced[s.hand]){
+
+			s.referenced[s.hand] = false;
+			s.hand = (s.hand + 1) % s.page.size();
+
+		}
+
+		uint64_t f = s.hand;
+		s.hand = (s.hand + 1) % s.page.size();
+
+		if(s.page[f] != NO_PAGE) frame[s.page[f]] = NO_PAGE;
+
+		uint64_t from = p*BLOCK_CACHE_PAGE;
+		uint64_t len = std::min(uint64_t(BLOCK_CACHE_PAGE), size - from);
+		uint8_t* buf = s.memory.get() + f*BLOCK_CACHE_PAGE;
+
+		uint64_t done = 0;
+
+		while(done < len){
+
+			ssize_t r = pread(fd, buf + done, len - done, offset + from + done);
+
+			if(r <= 0){
+
+				throw make_error("cannot read the index file (truncated?)");
+
+			}
+
+			done += r;
+
+		}
+
+		s.page[f] = p;
+		frame[p] = f;
+
+		n_misses++;
+
+		return f;
+
+	}
+
+	int fd = -1;
+	uint64_t offset = 0;	//of the region in the file
+	uint64_t size = 0;		//of the region
+
+	uint64_t n_shards = 0;
+	std::unique_ptr<shard[]> shards;
+
+	//frame of each page of the region (NO_PAGE if not cached). Entry p is only accessed with the lock of its shard
+	vector<uint64_t> frame;
+
+	std::atomic<uint64_t> n_misses {0};
+
+};
+
+#endif /* INTERNAL_BLOCK_CACHE_HPP_ */
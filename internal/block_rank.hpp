@@ -0,0 +1,613 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * block_rank.hpp
+ *
+ *  Kernels computing the in-block parallel rank of (A,C,G,N,T) of a 512-bit block of dna_string_n, i.e. the
+ *  number of occurrences of each letter among the first off characters of the block. See dna_string_n.hpp
+ *  for the block layout (three 128-bit planes followed by the counters).
+ *
+ *  Variants:
+ *
+ *  - scalar: portable, 10 64-bit popcounts. This is the reference implementation.
+ *  - popcnt: the scalar kernel compiled with the POPCNT instruction (otherwise, without -march flags, popcounts
+ *            are computed in software).
+ *  - avx2: the five masks are built in three vector registers and counted with the pshufb nibble-lookup popcount.
+ *  - avx512: the masks of A,C,G,N are built in one 512-bit register and counted with VPOPCNTQ.
+ *
+ *  Every variant also has a multi-offset version (block_rank_multi_*) computing the ranks at several offsets of the
+ *  same block: the block is loaded and the letter masks are built only once, then each offset costs a masked popcount.
+ *
+ *  The fastest variant supported by the CPU is selected at runtime (CPUID), so one binary runs everywhere. The
+ *  choice can be forced with the environment variable RHO_BLOCK_RANK=scalar|popcnt|avx2|avx512 (e.g. for testing).
+ *
+ *  The 2-bit blocks of dna_string (alphabet {A,C,G,T}) have their own kernels (block_rank2_*): two 192-bit planes
+ *  are counted with 3 popcounts per 64-bit word, T = |b0 & b1|, C = |b0| - T, G = |b1| - T, and A by difference.
+ *  Only the scalar and popcnt variants exist: with so few popcounts, vector registers do not pay off.
+ *
+ *  The bit blocks of the wavelet matrix levels of byte_string (block_rank1_*) count the ones of 448 bits, with
+ *  7 masked popcounts. Scalar and popcnt variants, as for the 2-bit blocks.
+ *
+ */
+
+#ifndef INTERNAL_BLOCK_RANK_HPP_
+#define INTERNAL_BLOCK_RANK_HPP_
+
+#include "include.hpp"
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BLOCK_RANK_X86
+#include <immintrin.h>
+#endif
+
+typedef p_rank_n (*block_rank_fn)(const uint8_t* block, uint64_t off);
+
+//out[i] = rank at offset offs[i], for i = 0, ..., k-1
+typedef void (*block_rank_multi_fn)(const uint8_t* block, const uint64_t* offs, int k, p_rank_n* out);
+
+struct block_rank_kernels{
+
+	block_rank_fn one;
+	block_rank_multi_fn multi;
+	const char* name;
+
+};
+
+/*
+ * internal encoding (does not reflect lexicographic ordering, which is the standard alphabetical one)
+ *
+ * A     000
+ * C     001
+ * G     010
+ * T     011
+ * TERM  100
+ * N     101
+ *
+ */
+
+__attribute__((always_inline)) inline p_rank_n block_rank_scalar_impl(const uint8_t* block, uint64_t off){
+
+	//chars[0..3] contains 1st, 2nd, 3rd bits of the 128 characters
+	const __uint128_t* chars = (const __uint128_t*)(block);
+
+	__uint128_t PAD = ((~__uint128_t(0))>>off);
+
+	//no character's code begins with 11, so we pad most 2 significant bits
+	__uint128_t b2 = chars[2] | PAD;
+	__uint128_t b1 = chars[1] | PAD;
+	__uint128_t b0 = chars[0];
+
+	return {
+
+		popcount128((~b2) & (~b1) & (~b0)), // A = 000
+		popcount128((~b2) & (~b1) & (b0)), // C = 001
+		popcount128((~b2) & (b1) & (~b0)), // G = 010
+		popcount128((b2) & (~b1) & (b0)), // N = 101
+		popcount128((~b2) & (b1) & (b0)), // T = 011
+
+	};
+
+}
+
+__attribute__((always_inline)) inline void block_rank_multi_scalar_impl(const uint8_t* block, const uint64_t* offs, int k, p_rank_n* out){
+
+	const __uint128_t* chars = (const __uint128_t*)(block);
+
+	__uint128_t b2 = chars[2];
+	__uint128_t b1 = chars[1];
+	__uint128_t b0 = chars[0];
+
+	//letter masks of the whole block (including the counters in the 11 least significant bits, masked below)
+	__uint128_t A = (~b2) & (~b1) & (~b0); // A = 000
+	__uint128_t C = (~b2) & (~b1) & (b0); // C = 001
+	__uint128_t G = (~b2) & (b1) & (~b0); // G = 010
+	__uint128_t N = (b2) & (~b1) & (b0); // N = 101
+	__uint128_t T = (~b2) & (b1) & (b0); // T = 011
+
+	for(int i=0;i<k;++i){
+
+		__uint128_t keep = ~((~__uint128_t(0))>>offs[i]);
+
+		out[i] = {
+			popcount128(A & keep),
+			popcount128(C & keep),
+			popcount128(G & keep),
+			popcount128(N & keep),
+			popcount128(T & keep)
+		};
+
+	}
+
+}
+
+inline p_rank_n block_rank_scalar(const uint8_t* block, uint64_t off){
+
+	return block_rank_scalar_impl(block, off);
+
+}
+
+inline void block_rank_multi_scalar(const uint8_t* block, const uint64_t* offs, int k, p_rank_n* out){
+
+	block_rank_multi_scalar_impl(block, offs, k, out);
+
+}
+
+#ifdef BLOCK_RANK_X86
+
+__attribute__((target("popcnt"))) inline p_rank_n block_rank_popcnt(const uint8_t* block, uint64_t off){
+
+	return block_rank_scalar_impl(block, off);
+
+}
+
+__attribute__((target("popcnt"))) inline void block_rank_multi_popcnt(const uint8_t* block, const uint64_t* offs, int k, p_rank_n* out){
+
+	block_rank_multi_scalar_impl(block, offs, k, out);
+
+}
+
+//mask of the first off characters of a plane (the first character is the most significant bit)
+__attribute__((target("sse2"))) inline __m128i prefix_mask128(uint64_t off){
+
+	__uint128_t m = ~((~__uint128_t(0))>>off);
+	__m128i r;
+	std::memcpy(&r, &m, sizeof(r));
+
+	return r;
+
+}
+
+__attribute__((target("avx2"))) inline __m256i popcount_bytes256(__m256i x){
+
+	const __m256i lookup = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+	const __m256i low4 = _mm256_set1_epi8(0x0f);
+
+	__m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low4));
+	__m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low4));
+
+	//one popcount per 64-bit lane
+	return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+
+}
+
+__attribute__((target("avx2"))) inline p_rank_n block_rank_avx2(const uint8_t* block, uint64_t off){
+
+	const __m128i* chars = (const __m128i*)(block);
+
+	//planes replicated in both 128-bit lanes, restricted to the first off characters
+	__m256i keep = _mm256_broadcastsi128_si256(prefix_mask128(off));
+	__m256i b0 = _mm256_and_si256(_mm256_broadcastsi128_si256(_mm_load_si128(chars)), keep);
+	__m256i b1 = _mm256_and_si256(_mm256_broadcastsi128_si256(_mm_load_si128(chars+1)), keep);
+	__m256i b2 = _mm256_and_si256(_mm256_broadcastsi128_si256(_mm_load_si128(chars+2)), keep);
+
+	//lanes [A|C] and [G|N]: a plane is negated (andnot) in a lane iff the letter's code has a 0 there
+	__m256i AC = _mm256_andnot_si256(b2, _mm256_andnot_si256(b1, keep));
+	AC = _mm256_and_si256(AC, _mm256_xor_si256(b0, _mm256_setr_epi64x(-1,-1,0,0)));
+
+	__m256i G_ = _mm256_andnot_si256(b2, _mm256_andnot_si256(b0, b1));
+	__m256i N_ = _mm256_and_si256(b2, _mm256_andnot_si256(b1, b0));
+	__m256i GN = _mm256_blend_epi32(G_, N_, 0xF0);
+
+	__m256i T_ = _mm256_andnot_si256(b2, _mm256_and_si256(b1, b0));
+
+	__m256i cAC = popcount_bytes256(AC);
+	__m256i cGN = popcount_bytes256(GN);
+	__m256i cT = popcount_bytes256(T_);
+
+	//add the two 64-bit halves of each letter
+	cAC = _mm256_add_epi64(cAC, _mm256_shuffle_epi32(cAC, _MM_SHUFFLE(1,0,3,2)));
+	cGN = _mm256_add_epi64(cGN, _mm256_shuffle_epi32(cGN, _MM_SHUFFLE(1,0,3,2)));
+	cT = _mm256_add_epi64(cT, _mm256_shuffle_epi32(cT, _MM_SHUFFLE(1,0,3,2)));
+
+	return {
+		uint64_t(_mm256_extract_epi64(cAC, 0)),
+		uint64_t(_mm256_extract_epi64(cAC, 2)),
+		uint64_t(_mm256_extract_epi64(cGN, 0)),
+		uint64_t(_mm256_extract_epi64(cGN, 2)),
+		uint64_t(_mm256_extract_epi64(cT, 0))
+	};
+
+}
+
+__attribute__((target("avx2"))) inline void block_rank_multi_avx2(const uint8_t* block, const uint64_t* offs, int k, p_rank_n* out){
+
+	const __m128i* chars = (const __m128i*)(block);
+
+	__m256i b0 = _mm256_broadcastsi128_si256(_mm_load_si128(chars));
+	__m256i b1 = _mm256_broadcastsi128_si256(_mm_load_si128(chars+1));
+	__m256i b2 = _mm256_broadcastsi128_si256(_mm_load_si128(chars+2));
+
+	//masks of the whole block, see block_rank_avx2
+	__m256i AC = _mm256_andnot_si256(b2, _mm256_andnot_si256(b1, _mm256_xor_si256(b0, _mm256_setr_epi64x(-1,-1,0,0))));
+	__m256i GN = _mm256_blend_epi32(_mm256_andnot_si256(b2, _mm256_andnot_si256(b0, b1)), _mm256_and_si256(b2, _mm256_andnot_si256(b1, b0)), 0xF0);
+	__m256i T_ = _mm256_andnot_si256(b2, _mm256_and_si256(b1, b0));
+
+	for(int i=0;i<k;++i){
+
+		__m256i keep = _mm256_broadcastsi128_si256(prefix_mask128(offs[i]));
+
+		__m256i cAC = popcount_bytes256(_mm256_and_si256(AC, keep));
+		__m256i cGN = popcount_bytes256(_mm256_and_si256(GN, keep));
+		__m256i cT = popcount_bytes256(_mm256_and_si256(T_, keep));
+
+		cAC = _mm256_add_epi64(cAC, _mm256_shuffle_epi32(cAC, _MM_SHUFFLE(1,0,3,2)));
+		cGN = _mm256_add_epi64(cGN, _mm256_shuffle_epi32(cGN, _MM_SHUFFLE(1,0,3,2)));
+		cT = _mm256_add_epi64(cT, _mm256_shuffle_epi32(cT, _MM_SHUFFLE(1,0,3,2)));
+
+		out[i] = {
+			uint64_t(_mm256_extract_epi64(cAC, 0)),
+			uint64_t(_mm256_extract_epi64(cAC, 2)),
+			uint64_t(_mm256_extract_epi64(cGN, 0)),
+			uint64_t(_mm256_extract_epi64(cGN, 2)),
+			uint64_t(_mm256_extract_epi64(cT, 0))
+		};
+
+	}
+
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt"))) inline p_rank_n block_rank_avx512(const uint8_t* block, uint64_t off){
+
+	const __m128i* chars = (const __m128i*)(block);
+
+	__m128i keep128 = prefix_mask128(off);
+
+	//planes replicated in the four 128-bit lanes, restricted to the first off characters
+	__m512i keep = _mm512_broadcast_i32x4(keep128);
+	__m512i b0 = _mm512_and_si512(_mm512_broadcast_i32x4(_mm_load_si128(chars)), keep);
+	__m512i b1 = _mm512_and_si512(_mm512_broadcast_i32x4(_mm_load_si128(chars+1)), keep);
+	__m512i b2 = _mm512_and_si512(_mm512_broadcast_i32x4(_mm_load_si128(chars+2)), keep);
+
+	//lanes [A|C|G|N]: a plane is negated in a lane iff the letter's code has a 0 in that bit
+	const __m512i neg0 = _mm512_setr_epi64(-1,-1, 0, 0,-1,-1, 0, 0); // A=000 C=001 G=010 N=101
+	const __m512i neg1 = _mm512_setr_epi64(-1,-1,-1,-1, 0, 0,-1,-1);
+	const __m512i neg2 = _mm512_setr_epi64(-1,-1,-1,-1,-1,-1, 0, 0);
+
+	__m512i m = _mm512_and_si512(keep, _mm512_xor_si512(b0, neg0));
+	m = _mm512_and_si512(m, _mm512_xor_si512(b1, neg1));
+	m = _mm512_and_si512(m, _mm512_xor_si512(b2, neg2));
+
+	__m512i c = _mm512_popcnt_epi64(m);
+
+	alignas(64) uint64_t cnt[8];
+	_mm512_store_si512((__m512i*)cnt, c);
+
+	//T = 011
+	__m128i t = _mm_andnot_si128(_mm_load_si128(chars+2), _mm_and_si128(_mm_load_si128(chars+1), _mm_load_si128(chars)));
+	t = _mm_and_si128(t, keep128);
+
+	uint64_t cT = __builtin_popcountll(uint64_t(_mm_cvtsi128_si64(t))) + __builtin_popcountll(uint64_t(_mm_extract_epi64(t, 1)));
+
+	return {cnt[0]+cnt[1], cnt[2]+cnt[3], cnt[4]+cnt[5], cnt[6]+cnt[7], cT};
+
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt"))) inline void block_rank_multi_avx512(const uint8_t* block, const uint64_t* offs, int k, p_rank_n* out){
+
+	const __m128i* chars = (const __m128i*)(block);
+
+	__m512i b0 = _mm512_broadcast_i32x4(_mm_load_si128(chars));
+	__m512i b1 = _mm512_broadcast_i32x4(_mm_load_si128(chars+1));
+	__m512i b2 = _mm512_broadcast_i32x4(_mm_load_si128(chars+2));
+
+	//masks [A|C|G|N] of the whole block, see block_rank_avx512
+	const __m512i neg0 = _mm512_setr_epi64(-1,-1, 0, 0,-1,-1, 0, 0);
+	const __m512i neg1 = _mm512_setr_epi64(-1,-1,-1,-1, 0, 0,-1,-1);
+	const __m512i neg2 = _mm512_setr_epi64(-1,-1,-1,-1,-1,-1, 0, 0);
+
+	__m512i m = _mm512_and_si512(_mm512_xor_si512(b0, neg0), _mm512_xor_si512(b1, neg1));
+	m = _mm512_and_si512(m, _mm512_xor_si512(b2, neg2));
+
+	__m128i t = _mm_andnot_si128(_mm_load_si128(chars+2), _mm_and_si128(_mm_load_si128(chars+1), _mm_load_si128(chars)));
+
+	alignas(64) uint64_t cnt[8];
+
+	for(int i=0;i<k;++i){
+
+		__m128i keep128 = prefix_mask128(offs[i]);
+
+		_mm512_store_si512((__m512i*)cnt, _mm512_popcnt_epi64(_mm512_and_si512(m, _mm512_broadcast_i32x4(keep128))));
+
+		__m128i ti = _mm_and_si128(t, keep128);
+		uint64_t cT = __builtin_popcountll(uint64_t(_mm_cvtsi128_si64(ti))) + __builtin_popcountll(uint64_t(_mm_extract_epi64(ti, 1)));
+
+		out[i] = {cnt[0]+cnt[1], cnt[2]+cnt[3], cnt[4]+cnt[5], cnt[6]+cnt[7], cT};
+
+	}
+
+}
+
+#endif
+
+/*
+ * 2-bit blocks (see dna_string.hpp): words 0-2 = low bit plane, words 3-5 = high bit plane, character i in bit i%64
+ * of word i/64. Encoding: A=00, C=01, G=10, T=11.
+ */
+
+typedef p_rank (*block_rank2_fn)(const uint8_t* block, uint64_t off);
+typedef void (*block_rank2_multi_fn)(const uint8_t* block, const uint64_t* offs, int k, p_rank* out);
+
+struct block_rank2_kernels{
+
+	block_rank2_fn one;
+	block_rank2_multi_fn multi;
+	const char* name;
+
+};
+
+//mask of the characters of word w (0,1,...) among the first off characters of the block
+__attribute__((always_inline)) inline uint64_t prefix_mask64(uint64_t off, int w){
+
+	uint64_t o = off - std::min(off, uint64_t(64*w));
+
+	return o >= 64 ? ~uint64_t(0) : (uint64_t(1) << o) - 1;
+
+}
+
+/*
+ * number of positions 0 < i < len where the character differs from the previous one, in a block encoded as P bit
+ * planes of W words (character i in bit i%64 of word i/64 of each plane): XOR of each plane with itself shifted
+ * by one character, then popcount. Used by the constructions of the strings to count the BWT runs
+ */
+template<int P, int W>
+inline uint64_t plane_breaks(std::array<const uint64_t*, P> planes, uint64_t len){
+
+	uint64_t breaks = 0;
+
+	for(int w = 0; w < W; ++w){
+
+		//bit i: character 64w+i differs from character 64w+i+1
+		uint64_t diff = 0;
+
+		for(int p = 0; p < P; ++p){
+
+			uint64_t next = w+1 < W ? planes[p][w+1] : 0;
+			diff |= planes[p][w] ^ ((planes[p][w] >> 1) | (next << 63));
+
+		}
+
+		breaks += __builtin_popcountll(diff & prefix_mask64(len - std::min(len, uint64_t(1)), w));
+
+	}
+
+	return breaks;
+
+}
+
+__attribute__((always_inline)) inline p_rank block_rank2_scalar_impl(const uint8_t* block, uint64_t off){
+
+	const uint64_t* w = (const uint64_t*)(block);
+
+	uint64_t b0 = 0, b1 = 0, t = 0;
+
+	for(int i=0;i<3;++i){
+
+		uint64_t keep = prefix_mask64(off, i);
+
+		b0 += __builtin_popcountll(w[i] & keep);
+		b1 += __builtin_popcountll(w[i+3] & keep);
+		t += __builtin_popcountll(w[i] & w[i+3] & keep);
+
+	}
+
+	return {off - (b0 + b1 - t), b0 - t, b1 - t, t};
+
+}
+
+__attribute__((always_inline)) inline void block_rank2_multi_scalar_impl(const uint8_t* block, const uint64_t* offs, int k, p_rank* out){
+
+	for(int i=0;i<k;++i) out[i] = block_rank2_scalar_impl(block, offs[i]);
+
+}
+
+inline p_rank block_rank2_scalar(const uint8_t* block, uint64_t off){
+
+	return block_rank2_scalar_impl(block, off);
+
+}
+
+inline void block_rank2_multi_scalar(const uint8_t* block, const uint64_t* offs, int k, p_rank* out){
+
+	block_rank2_multi_scalar_impl(block, offs, k, out);
+
+}
+
+#ifdef BLOCK_RANK_X86
+
+__attribute__((target("popcnt"))) inline p_rank block_rank2_popcnt(const uint8_t* block, uint64_t off){
+
+	return block_rank2_scalar_impl(block, off);
+
+}
+
+__attribute__((target("popcnt"))) inline void block_rank2_multi_popcnt(const uint8_t* block, const uint64_t* offs, int k, p_rank* out){
+
+	block_rank2_multi_scalar_impl(block, offs, k, out);
+
+}
+
+#endif
+
+/*
+ * bit blocks (see byte_string.hpp): word 0 = number of ones before the block, words 1-7 = 448 bits, bit i in bit
+ * i%64 of word 1+i/64. The kernels count the ones among the first off < 448 bits.
+ */
+
+typedef uint64_t (*block_rank1_fn)(const uint8_t* block, uint64_t off);
+typedef void (*block_rank1_multi_fn)(const uint8_t* block, const uint64_t* offs, int k, uint64_t* out);
+
+struct block_rank1_kernels{
+
+	block_rank1_fn one;
+	block_rank1_multi_fn multi;
+	const char* name;
+
+};
+
+__attribute__((always_inline)) inline uint64_t block_rank1_scalar_impl(const uint8_t* block, uint64_t off){
+
+	const uint64_t* w = (const uint64_t*)(block) + 1;
+
+	uint64_t r = 0;
+
+	for(int i=0;i<7;++i) r += __builtin_popcountll(w[i] & prefix_mask64(off, i));
+
+	return r;
+
+}
+
+__attribute__((always_inline)) inline void block_rank1_multi_scalar_impl(const uint8_t* block, const uint64_t* offs, int k, uint64_t* out){
+
+	for(int i=0;i<k;++i) out[i] = block_rank1_scalar_impl(block, offs[i]);
+
+}
+
+inline uint64_t block_rank1_scalar(const uint8_t* block, uint64_t off){
+
+	return block_rank1_scalar_impl(block, off);
+
+}
+
+inline void block_rank1_multi_scalar(const uint8_t* block, const uint64_t* offs, int k, uint64_t* out){
+
+	block_rank1_multi_scalar_impl(block, offs, k, out);
+
+}
+
+#ifdef BLOCK_RANK_X86
+
+__attribute__((target("popcnt"))) inline uint64_t block_rank1_popcnt(const uint8_t* block, uint64_t off){
+
+	return block_rank1_scalar_impl(block, off);
+
+}
+
+__attribute__((target("popcnt"))) inline void block_rank1_multi_popcnt(const uint8_t* block, const uint64_t* offs, int k, uint64_t* out){
+
+	block_rank1_multi_scalar_impl(block, offs, k, out);
+
+}
+
+#endif
+
+/*
+ * fastest kernels supported by the CPU, unless forced with RHO_BLOCK_RANK
+ */
+inline block_rank_kernels select_block_rank(){
+
+	const char* forced = getenv("RHO_BLOCK_RANK");
+	std::string f = forced == NULL ? "" : forced;
+
+	const block_rank_kernels scalar = {block_rank_scalar, block_rank_multi_scalar, "scalar"};
+
+	if(f == "scalar") return scalar;
+
+#ifdef BLOCK_RANK_X86
+
+	const block_rank_kernels popcnt = {block_rank_popcnt, block_rank_multi_popcnt, "popcnt"};
+	const block_rank_kernels avx2 = {block_rank_avx2, block_rank_multi_avx2, "avx2"};
+	const block_rank_kernels avx512 = {block_rank_avx512, block_rank_multi_avx512, "avx512"};
+
+	__builtin_cpu_init();
+
+	bool has_popcnt = __builtin_cpu_supports("popcnt");
+	bool has_avx2 = __builtin_cpu_supports("avx2");
+	bool has_avx512 = __builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512vpopcntdq") and has_popcnt;
+
+	if(f == "popcnt" and has_popcnt) return popcnt;
+	if(f == "avx2" and has_avx2) return avx2;
+	if(f == "avx512" and has_avx512) return avx512;
+
+	if(has_avx512) return avx512;
+	if(has_avx2) return avx2;
+	if(has_popcnt) return popcnt;
+
+#endif
+
+	return scalar;
+
+}
+
+/*
+ * kernels used by dna_string_n (selected once)
+ */
+inline block_rank_kernels block_rank_kernel(){
+
+	static const block_rank_kernels k = select_block_rank();
+	return k;
+
+}
+
+/*
+ * 2-bit kernels: popcnt if supported, unless RHO_BLOCK_RANK=scalar
+ */
+inline block_rank2_kernels select_block_rank2(){
+
+	const char* forced = getenv("RHO_BLOCK_RANK");
+	std::string f = forced == NULL ? "" : forced;
+
+	const block_rank2_kernels scalar = {block_rank2_scalar, block_rank2_multi_scalar, "scalar"};
+
+	if(f == "scalar") return scalar;
+
+#ifdef BLOCK_RANK_X86
+
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("popcnt")) return {block_rank2_popcnt, block_rank2_multi_popcnt, "popcnt"};
+
+#endif
+
+	return scalar;
+
+}
+
+/*
+ * kernels used by dna_string (selected once)
+ */
+inline block_rank2_kernels block_rank2_kernel(){
+
+	static const block_rank2_kernels k = select_block_rank2();
+	return k;
+
+}
+
+/*
+ * bit-block kernels: popcnt if supported, unless RHO_BLOCK_RANK=scalar
+ */
+inline block_rank1_kernels select_block_rank1(){
+
+	const char* forced = getenv("RHO_BLOCK_RANK");
+	std::string f = forced == NULL ? "" : forced;
+
+	const block_rank1_kernels scalar = {block_rank1_scalar, block_rank1_multi_scalar, "scalar"};
+
+	if(f == "scalar") return scalar;
+
+#ifdef BLOCK_RANK_X86
+
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("popcnt")) return {block_rank1_popcnt, block_rank1_multi_popcnt, "popcnt"};
+
+#endif
+
+	return scalar;
+
+}
+
+/*
+ * kernels used by byte_string (selected once)
+ */
+inline block_rank1_kernels block_rank1_kernel(){
+
+	static const block_rank1_kernels k = select_block_rank1();
+	return k;
+
+}
+
+#endif /* INTERNAL_BLOCK_RANK_HPP_ */
@@ -0,0 +1,491 @@
+#include "include.hpp"
+#include "byte_string.hpp"
+#include "index_file.hpp"
+
+#ifndef INTERNAL_BYTE_BWT_HPP_
+#define INTERNAL_BYTE_BWT_HPP_
+
+/*
+ * BWT index with suffix tree navigation on a general byte alphabet (proteins, text, ...), stored in a byte_string
+ * (wavelet matrix). The alphabet is byte_alphabet<S>: nodes have S+2 boundaries, where S is a capacity at least as
+ * large as the number of letters of the BWT (letters beyond it have empty intervals). The instances below cover up
+ * to 31 letters (e.g. proteins), 127 letters (7-bit ASCII text) and 255 letters (any byte).
+ *
+ * Unlike dna_bwt, the Weiner children are not computed with a full rank per letter at each boundary: the letters
+ * preceding the interval of a node are enumerated by byte_string::left_extensions, and only the right-maximal
+ * children are built (see get_weiner_children).
+ */
+template<class alphabet_type>
+class byte_bwt{
+
+public:
+
+	typedef alphabet_type alphabet;
+
+	static constexpr int sigma = alphabet::sigma;
+
+	static_assert(sigma + 2 <= MAX_POS_WM, "byte alphabets have at most 255 letters");
+
+	typedef alpha_node<alphabet> sa_node_t;
+	typedef flags<alphabet> flags_t;
+
+	byte_bwt(){};
+
+	/*
+	 * constructor path of a BWT file containing the BWT in ASCII format. The string is built using the given number of threads
+	 */
+	byte_bwt(string path, char TERM = '#', int threads = 1) : TERM(TERM){
+
+		n = input_file_size(path);
+
+		BWT = byte_string(path, TERM, threads);
+
+		runs = BWT.run_breaks();
+
+		if(BWT.sigma() > uint64_t(sigma)){
+
+			throw make_error("the BWT has ", BWT.sigma(), " letters, more than the ", sigma, " of this index");
+
+		}
+
+		//F column from the letter counts; letters not in the BWT start at the end
+		letters = BWT.sigma();
+
+		F.fill(n);
+
+		uint64_t f = BWT.terminators();
+
+		for(uint64_t c=0;c<letters;++c){
+
+			F[c] = f;
+			f += BWT.count(c);
+
+		}
+
+	}
+
+	char operator[](uint64_t i){
+
+		return BWT[i];
+
+	}
+
+	/*
+	 * number of c before position i excluded
+	 */
+	uint64_t rank(uint64_t i, uint8_t c){
+
+		assert(i<=n);
+
+		return BWT.rank(i,c);
+
+	}
+
+	uint64_t size(){
+
+		assert(n == BWT.size());
+		return n;
+
+	}
+
+	//bytes used by the BWT representation
+	uint64_t bytes(){
+		return BWT.bytes();
+	}
+
+	//number of letters of the BWT (at most sigma)
+	uint64_t alphabet_size(){
+		return letters;
+	}
+
+	//levels of the wavelet matrix
+	uint64_t levels(){
+		return BWT.n_levels();
+	}
+
+	/*
+	 * the layout does not depend on the capacity sigma: n, number of letters, F for 255 letters, string
+	 */
+	uint64_t serialize(std::ostream& out){
+
+		uint64_t w_bytes = 0;
+
+		std::array<uint64_t, 255> F_all;
+		F_all.fill(n);
+		std::copy(F.begin(), F.begin() + letters, F_all.begin());
+
+		out.write((char*)&n,sizeof(n));
+		out.write((char*)&letters,sizeof(letters));
+		out.write((char*)F_all.data(),sizeof(F_all));
+
+		w_bytes += sizeof(n) + sizeof(letters) + sizeof(F_all);
+
+		w_bytes += BWT.serialize(out);
+
+		return w_bytes;
+
+	}
+
+	/* load the structure from the istream
+	 * \param in the istream
+	 */
+	void load(std::istream& in) {
+
+		std::array<uint64_t, 255> F_all;
+
+		in.read((char*)&n,sizeof(n));
+		in.read((char*)&letters,sizeof(letters));
+		in.read((char*)F_all.data(),sizeof(F_all));
+
+		set_F(F_all.data());
+
+		BWT.load(in);
+
+	}
+
+	/*
+	 * zero-copy load from a memory-mapped file containing the serialization of the structure at the
+	 * given offset (see byte_string::load). Returns the offset following the structure.
+	 */
+	uint64_t load(std::shared_ptr<mapped_file> file, uint64_t offset){
+
+		if(offset + 257*sizeof(uint64_t) > file->size()){
+
+			throw make_error("truncated index file");
+
+		}
+
+		uint64_t* header = (uint64_t*)(file->data() + offset);
+
+		n = header[0];
+		letters = header[1];
+		set_F(header + 2);
+
+		return BWT.load(file, offset + 257*sizeof(uint64_t));
+
+	}
+
+	/*
+	 * hash of BWT length, F column, number of runs, terminator and of the string's metadata
+	 * (blocks excluded, see byte_string::checksum)
+	 */
+	uint64_t checksum(){
+
+		uint64_t term = uint8_t(TERM);
+		uint64_t h = fnv1a(&n, sizeof(n));
+
+		h = fnv1a(&letters, sizeof(letters), h);
+		h = fnv1a(F.data(), sizeof(uint64_t)*letters, h);
+		h = fnv1a(&runs, sizeof(runs), h);
+		h = fnv1a(&term, sizeof(term), h);
+
+		uint64_t hs = BWT.checksum();
+
+		return fnv1a(&hs, sizeof(hs), h);
+
+	}
+
+	/*
+	 * store header (magic, version, terminator, checksums) and index to file. The checksum of the data is computed
+	 * by reading the file back
+	 */
+	void save_to_file(string path){
+
+		index_header h = make_header();
+
+		std::ofstream out(path, std::ios::binary);
+		out.write((char*)&h, sizeof(h));
+		serialize(out);
+		out.close();
+
+		if(not out){
+
+			throw make_error("cannot write index file ", path);
+
+		}
+
+		seal_index_file(path);
+
+	}
+
+	/*
+	 * path = path of an index file. The index is copied in memory, and the checksum of all its data is verified
+	 */
+	void load_from_file(string path){
+
+		index_header h;
+
+		std::ifstream in(path, std::ios::binary);
+		in.read((char*)&h, sizeof(h));
+		check_header(h, path);
+		check_data_checksum(h, index_data_checksum(path), path);
+
+		load(in);
+		in.close();
+
+		set_header(h, path);
+
+	}
+
+	/*
+	 * path = path of an index file. The index is memory-mapped instead of being copied in memory. Only the metadata
+	 * are verified, unless verify: then the checksum of all the data is too (which reads the whole file)
+	 */
+	void map_from_file(string path, bool verify = false){
+
+		auto file = std::make_shared<mapped_file>(path);
+
+		if(file->size() < sizeof(index_header)){
+
+			throw make_error(path, " is not a valid index file");
+
+		}
+
+		index_header h = *(index_header*)file->data();
+		check_header(h, path);
+
+		if(verify) check_data_checksum(h, fnv1a(file->data() + sizeof(index_header), file->size() - sizeof(index_header)), path);
+
+		load(file, sizeof(index_header));
+
+		set_header(h, path);
+
+	}
+
+
+	/*
+	 * functions for suffix tree navigation
+	 */
+
+	sa_node_t root(){
+
+		sa_node_t x;
+
+		x.bounds[0] = 0;
+		for(int c=0;c<sigma;++c) x.bounds[c+1] = F[c];
+		x.bounds[sigma+1] = n;
+		x.depth = 0;
+
+		return x;
+
+	}
+
+	//number of BWT equal-letter runs, as in dna_bwt::r (counted by the string during its construction)
+	uint64_t r(){
+
+		return runs;
+
+	}
+
+	char terminator(){
+		return TERM;
+	}
+
+	/*
+	 * number of occurrences of P in the text, by backward search. P may not contain the terminator
+	 */
+	uint64_t count(string P){
+
+		uint64_t l = 0, r = n;
+
+		for(uint64_t i = P.size(); i > 0 and l < r; --i){
+
+			uint64_t c = 0;
+			while(c < letters and BWT.letter(c) != P[i-1]) c++;
+
+			if(c == letters) return 0;
+
+			l = F[c] + BWT.rank(l, uint8_t(P[i-1]));
+			r = F[c] + BWT.rank(r, uint8_t(P[i-1]));
+
+		}
+
+		return r - l;
+
+	}
+
+	/*
+	 * number of rank queries (LF calls, each for all the letters) of get_weiner_children(N): one per distinct boundary
+	 */
+	int lf_queries(sa_node_t & N){
+
+		uint64_t pos[sigma+2];
+		return boundaries(N, pos);
+
+	}
+
+	/*
+	 * prefetch the memory that get_weiner_children(N) will access first
+	 */
+	void prefetch(sa_node_t & N){
+
+		uint64_t pos[sigma+2];
+		int m = boundaries(N, pos);
+
+		BWT.prefetch_multi(pos, m);
+
+	}
+
+	//follow Weiner links from node x and push on the stack the resulting right-maximal nodes (at most sigma).
+	//Does not modify the index: can be called concurrently by several threads.
+	void get_weiner_children(sa_node_t & x, sa_node_t * TMP_NODES, int & t){
+
+		//distinct boundaries of x, and the one corresponding to each boundary of x
+		uint64_t pos[sigma+2];
+		uint16_t idx[sigma+2];
+
+		int m = boundaries(x, pos, idx);
+
+		t = 0;
+
+		BWT.template left_extensions<sigma+2>(pos, m, [&](uint64_t c, const uint64_t* r){
+
+			//cW is right-maximal iff at least two of its right extensions (intervals between boundaries) are non-empty
+			int k = 0;
+			for(int i=1;i<m;++i) k += r[i] > r[i-1];
+
+			if(k < 2) return;
+
+			sa_node_t & y = TMP_NODES[t++];
+
+			for(int j=0;j<sigma+2;++j) y.bounds[j] = F[c] + r[idx[j]];
+			y.depth = x.depth+1;
+
+		});
+
+		//return right-maximal nodes in increasing size (i.e. interval length) order
+
+		sort_nodes_by_size(TMP_NODES, t);
+
+	}
+
+private:
+
+	/*
+	 * distinct boundaries of N, in pos; idx[j] (if given) = index in pos of N.bounds[j]. Returns their number
+	 */
+	int boundaries(sa_node_t & N, uint64_t * pos, uint16_t * idx = NULL){
+
+		int m = 0;
+
+		for(int j=0;j<sigma+2;++j){
+
+			if(m == 0 or N.bounds[j] != pos[m-1]) pos[m++] = N.bounds[j];
+			if(idx != NULL) idx[j] = uint16_t(m-1);
+
+		}
+
+		return m;
+
+	}
+
+	//F from the first 'letters' values of F_all
+	void set_F(const uint64_t * F_all){
+
+		if(letters > uint64_t(sigma)){
+
+			throw make_error("the index has ", letters, " letters, more than the ", sigma, " of this instance");
+
+		}
+
+		F.fill(n);
+		std::copy(F_all, F_all + letters, F.begin());
+
+	}
+
+	index_header make_header(){
+
+		index_header h = {};
+
+		std::copy(INDEX_MAGIC, INDEX_MAGIC+8, h.magic);
+		h.version = INDEX_VERSION;
+		h.TERM = uint8_t(TERM);
+		h.n = n;
+		h.runs = r();
+		h.checksum = checksum();
+		h.string_type = byte_string::type_id();
+
+		return h;
+
+	}
+
+	void check_header(index_header & h, string path){
+
+		if(not std::equal(h.magic, h.magic+8, INDEX_MAGIC)){
+
+			throw make_error(path, " is not a valid index file");
+
+		}
+
+		if(h.version != INDEX_VERSION){
+
+			throw make_error("index file ", path, " has version ", h.version, ", expected ", INDEX_VERSION);
+
+		}
+
+		if(h.string_type != byte_string::type_id()){
+
+			throw make_error("index file ", path, " stores a different BWT representation (type ", h.string_type, ")");
+
+		}
+
+	}
+
+	//to be called after the structure has been loaded
+	void set_header(index_header & h, string path){
+
+		TERM = char(h.TERM);
+		runs = h.runs;
+
+		if(h.n != n or BWT.size() != n or h.checksum != checksum()){
+
+			throw make_error("index file ", path, " is corrupted (checksum mismatch)");
+
+		}
+
+	}
+
+	char TERM = '#';
+
+	uint64_t runs = 0;
+
+	uint64_t n = 0;//BWT length
+
+	uint64_t letters = 0; //number of letters of the BWT
+
+	std::array<uint64_t, sigma> F {}; //F array: F[c] = first position of letter c in the F column (n if c >= letters)
+
+	byte_string BWT;
+
+};
+
+template<class alphabet_type>
+constexpr int byte_bwt<alphabet_type>::sigma;
+
+typedef byte_bwt<byte_alphabet<31> > byte_bwt_31_t;
+typedef byte_bwt<byte_alphabet<127> > byte_bwt_127_t;
+typedef byte_bwt<byte_alphabet<255> > byte_bwt_255_t;
+
+/*
+ * number of letters of the BWT stored in the index file at path (written by byte_bwt::save_to_file)
+ */
+inline uint64_t index_alphabet_size(string path){
+
+	index_header h = {};
+	uint64_t header[2] = {};
+
+	std::ifstream in(path, std::ios::binary);
+	in.read((char*)&h, sizeof(h));
+	in.read((char*)header, sizeof(header));
+
+	if(not in or h.string_type != byte_string::type_id()){
+
+		throw make_error(path, " is not a valid index file");
+
+	}
+
+	return header[1];
+
+}
+
+#endif /* INTERNAL_BYTE_BWT_HPP_ */
@@ -0,0 +1,740 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * byte_string.hpp
+ *
+ *  String with rank on a general byte alphabet (proteins, text, ...), used by byte_bwt (see byte_bwt.hpp).
+ *
+ *  The sigma distinct bytes of the string other than the terminator are its letters: the c-th smallest is letter c
+ *  and has code c+1, the terminator has code 0. Codes are stored in a wavelet matrix with L = ceil(log2(sigma+1))
+ *  levels: level l is a bitvector holding bit L-1-l of the codes, in the order obtained by stably partitioning the
+ *  string by the bits of the previous levels (zeros first). Following position i through the levels (i -> i - rank1(i)
+ *  on a 0 bit, i -> Z + rank1(i) on a 1 bit, Z = number of zeros of the level) gives start(x) + rank_x(i), where
+ *  start(x) is the position reached from 0 by code x.
+ *
+ *  left_extensions computes, for every letter occurring in a range, its rank at several sorted positions of the range:
+ *  the positions descend the levels together, and only the branches of the matrix that are non-empty in the range are
+ *  followed. On a suffix tree node with k left extensions this costs O(k L) block lookups instead of the O(sigma)
+ *  ranks per boundary of the DNA strings, so that the traversal stays fast on large alphabets.
+ *
+ *  Each level is stored and cache-aligned in blocks of 512 bits: the number of ones before the block (64 bits)
+ *  followed by 448 bits. A rank costs 1 cache miss per level, shared by the positions falling in the same block.
+ *
+ *  Like the DNA strings, the structure can be serialized and then loaded (copy) or memory-mapped (zero-copy).
+ *
+ *  Size of the string: 512/448 L < 1.15 L n bits, where n = string length. The construction uses 2n more bytes
+ *  (the codes, in the order of the current and of the next level).
+ *
+ */
+
+#ifndef INTERNAL_BYTE_STRING_HPP_
+#define INTERNAL_BYTE_STRING_HPP_
+
+#define BLOCK_SIZE_WM 448			//number of bits inside a block
+#define BYTES_PER_BLOCK_WM 64		//bytes in a block of 512 bits
+#define ALN_WM 64					//alignment
+#define BLOCKS_PER_CHUNK_WM 4096	//blocks built at once by a construction thread (about 1.8 MB of input)
+#define MAX_LEVELS_WM 8				//levels for 256 codes (255 letters and the terminator)
+#define MAX_POS_WM 257				//positions accepted by left_extensions (boundaries of a node with 255 letters)
+
+#include "include.hpp"
+#include "block_rank.hpp"
+#include "mapped_file.hpp"
+#include <memory>
+#include <atomic>
+#include <thread>
+
+class byte_string{
+
+public:
+
+	//written in index files (see byte_bwt::save_to_file)
+	static uint64_t type_id(){
+		return 3;
+	}
+
+	byte_string(){}
+
+	/*
+	 * constructor from ASCII file. The file is read and each level is built in parallel chunks of BLOCKS_PER_CHUNK_WM
+	 * blocks (see dna_string_n for the chunked construction).
+	 */
+	byte_string(string path, char TERM = '#', int threads = 1){
+
+		this->TERM = TERM;
+
+		n = input_file_size(path);
+
+		n_blocks = n/BLOCK_SIZE_WM + 1; //also position n (rank of the whole string) falls in a block
+
+		uint64_t n_chunks = n_blocks/BLOCKS_PER_CHUNK_WM + (n_blocks%BLOCKS_PER_CHUNK_WM != 0);
+		uint64_t chunk_size = BLOCKS_PER_CHUNK_WM*BLOCK_SIZE_WM;
+
+		//the string in the order of the current level, padded to whole blocks
+		vector<uint8_t> cur(n_blocks*BLOCK_SIZE_WM, 0);
+
+		vector<std::array<uint64_t, 256> > chunk_count(n_chunks);
+		vector<uint64_t> chunk_breaks(n_chunks);
+
+		//read the chunks, count the bytes and the positions i > 0 of the chunk such that S[i] != S[i-1]
+		parallel_for_chunks(n_chunks, threads, [&](uint64_t c){
+
+			uint64_t from = std::min(c*chunk_size, n);
+			uint64_t len = std::min((c+1)*chunk_size, n) - from;
+
+			read_file_range(path, (char*)cur.data() + from, from, len);
+
+			std::array<uint64_t, 256> cnt {};
+			uint64_t br = 0;
+
+			for(uint64_t i = from; i < from+len; ++i){
+
+				cnt[cur[i]]++;
+				br += i > from and cur[i] != cur[i-1];
+
+			}
+
+			chunk_count[c] = cnt;
+			chunk_breaks[c] = br;
+
+		});
+
+		std::array<uint64_t, 256> byte_count {};
+
+		breaks = 0;
+
+		for(uint64_t c = 0; c < n_chunks; ++c){
+
+			for(int b = 0; b < 256; ++b) byte_count[b] += chunk_count[c][b];
+
+			breaks += chunk_breaks[c];
+
+			if(c > 0 and c*chunk_size < n) breaks += cur[c*chunk_size] != cur[c*chunk_size-1];
+
+		}
+
+		//alphabet: the terminator has code 0, letters are the other bytes, in increasing order
+		std::array<uint8_t, 256> code {};
+
+		sigma_ = 0;
+		counts.fill(0);
+		letters.fill(0);
+
+		counts[0] = byte_count[uint8_t(TERM)];
+		n_terms = counts[0];
+
+		for(int b = 0; b < 256; ++b){
+
+			if(b == uint8_t(TERM) or byte_count[b] == 0) continue;
+
+			code[b] = uint8_t(++sigma_);
+			letters[sigma_] = uint8_t(b);
+			counts[sigma_] = byte_count[b];
+
+		}
+
+		levels = 1;
+		while((uint64_t(1) << levels) <= sigma_) levels++;
+
+		nbytes = levels*n_blocks*BYTES_PER_BLOCK_WM;
+
+		memory = std::unique_ptr<uint8_t[]>(new uint8_t[nbytes+ALN_WM]);
+		data = memory.get();
+		while(uint64_t(data) % ALN_WM != 0) data++;
+
+		parallel_for_chunks(n_chunks, threads, [&](uint64_t c){
+
+			uint64_t end = std::min((c+1)*chunk_size, n);
+			for(uint64_t i = c*chunk_size; i < end; ++i) cur[i] = code[cur[i]];
+
+		});
+
+		vector<uint8_t> next(levels > 1 ? cur.size() : 0, 0);
+
+		vector<uint64_t> chunk_ones(n_chunks);
+
+		for(uint64_t l = 0; l < levels; ++l){
+
+			uint64_t shift = levels-1-l;
+
+			//phase 1: bits of the level and number of ones of each chunk
+			parallel_for_chunks(n_chunks, threads, [&](uint64_t c){
+
+				uint64_t ones = 0;
+
+				for(uint64_t bl = c*BLOCKS_PER_CHUNK_WM; bl < std::min((c+1)*BLOCKS_PER_CHUNK_WM, n_blocks); ++bl){
+
+					uint64_t* words = block(l, bl);
+
+					for(int w = 0; w < 7; ++w){
+
+						words[w+1] = pack_bits(cur.data() + bl*BLOCK_SIZE_WM + 64*w, shift);
+						ones += __builtin_popcountll(words[w+1]);
+
+					}
+
+				}
+
+				chunk_ones[c] = ones;
+
+			});
+
+			//ones before each chunk
+			uint64_t tot = 0;
+
+			for(uint64_t c = 0; c < n_chunks; ++c){
+
+				uint64_t o = chunk_ones[c];
+				chunk_ones[c] = tot;
+				tot += o;
+
+			}
+
+			Z[l] = n - tot;
+
+			//phase 2: block counters, and the string in the order of the next level
+			parallel_for_chunks(n_chunks, threads, [&](uint64_t c){
+
+				uint64_t ones = chunk_ones[c];
+
+				for(uint64_t bl = c*BLOCKS_PER_CHUNK_WM; bl < std::min((c+1)*BLOCKS_PER_CHUNK_WM, n_blocks); ++bl){
+
+					uint64_t* words = block(l, bl);
+
+					words[0] = ones;
+					for(int w = 0; w < 7; ++w) ones += __builtin_popcountll(words[w+1]);
+
+				}
+
+				if(l+1 == levels) return;
+
+				uint64_t from = std::min(c*chunk_size, n);
+				uint64_t end = std::min((c+1)*chunk_size, n);
+
+				uint64_t zero_pos = from - chunk_ones[c];
+				uint64_t one_pos = Z[l] + chunk_ones[c];
+
+				for(uint64_t i = from; i < end; ++i){
+
+					if((cur[i] >> shift) & 1) next[one_pos++] = cur[i];
+					else next[zero_pos++] = cur[i];
+
+				}
+
+			});
+
+			if(l+1 < levels) cur.swap(next);
+
+		}
+
+		cur = vector<uint8_t>();
+		next = vector<uint8_t>();
+
+		init_codes();
+
+		assert(check_content(path));
+
+	}
+
+	//return i-th character
+	char operator[](uint64_t i){
+
+		assert(i<n);
+
+		uint64_t x = 0;
+
+		for(uint64_t l = 0; l < levels; ++l){
+
+			uint64_t b = bit(l, i);
+			uint64_t r1 = rank1(l, i);
+
+			x = (x << 1) | b;
+			i = b ? Z[l] + r1 : i - r1;
+
+		}
+
+		return x == 0 ? TERM : char(letters[x]);
+
+	}
+
+	/*
+	 * standard rank: number of c before position i excluded. c can be any byte (0 if it does not occur) or TERM
+	 */
+	uint64_t rank(uint64_t i, uint8_t c){
+
+		assert(i<=n);
+
+		if(c != uint8_t(TERM) and code_of[c] == 0) return 0;
+
+		uint64_t x = c == uint8_t(TERM) ? 0 : code_of[c];
+
+		for(uint64_t l = 0; l < levels; ++l){
+
+			uint64_t r1 = rank1(l, i);
+			i = ((x >> (levels-1-l)) & 1) ? Z[l] + r1 : i - r1;
+
+		}
+
+		return i - start[x];
+
+	}
+
+	/*
+	 * rank of all the letters occurring in [pos[0], pos[m-1]), at the m <= M positions pos[0] <= ... <= pos[m-1]:
+	 * calls f(c, r) for every such letter c (in increasing order), where r[k] = number of c before position pos[k].
+	 * r is valid only during the call. M <= MAX_POS_WM sizes the buffers (on the stack).
+	 */
+	template<int M, class F>
+	void left_extensions(const uint64_t* pos, int m, F f){
+
+		static_assert(M <= MAX_POS_WM, "too many positions");
+		assert(m <= M);
+
+		//positions of the current branch at each level: zeros side and ones side
+		uint64_t buf[MAX_LEVELS_WM+1][2][M];
+
+		if(m > 0 and pos[m-1] > pos[0]) descend<M>(0, 0, pos, m, buf, f);
+
+	}
+
+	/*
+	 * software prefetch of the first-level blocks containing the positions pos[0] <= ... <= pos[m-1] (the blocks
+	 * of the next levels depend on the ranks). Positions falling in the block of the previous one are skipped
+	 */
+	inline void prefetch_multi(const uint64_t* pos, int m){
+
+		for(int i=0;i<m;++i)
+			if(i == 0 or pos[i]/BLOCK_SIZE_WM != pos[i-1]/BLOCK_SIZE_WM) __builtin_prefetch(block(0, pos[i]/BLOCK_SIZE_WM));
+
+	}
+
+	//number of letters (terminator excluded)
+	uint64_t sigma(){
+		return sigma_;
+	}
+
+	//the c-th letter, c < sigma()
+	char letter(uint64_t c){
+		return char(letters[c+1]);
+	}
+
+	//number of occurrences of the c-th letter
+	uint64_t count(uint64_t c){
+		return counts[c+1];
+	}
+
+	uint64_t terminators(){
+		return n_terms;
+	}
+
+	//number of positions i > 0 such that S[i] != S[i-1], counted during the construction
+	uint64_t run_breaks(){
+		return breaks;
+	}
+
+	uint64_t n_levels(){
+		return levels;
+	}
+
+	uint64_t serialize(std::ostream& out){
+
+		uint64_t w_bytes = 0;
+
+		uint64_t term = uint8_t(TERM);
+
+		out.write((char*)&n,sizeof(n));
+		out.write((char*)&n_blocks,sizeof(n_blocks));
+		out.write((char*)&levels,sizeof(levels));
+		out.write((char*)&sigma_,sizeof(sigma_));
+		out.write((char*)&term,sizeof(term));
+		out.write((char*)&n_terms,sizeof(n_terms));
+		out.write((char*)&breaks,sizeof(breaks));
+
+		w_bytes += 7*sizeof(uint64_t);
+
+		//alphabet and level metadata, then the blocks at a 64-byte file offset, so that they can be memory-mapped
+		w_bytes += write_padding(out);
+
+		out.write((char*)Z.data(),sizeof(Z));
+		out.write((char*)start.data(),sizeof(start));
+		out.write((char*)counts.data(),sizeof(counts));
+		out.write((char*)letters.data(),sizeof(letters));
+
+		w_bytes += sizeof(Z) + sizeof(start) + sizeof(counts) + sizeof(letters);
+
+		w_bytes += write_padding(out);
+
+		out.write((char*)data,nbytes*sizeof(uint8_t));
+		w_bytes += nbytes*sizeof(uint8_t);
+
+		return w_bytes;
+
+	}
+
+	void load(std::istream& in) {
+
+		uint64_t term = 0;
+
+		in.read((char*)&n,sizeof(n));
+		in.read((char*)&n_blocks,sizeof(n_blocks));
+		in.read((char*)&levels,sizeof(levels));
+		in.read((char*)&sigma_,sizeof(sigma_));
+		in.read((char*)&term,sizeof(term));
+		in.read((char*)&n_terms,sizeof(n_terms));
+		in.read((char*)&breaks,sizeof(breaks));
+
+		TERM = char(term);
+
+		skip_padding(in);
+
+		in.read((char*)Z.data(),sizeof(Z));
+		in.read((char*)start.data(),sizeof(start));
+		in.read((char*)counts.data(),sizeof(counts));
+		in.read((char*)letters.data(),sizeof(letters));
+
+		skip_padding(in);
+
+		nbytes = levels*n_blocks*BYTES_PER_BLOCK_WM;
+
+		memory = std::unique_ptr<uint8_t[]>(new uint8_t[nbytes+ALN_WM]);
+		data = memory.get();
+		while(uint64_t(data) % ALN_WM != 0) data++;
+		in.read((char*)data,nbytes*sizeof(uint8_t));
+
+		init_codes();
+
+	}
+
+	/*
+	 * zero-copy load from a memory-mapped file containing the serialization of the string at the given
+	 * offset (see dna_string_n::load). Returns the offset following the structure.
+	 */
+	uint64_t load(std::shared_ptr<mapped_file> file, uint64_t offset){
+
+		uint8_t* base = file->data();
+
+		if(offset + 7*sizeof(uint64_t) > file->size()){
+
+			throw make_error("truncated index file");
+
+		}
+
+		uint64_t* header = (uint64_t*)(base + offset);
+
+		n = header[0];
+		n_blocks = header[1];
+		levels = header[2];
+		sigma_ = header[3];
+		TERM = char(header[4]);
+		n_terms = header[5];
+		breaks = header[6];
+
+		offset = padded(offset + 7*sizeof(uint64_t));
+
+		uint64_t meta = sizeof(Z) + sizeof(start) + sizeof(counts) + sizeof(letters);
+
+		if(levels > MAX_LEVELS_WM or offset + meta > file->size()){
+
+			throw make_error("truncated index file");
+
+		}
+
+		memcpy(Z.data(), base + offset, sizeof(Z));
+		memcpy(start.data(), base + offset + sizeof(Z), sizeof(start));
+		memcpy(counts.data(), base + offset + sizeof(Z) + sizeof(start), sizeof(counts));
+		memcpy(letters.data(), base + offset + sizeof(Z) + sizeof(start) + sizeof(counts), sizeof(letters));
+
+		offset = padded(offset + meta);
+
+		nbytes = levels*n_blocks*BYTES_PER_BLOCK_WM;
+
+		memory.reset();
+
+		data = base + offset;
+		offset += nbytes;
+
+		if(offset > file->size()){
+
+			throw make_error("truncated index file");
+
+		}
+
+		assert(uint64_t(data) % ALN_WM == 0);
+
+		mapping = file;
+
+		init_codes();
+
+		return offset;
+
+	}
+
+	uint64_t size(){
+		return n;
+	}
+
+	//bytes used by the structure
+	uint64_t bytes(){
+		return nbytes + sizeof(Z) + sizeof(start) + sizeof(counts) + sizeof(letters);
+	}
+
+	/*
+	 * hash of the sizes, of the terminator and of the alphabet and level metadata (blocks excluded, see
+	 * dna_string_n::checksum)
+	 */
+	uint64_t checksum(){
+
+		uint64_t term = uint8_t(TERM);
+
+		uint64_t h = fnv1a(&n, sizeof(n));
+		h = fnv1a(&n_blocks, sizeof(n_blocks), h);
+		h = fnv1a(&levels, sizeof(levels), h);
+		h = fnv1a(&sigma_, sizeof(sigma_), h);
+		h = fnv1a(&term, sizeof(term), h);
+		h = fnv1a(&n_terms, sizeof(n_terms), h);
+		h = fnv1a(&breaks, sizeof(breaks), h);
+		h = fnv1a(Z.data(), sizeof(Z), h);
+		h = fnv1a(start.data(), sizeof(start), h);
+		h = fnv1a(counts.data(), sizeof(counts), h);
+
+		return fnv1a(letters.data(), sizeof(letters), h);
+
+	}
+
+private:
+
+	//bl-th block of level l
+	inline uint64_t* block(uint64_t l, uint64_t bl){
+
+		return (uint64_t*)(data + (l*n_blocks + bl)*BYTES_PER_BLOCK_WM);
+
+	}
+
+	//number of ones of level l in positions [0,i)
+	inline uint64_t rank1(uint64_t l, uint64_t i){
+
+		uint64_t* b = block(l, i/BLOCK_SIZE_WM);
+
+		return b[0] + rank_kernel.one((uint8_t*)b, i%BLOCK_SIZE_WM);
+
+	}
+
+	inline uint64_t bit(uint64_t l, uint64_t i){
+
+		uint64_t off = i%BLOCK_SIZE_WM;
+
+		return (block(l, i/BLOCK_SIZE_WM)[1 + off/64] >> (off%64)) & 1;
+
+	}
+
+	/*
+	 * out[k] = rank1(l, pos[k]) for the sorted positions pos[0..m-1]. Positions in the same block share its lookup
+	 */
+	template<int M>
+	inline void rank1_multi(uint64_t l, const uint64_t* pos, int m, uint64_t* out){
+
+		uint64_t offs[M];
+
+		int i = 0;
+
+		while(i<m){
+
+			uint64_t bl = pos[i]/BLOCK_SIZE_WM;
+			uint64_t block_start = bl*BLOCK_SIZE_WM;
+
+			int j = i;
+			while(j<m and pos[j] - block_start < BLOCK_SIZE_WM){
+
+				offs[j-i] = pos[j] - block_start;
+				j++;
+
+			}
+
+			uint64_t* b = block(l, bl);
+
+			rank_kernel.multi((uint8_t*)b, offs, j-i, out+i);
+
+			for(int h=i;h<j;++h) out[h] += b[0];
+
+			i = j;
+
+		}
+
+	}
+
+	/*
+	 * positions pos[0..m-1] (pos[0] < pos[m-1]) on level l, in the branch of the codes starting with the bits of x:
+	 * follow the non-empty children (see left_extensions)
+	 */
+	template<int M, class F>
+	void descend(uint64_t l, uint64_t x, const uint64_t* pos, int m, uint64_t (*buf)[2][M], F& f){
+
+		if(l == levels){
+
+			//the terminator has no Weiner link
+			if(x == 0) return;
+
+			uint64_t* r = buf[l][0];
+			for(int k=0;k<m;++k) r[k] = pos[k] - start[x];
+
+			f(x-1, (const uint64_t*)r);
+
+			return;
+
+		}
+
+		uint64_t* zeros = buf[l][0];
+		uint64_t* ones = buf[l][1];
+
+		rank1_multi<M>(l, pos, m, ones);
+
+		for(int k=0;k<m;++k){
+
+			zeros[k] = pos[k] - ones[k];
+			ones[k] += Z[l];
+
+		}
+
+		if(zeros[m-1] > zeros[0]) descend<M>(l+1, x << 1, zeros, m, buf, f);
+		if(ones[m-1] > ones[0]) descend<M>(l+1, (x << 1) | 1, ones, m, buf, f);
+
+	}
+
+	/*
+	 * bit 'shift' of the 64 bytes at s, packed in a word (byte i -> bit i)
+	 */
+	static uint64_t pack_bits(const uint8_t* s, uint64_t shift){
+
+		uint64_t w = 0;
+
+		for(int g = 0; g < 8; ++g){
+
+			uint64_t x;
+			memcpy(&x, s + 8*g, 8);
+
+			//the multiplication gathers the lowest bit of the 8 bytes in the top byte
+			w |= ((((x >> shift) & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56) << (8*g);
+
+		}
+
+		return w;
+
+	}
+
+	/*
+	 * code of each byte and position reached from 0 by each code (to be called once the levels are built or loaded)
+	 */
+	void init_codes(){
+
+		code_of.fill(0);
+
+		for(uint64_t x = 1; x <= sigma_; ++x) code_of[letters[x]] = uint8_t(x);
+
+		start.fill(0);
+
+		for(uint64_t x = 0; x <= sigma_; ++x){
+
+			uint64_t i = 0;
+
+			for(uint64_t l = 0; l < levels; ++l){
+
+				uint64_t r1 = rank1(l, i);
+				i = ((x >> (levels-1-l)) & 1) ? Z[l] + r1 : i - r1;
+
+			}
+
+			start[x] = i;
+
+		}
+
+	}
+
+	//round offset up to the next multiple of ALN_WM
+	static uint64_t padded(uint64_t offset){
+		return ((offset + ALN_WM - 1)/ALN_WM)*ALN_WM;
+	}
+
+	//pad the stream with zeros up to the next 64-byte offset. Returns the number of written bytes
+	static uint64_t write_padding(std::ostream& out){
+
+		uint64_t pos = uint64_t(out.tellp());
+		uint64_t pad = padded(pos) - pos;
+
+		char zeros[ALN_WM] = {};
+		out.write(zeros, pad);
+
+		return pad;
+
+	}
+
+	static void skip_padding(std::istream& in){
+
+		uint64_t pos = uint64_t(in.tellg());
+		in.seekg(padded(pos));
+
+	}
+
+	/*
+	 * check that the string contains exactly the same characters as the file in path
+	 */
+	bool check_content(string path){
+
+		ifstream ifs(path);
+
+		bool res = true;
+
+		for(uint64_t i=0;i<n;++i){
+
+			char c;
+			ifs.read((char*)&c, sizeof(char));
+
+			if(operator[](i) != c) res = false;
+
+		}
+
+		if(res){
+
+			cout << "string content is valid" << endl;
+
+		}else{
+
+			cout << "string content is not valid" << endl;
+
+		}
+
+		return res;
+
+	}
+
+	char TERM = '#';
+
+	//in-block rank kernel, selected at runtime for this CPU
+	block_rank1_kernels rank_kernel = block_rank1_kernel();
+
+	uint64_t n_blocks = 0;	//blocks per level
+	uint64_t levels = 0;
+	uint64_t sigma_ = 0;	//number of letters
+	uint64_t n_terms = 0;
+	uint64_t breaks = 0;	//see run_breaks()
+
+	std::array<uint64_t, MAX_LEVELS_WM> Z {};	//number of zeros of each level
+	std::array<uint64_t, 256> start {};		//position reached from 0 by each code
+	std::array<uint64_t, 256> counts {};	//occurrences of each code
+	std::array<uint8_t, 256> letters {};	//byte of each code (letters[0] unused: the terminator)
+	std::array<uint8_t, 256> code_of {};	//code of each byte (0 if absent or terminator)
+
+	std::unique_ptr<uint8_t[]> memory; //allocated memory (empty if the string is memory-mapped)
+
+	//levels, one after the other, in blocks of 64 bytes = 512 bits. Points either inside memory or inside mapping
+	uint8_t * data = NULL;
+
+	std::shared_ptr<mapped_file> mapping; //keeps the mapped index alive
+
+	uint64_t nbytes = 0; //bytes used in data
+	uint64_t n = 0;
+
+};
+
+#endif /* INTERNAL_BYTE_STRING_HPP_ */
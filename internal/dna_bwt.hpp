@@ -0,0 +1,565 @@
+#include "include.hpp"
+#include "dna_string.hpp"
+#include "index_file.hpp"
+
+#ifndef INTERNAL_DNA_BWT_HPP_
+#define INTERNAL_DNA_BWT_HPP_
+
+/*
+ * BWT index with suffix tree navigation. The alphabet is the one of the string (str_type::alphabet, see the
+ * alphabet descriptors in include.hpp): nodes, ranks and LF results have one entry per letter, and the 
+ * per-letter loops are unrolled at compile time, so each alphabet gets its own specialized code.
+ *
+ * Instances: dna_bwt_t (A,C,G,T: dna_string), dna_bwt_n_t and rle_bwt_n_t (A,C,G,N,T: dna_string_n, rle_string_n).
+ */
+template<class str_type>
+class dna_bwt{
+
+public:
+
+	typedef typename str_type::alphabet alphabet;
+
+	static constexpr int sigma = alphabet::sigma;
+
+	typedef alpha_node<alphabet> sa_node_t;
+	typedef alpha_rank<alphabet> rank_t;
+	typedef alpha_range<alphabet> p_range_t;
+	typedef alpha_p_node<alphabet> p_node_t;
+	typedef flags<alphabet> flags_t;
+
+	dna_bwt(){};
+
+	/*
+	 * constructor path of a BWT file containing the BWT in ASCII format. The string is built using the given number of threads
+	 */
+	dna_bwt(string path, char TERM = '#', int threads = 1) : TERM(TERM){
+
+		n = input_file_size(path);
+
+		BWT = str_type(path, TERM, threads);
+
+		runs = BWT.run_breaks();
+
+		build_F();
+
+	}
+
+	/*
+	 * constructor from a stream of the n characters of the BWT, computed on the fly (see pfp.hpp):
+	 * read(buf, len) writes the next len characters to buf. Available for dna_string_n and dna_string.
+	 */
+	template<class read_t>
+	dna_bwt(uint64_t n, read_t read, char TERM = '#', int threads = 1) : TERM(TERM){
+
+		this->n = n;
+
+		BWT = str_type(n, read, TERM, threads);
+
+		runs = BWT.run_breaks();
+
+		build_F();
+
+	}
+
+	/*
+	 * get full BWT range
+	 */
+	range_t full_range(){
+
+		//right-exclusive range
+		return {0,size()};
+
+	}
+
+	/*
+	 * left-extend range by all letters
+	 */
+	p_range_t LF(range_t rn){
+
+		assert(rn.second >= rn.first);
+
+		//number of occurrences of each letter before start of interval
+		rank_t start = BWT.parallel_rank(rn.first);
+
+		//number of occurrences of each letter before end of interval (last position of interval included)
+		rank_t end;
+
+		if(rn.second>rn.first)
+			end	= BWT.parallel_rank(rn.second);
+		else
+			end = start;
+
+		assert(start <= end);
+
+		rank_t f = {F};
+		rank_t l = f + start;
+		rank_t r = f + end;
+
+		for(int c=0;c+1<sigma;++c) assert(r[c] <= l[c+1]);
+		assert(r[sigma-1] <= n);
+
+		return fold_ranks(l,r);
+
+	}
+
+	char operator[](uint64_t i){
+
+		return BWT[i];
+
+	}
+
+	/*
+	 * number of c before position i excluded
+	 */
+	uint64_t rank(uint64_t i, uint8_t c){
+
+		assert(i<=n);
+
+		return BWT.rank(i,c);
+
+	}
+
+	/*
+	 * return number of occurrences of each letter in the prefix of length i of the text. At most 1 cache miss!
+	 */
+	rank_t parallel_rank(uint64_t i){
+
+		return BWT.parallel_rank(i);
+
+	}
+
+	/*
+	 * out[i] = parallel_rank(pos[i]) for the k positions pos[0] <= ... <= pos[k-1]. Positions falling in the same
+	 * block share its lookup, and blocks are accessed in increasing order
+	 */
+	void parallel_rank_multi(const uint64_t* pos, int k, rank_t* out){
+
+		BWT.parallel_rank_multi(pos, k, out);
+
+	}
+
+	uint64_t size(){
+
+		assert(n == BWT.size());
+		return n;
+
+	}
+
+	//bytes used by the BWT representation
+	uint64_t bytes(){
+		return BWT.bytes();
+	}
+
+	uint64_t serialize(std::ostream& out){
+
+		uint64_t w_bytes = 0;
+
+		out.write((char*)&n,sizeof(n));
+		out.write((char*)F.data(),sizeof(uint64_t)*sigma);
+
+		w_bytes += sizeof(n) + sizeof(uint64_t)*sigma;
+
+		w_bytes += BWT.serialize(out);
+
+		return w_bytes;
+
+	}
+
+	/* load the structure from the istream
+	 * \param in the istream
+	 */
+	void load(std::istream& in) {
+
+		in.read((char*)&n,sizeof(n));
+		in.read((char*)F.data(),sizeof(uint64_t)*sigma);
+
+		BWT.load(in);
+
+	}
+
+	/*
+	 * zero-copy load from a memory-mapped file containing the serialization of the structure at the
+	 * given offset (see dna_string::load). Returns the offset following the structure.
+	 */
+	uint64_t load(std::shared_ptr<mapped_file> file, uint64_t offset){
+
+		uint64_t* header = (uint64_t*)(file->data() + offset);
+
+		n = header[0];
+		std::copy(header + 1, header + 1 + sigma, F.begin());
+
+		return BWT.load(file, offset + (1+sigma)*sizeof(uint64_t));
+
+	}
+
+	/*
+	 * hash of BWT length, F column, number of runs, terminator and of the string's metadata
+	 * (blocks excluded, see str_type::checksum)
+	 */
+	uint64_t checksum(){
+
+		uint64_t term = uint8_t(TERM);
+		uint64_t h = fnv1a(&n, sizeof(n));
+
+		h = fnv1a(F.data(), sizeof(uint64_t)*sigma, h);
+		h = fnv1a(&runs, sizeof(runs), h);
+		h = fnv1a(&term, sizeof(term), h);
+
+		uint64_t hs = BWT.checksum();
+
+		return fnv1a(&hs, sizeof(hs), h);
+
+	}
+
+	/*
+	 * store header (magic, version, terminator, checksums) and index to file. The checksum of the data is computed
+	 * by reading the file back
+	 */
+	void save_to_file(string path){
+
+		index_header h = make_header();
+
+		std::ofstream out(path, std::ios::binary);
+		out.write((char*)&h, sizeof(h));
+		serialize(out);
+		out.close();
+
+		if(not out){
+
+			throw make_error("cannot write index file ", path);
+
+		}
+
+		seal_index_file(path);
+
+	}
+
+	/*
+	 * path = path of an index file. The index is copied in memory, and the checksum of all its data is verified
+	 */
+	void load_from_file(string path){
+
+		index_header h;
+
+		std::ifstream in(path, std::ios::binary);
+		in.read((char*)&h, sizeof(h));
+		check_header(h, path);
+		check_data_checksum(h, index_data_checksum(path), path);
+
+		load(in);
+		in.close();
+
+		set_header(h, path);
+
+	}
+
+	/*
+	 * path = path of an index file. The index is memory-mapped instead of being copied in memory. Only the metadata
+	 * are verified, unless verify: then the checksum of all the data is too (which reads the whole file)
+	 */
+	void map_from_file(string path, bool verify = false){
+
+		auto file = std::make_shared<mapped_file>(path);
+
+		if(file->size() < sizeof(index_header)){
+
+			throw make_error(path, " is not a valid index file");
+
+		}
+
+		index_header h = *(index_header*)file->data();
+		check_header(h, path);
+
+		if(verify) check_data_checksum(h, fnv1a(file->data() + sizeof(index_header), file->size() - sizeof(index_header)), path);
+
+		load(file, sizeof(index_header));
+
+		set_header(h, path);
+
+	}
+
+	/*
+	 * path = path of an index file. Semi-external: only the F column and the superblock ranks are read in memory,
+	 * the blocks are read from the file through a cache of at most cache_bytes bytes (see dna_string_n::load_paged).
+	 * Available for dna_string_n. If verify, the checksum of all the data is verified (reading the whole file once).
+	 */
+	void page_from_file(string path, uint64_t cache_bytes, bool verify = false){
+
+		index_header h;
+
+		std::ifstream in(path, std::ios::binary);
+		in.read((char*)&h, sizeof(h));
+		check_header(h, path);
+
+		if(verify) check_data_checksum(h, index_data_checksum(path), path);
+
+		in.read((char*)&n, sizeof(n));
+		in.read((char*)F.data(), sizeof(uint64_t)*sigma);
+		in.close();
+
+		BWT.load_paged(path, sizeof(index_header) + (1+sigma)*sizeof(uint64_t), cache_bytes);
+
+		set_header(h, path);
+
+	}
+
+	//pages of the BWT read from disk so far (see page_from_file)
+	uint64_t pages_read(){
+		return BWT.pages_read();
+	}
+
+
+	/*
+	 * functions for suffix tree navigation
+	 */
+
+	sa_node_t root(){
+
+		sa_node_t x;
+
+		x.bounds[0] = 0;
+		for(int c=0;c<sigma;++c) x.bounds[c+1] = F[c];
+		x.bounds[sigma+1] = n;
+		x.depth = 0;
+
+		return x;
+
+	}
+
+	/*
+	 * depth = LCP inside the leaf.
+	 */
+	sa_leaf first_leaf(){
+
+		return {{0, F[0]}, 0};
+
+	}
+
+	//number of BWT equal-letter runs, counted by the string while encoding its blocks (and stored in index files)
+	uint64_t r(){
+
+		return runs;
+
+	}
+
+	char terminator(){
+		return TERM;
+	}
+
+	/*
+	 * number of occurrences of P in the text, by backward search. P may contain only the letters of the alphabet
+	 * (not the terminator): otherwise it does not occur
+	 */
+	uint64_t count(string P){
+
+		uint64_t l = 0, r = n;
+
+		for(uint64_t i = P.size(); i > 0 and l < r; --i){
+
+			int c = 0;
+			while(c < sigma and alphabet::letter(c) != P[i-1]) c++;
+
+			if(c == sigma) return 0;
+
+			l = F[c] + parallel_rank(l)[c];
+			r = F[c] + parallel_rank(r)[c];
+
+		}
+
+		return r - l;
+
+	}
+
+
+	/*
+	 * Input: suffix tree node N.
+	 * Output: suffix tree nodes (explicit, implicit, or empty) reached applying LF for each letter from node N
+	 */
+	p_node_t LF(sa_node_t & N){
+
+		//interval boundaries are sorted and, for deep nodes, typically fall in the same block: rank them in one batch
+		std::array<rank_t, sigma+2> before;
+
+		BWT.parallel_rank_multi(N.bounds.data(), sigma+2, before.data());
+
+		return LF(N, before.data());
+
+	}
+
+	/*
+	 * LF(N) from the ranks at the boundaries of N, computed by the caller: before[j] = parallel_rank(N.bounds[j])
+	 */
+	p_node_t LF(sa_node_t & N, const rank_t* before){
+
+		p_node_t left_exts;
+
+		static_for<sigma>([&](int c){
+
+			static_for<sigma+2>([&](int j){ left_exts[c].bounds[j] = F[c] + before[j][c]; });
+			left_exts[c].depth = N.depth+1;
+
+		});
+
+		return left_exts;
+
+	}
+
+	/*
+	 * number of rank queries (LF calls, each for all the letters) of get_weiner_children(N): one per boundary
+	 */
+	int lf_queries(sa_node_t &){
+
+		return sigma+2;
+
+	}
+
+	/*
+	 * prefetch the memory that LF(N) will access
+	 */
+	void prefetch(sa_node_t & N){
+
+		BWT.prefetch_multi(N.bounds.data(), sigma+2);
+
+	}
+
+	//return labels of Weiner links exiting x (bit c+1 = letter c, see flags)
+	flags_t weiner_links(sa_node_t & x){
+
+		p_node_t left_exts = LF(x);
+
+		flags_t wl;
+		static_for<sigma>([&](int c){ wl.set(c+1, not empty_node(left_exts[c])); });
+
+		return wl;
+
+	}
+
+
+	//does the node have only one exiting Weiner link?
+	bool is_weiner_unary(sa_node_t & x){
+
+		return weiner_links(x).count() == 1;
+	
+	}
+
+	//follow Weiner links from node x and push on the stack the resulting right-maximal nodes (at most sigma).
+	//Does not modify the index: can be called concurrently by several threads.
+	void get_weiner_children(sa_node_t & x, sa_node_t * TMP_NODES, int & t){
+
+		p_node_t left_exts = LF(x);
+
+		right_maximal_children(left_exts, TMP_NODES, t);
+
+	}
+
+	//get_weiner_children from the ranks at the boundaries of x (see LF(N, before))
+	void get_weiner_children(sa_node_t & x, const rank_t* before, sa_node_t * TMP_NODES, int & t){
+
+		p_node_t left_exts = LF(x, before);
+
+		right_maximal_children(left_exts, TMP_NODES, t);
+
+	}
+
+private:
+
+	//copy to TMP_NODES the right-maximal nodes among the left extensions of a node, in increasing size order
+	inline void right_maximal_children(p_node_t & left_exts, sa_node_t * TMP_NODES, int & t){
+
+		t = 0;
+
+		//branch-free: every node is written, and kept (t advances) only if right-maximal. t <= c, so TMP_NODES[t] is in bounds
+		static_for<sigma>([&](int c) __attribute__((always_inline)) {
+
+			TMP_NODES[t] = left_exts[c];
+			t += number_of_right_ext(left_exts[c]) >= 2;
+
+		});
+
+		//return right-maximal nodes in increasing size (i.e. interval length) order
+
+		sort_nodes_by_size(TMP_NODES, t);
+
+	}
+
+	//build F column from the letter counts, i.e. the rank at the end of the BWT
+	void build_F(){
+
+		rank_t counts = BWT.parallel_rank(n);
+
+		F[0] = n - counts.sum(); //number of terminators
+
+		for(int c=1;c<sigma;++c) F[c] = F[c-1] + counts[c-1];
+
+	}
+
+	index_header make_header(){
+
+		index_header h = {};
+
+		std::copy(INDEX_MAGIC, INDEX_MAGIC+8, h.magic);
+		h.version = INDEX_VERSION;
+		h.TERM = uint8_t(TERM);
+		h.n = n;
+		h.runs = r();
+		h.checksum = checksum();
+		h.string_type = str_type::type_id();
+
+		return h;
+
+	}
+
+	void check_header(index_header & h, string path){
+
+		if(not std::equal(h.magic, h.magic+8, INDEX_MAGIC)){
+
+			throw make_error(path, " is not a valid index file");
+
+		}
+
+		if(h.version != INDEX_VERSION){
+
+			throw make_error("index file ", path, " has version ", h.version, ", expected ", INDEX_VERSION);
+
+		}
+
+		if(h.string_type != str_type::type_id()){
+
+			throw make_error("index file ", path, " stores a different BWT representation (type ", h.string_type, ")");
+
+		}
+
+	}
+
+	//to be called after the structure has been loaded
+	void set_header(index_header & h, string path){
+
+		TERM = char(h.TERM);
+		runs = h.runs;
+
+		if(h.n != n or BWT.size() != n or h.checksum != checksum()){
+
+			throw make_error("index file ", path, " is corrupted (checksum mismatch)");
+
+		}
+
+	}
+
+	char TERM = '#';
+
+	uint64_t runs = 0;
+
+	uint64_t n = 0;//BWT length
+
+	std::array<uint64_t, sigma> F {}; //F array: F[c] = first position of letter c in the F column
+
+	str_type BWT;
+
+};
+
+template<class str_type>
+constexpr int dna_bwt<str_type>::sigma;
+
+typedef dna_bwt<dna_string> dna_bwt_t;
+
+#endif /* INTERNAL_DNA_BWT_HPP_ */
@@ -0,0 +1,875 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * dna_string.hpp
+ *
+ *  Optimized string with rank on the DNA alphabet without N: {A,C,G,T,TERM}, used when the BWT contains no N
+ *  (see dna_bwt.hpp). Same design as dna_string_n, with 2 bits per character instead of 3.
+ *
+ *  One access or a parallel rank for the 4 letters A,C,G,T causes only 1 cache miss (plus a lookup of the terminator
+ *  positions, see below).
+ *
+ *  Max string length: 2^64
+ *
+ *  Terminators are encoded as A and their positions are stored separately in a sorted array: rank of A is corrected
+ *  by the number of terminators before the position. BWTs of string collections have one terminator per string, so
+ *  the array can be large: a sample (rebuilt at load time, not stored) gives the number of terminators before every
+ *  TERM_SAMPLE_2B-th position, and the binary search is restricted to the terminators between two samples.
+ *
+ *  Data is stored and cache-aligned in blocks of 512 bits (64 bytes). The in-block rank is computed by the 2-bit
+ *  kernels of block_rank.hpp (3 popcounts per 64-bit word instead of the 10 per 128 bits of dna_string_n).
+ *
+ *  Like dna_string_n, the structure can be serialized and then loaded (copy) or memory-mapped (zero-copy).
+ *
+ *  Size of the string: 512/192 < 2.67n bits, where n = string length
+ *
+ *  512-bits Block layout:
+ *
+ *  | 192-bit low bits | 192-bit high bits | 32-bit rank A | 32-bit rank C | 32-bit rank G | 32-bit rank T |
+ *
+ *  Character i of the block is bit i%64 of word i/64 of each plane. Encoding: A (and TERM) 00, C 01, G 10, T 11.
+ *  Counters (terminators counted as A) are relative to the superblock.
+ *
+ */
+
+#ifndef INTERNAL_DNA_STRING_HPP_
+#define INTERNAL_DNA_STRING_HPP_
+
+#define SUPERBLOCK_SIZE_2B 3221225472 		//number of characters in a superblock = 192*2^24 characters
+#define BLOCKS_PER_SUPERBLOCK_2B 16777216	//blocks in a superblock = 2^24
+#define BYTES_PER_SUPERBLOCK_2B 1073741824	//bytes in a superblock = 64*BLOCKS_PER_SUPERBLOCK_2B
+#define BLOCK_SIZE_2B 192 					//number of characters inside a block
+#define BYTES_PER_BLOCK_2B 64				//bytes in a block of 512 bits
+#define ALN_2B 64							//alignment
+#define BLOCKS_PER_CHUNK_2B 8192			//blocks encoded at once by a construction thread (about 1.5 MB of input)
+#define TERM_SAMPLE_2B 65536				//distance between two samples of the terminator positions
+
+#include "include.hpp"
+#include "block_rank.hpp"
+#include "mapped_file.hpp"
+#include <memory>
+#include <atomic>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+class dna_string{
+
+public:
+
+	typedef dna_alphabet alphabet;
+
+	//written in index files (see dna_bwt::save_to_file)
+	static uint64_t type_id(){
+		return 2;
+	}
+
+	dna_string(){}
+
+	/*
+	 * Data, superblock_ranks and term_pos point into buffers owned by the string (or into its mapping): a copy would point into the buffers of
+	 * the original. Moves keep the buffers where they are, so the pointers stay valid in the target (the moved-from
+	 * string is not to be used)
+	 */
+	dna_string(const dna_string&) = delete;
+	dna_string& operator=(const dna_string&) = delete;
+
+	dna_string(dna_string&&) = default;
+	dna_string& operator=(dna_string&&) = default;
+
+	/*
+	 * constructor from ASCII file. Parallel chunked construction, see dna_string_n. Terminator positions are
+	 * collected per chunk and concatenated in order.
+	 */
+	dna_string(string path, char TERM = '#', int threads = 1){
+
+		build(input_file_size(path), TERM, threads, false, [&](char* buf, uint64_t from, uint64_t len){
+
+			read_file_range(path, buf, from, len);
+
+		});
+
+		assert(check_content(path));
+
+	}
+
+	/*
+	 * constructor from a stream of n characters, see dna_string_n
+	 */
+	template<class read_t>
+	dna_string(uint64_t n, read_t read, char TERM = '#', int threads = 1){
+
+		build(n, TERM, threads, true, [&](char* buf, uint64_t, uint64_t len){ read(buf, len); });
+
+	}
+
+	//return i-th character
+	char operator[](uint64_t i){
+
+		assert(i<n);
+
+		uint64_t superblock_number = i / SUPERBLOCK_SIZE_2B;
+		uint64_t superblock_off = i % SUPERBLOCK_SIZE_2B;
+		uint64_t block_number = superblock_off / BLOCK_SIZE_2B;
+		uint64_t block_off = superblock_off % BLOCK_SIZE_2B;
+
+		const uint64_t* w = (const uint64_t*)(data + superblock_number*BYTES_PER_SUPERBLOCK_2B + block_number*BYTES_PER_BLOCK_2B);
+
+		uint64_t b =	((w[block_off/64]>>(block_off%64))&0x1) +
+						(((w[3 + block_off/64]>>(block_off%64))&0x1)<<1);
+
+		if(b == 0 and is_term(i)) return TERM;
+
+		return 	(b == 0)*'A' +
+				(b == 1)*'C' +
+				(b == 2)*'G' +
+				(b == 3)*'T';
+
+	}
+
+	/*
+	 * Parallel rank of (A,C,G,T) at position i.
+	 */
+	p_rank parallel_rank(uint64_t i){
+
+		uint64_t superblock_number = i / SUPERBLOCK_SIZE_2B;
+		uint64_t superblock_off = i % SUPERBLOCK_SIZE_2B;
+		uint64_t block_number = superblock_off / BLOCK_SIZE_2B;
+		uint64_t block_off = superblock_off % BLOCK_SIZE_2B;
+
+		p_rank superblock_r = superblock_ranks[superblock_number];
+		p_rank block_r = get_counters(superblock_number,block_number);
+
+		p_rank r = superblock_r + block_r + block_rank(superblock_number, block_number, block_off);
+		r[alphabet::A] -= terms_before(i);
+
+		return r;
+
+	}
+
+	/*
+	 * Parallel rank of (A,C,G,T) at the k positions pos[0] <= pos[1] <= ... <= pos[k-1]: out[i] = parallel_rank(pos[i]).
+	 * Consecutive positions falling in the same block share the block lookup (see dna_string_n::parallel_rank_multi).
+	 */
+	void parallel_rank_multi(const uint64_t* pos, int k, p_rank* out){
+
+		uint64_t offs[BLOCK_SIZE_2B];
+
+		int i = 0;
+
+		while(i<k){
+
+			assert(i == 0 or pos[i] >= pos[i-1]);
+
+			uint64_t superblock_number = pos[i] / SUPERBLOCK_SIZE_2B;
+			uint64_t superblock_off = pos[i] % SUPERBLOCK_SIZE_2B;
+			uint64_t block_number = superblock_off / BLOCK_SIZE_2B;
+			uint64_t block_start = pos[i] - superblock_off % BLOCK_SIZE_2B;
+
+			//positions in the same block
+			int j = i;
+			while(j<k and j-i < BLOCK_SIZE_2B and pos[j] - block_start < BLOCK_SIZE_2B){
+
+				offs[j-i] = pos[j] - block_start;
+				j++;
+
+			}
+
+			uint8_t* start = data + superblock_number*BYTES_PER_SUPERBLOCK_2B + block_number*BYTES_PER_BLOCK_2B;
+
+			p_rank r = superblock_ranks[superblock_number] + get_counters(superblock_number,block_number);
+
+			rank_kernel.multi(start, offs, j-i, out+i);
+
+			for(int h=i;h<j;++h){
+
+				out[h] = out[h] + r;
+				out[h][alphabet::A] -= terms_before(pos[h]);
+
+			}
+
+			i = j;
+
+		}
+
+	}
+
+	/*
+	 * software prefetch of the block containing position i (a later rank at i will not wait for memory)
+	 */
+	inline void prefetch(uint64_t i){
+
+		uint64_t superblock_number = i / SUPERBLOCK_SIZE_2B;
+		uint64_t block_number = (i % SUPERBLOCK_SIZE_2B) / BLOCK_SIZE_2B;
+
+		__builtin_prefetch(data + superblock_number*BYTES_PER_SUPERBLOCK_2B + block_number*BYTES_PER_BLOCK_2B);
+
+	}
+
+	/*
+	 * prefetch for the positions pos[0] <= ... <= pos[k-1]. Positions falling in the block of the previous one are skipped
+	 */
+	inline void prefetch_multi(const uint64_t* pos, int k){
+
+		for(int i=0;i<k;++i)
+			if(i == 0 or pos[i]/BLOCK_SIZE_2B != pos[i-1]/BLOCK_SIZE_2B) prefetch(pos[i]);
+
+	}
+
+	/*
+	 * standard rank. c can be A,C,G,T, or TERM
+	 */
+	uint64_t rank(uint64_t i, uint8_t c){
+
+		if(c==TERM) return terms_before(i);
+
+		p_rank pr = parallel_rank(i);
+
+		switch(c){
+			case 'A' : return pr[alphabet::A]; break;
+			case 'C' : return pr[alphabet::C]; break;
+			case 'G' : return pr[alphabet::G]; break;
+			case 'T' : return pr[alphabet::T]; break;
+		}
+
+		return 0;
+
+	}
+
+	uint64_t serialize(std::ostream& out){
+
+		uint64_t w_bytes = 0;
+
+		uint64_t term = uint8_t(TERM);
+
+		out.write((char*)&n,sizeof(n));
+		out.write((char*)&nbytes,sizeof(nbytes));
+		out.write((char*)&n_superblocks,sizeof(n_superblocks));
+		out.write((char*)&n_blocks,sizeof(n_blocks));
+		out.write((char*)&term,sizeof(term));
+		out.write((char*)&n_terms,sizeof(n_terms));
+
+		w_bytes += sizeof(n) + sizeof(nbytes) + sizeof(n_superblocks) + sizeof(n_blocks) + sizeof(term) + sizeof(n_terms);
+
+		//superblock ranks, blocks and terminator positions start at 64-byte file offsets, so that they can be memory-mapped
+		w_bytes += write_padding(out);
+
+		out.write((char*)superblock_ranks,n_superblocks*sizeof(p_rank));
+		w_bytes += n_superblocks*sizeof(p_rank);
+
+		w_bytes += write_padding(out);
+
+		out.write((char*)data,nbytes*sizeof(uint8_t));
+		w_bytes += nbytes*sizeof(uint8_t);
+
+		w_bytes += write_padding(out);
+
+		out.write((char*)term_pos,n_terms*sizeof(uint64_t));
+		w_bytes += n_terms*sizeof(uint64_t);
+
+		return w_bytes;
+
+	}
+
+	void load(std::istream& in) {
+
+		uint64_t term = 0;
+
+		in.read((char*)&n,sizeof(n));
+		in.read((char*)&nbytes,sizeof(nbytes));
+		in.read((char*)&n_superblocks,sizeof(n_superblocks));
+		in.read((char*)&n_blocks,sizeof(n_blocks));
+		in.read((char*)&term,sizeof(term));
+		in.read((char*)&n_terms,sizeof(n_terms));
+
+		TERM = char(term);
+
+		skip_padding(in);
+
+		superblock_memory = vector<p_rank>(n_superblocks);
+		superblock_ranks = superblock_memory.data();
+		in.read((char*)superblock_ranks,n_superblocks*sizeof(p_rank));
+
+		skip_padding(in);
+
+		memory = std::unique_ptr<uint8_t[]>(new uint8_t[nbytes+ALN_2B]);
+		data = memory.get();
+		while(uint64_t(data) % ALN_2B != 0) data++;
+		in.read((char*)data,nbytes*sizeof(uint8_t));
+
+		skip_padding(in);
+
+		term_memory = vector<uint64_t>(n_terms);
+		term_pos = term_memory.data();
+		in.read((char*)term_pos,n_terms*sizeof(uint64_t));
+
+		sample_terms();
+
+		assert(check_rank());
+
+	}
+
+	/*
+	 * zero-copy load from a memory-mapped file containing the serialization of the string at the given
+	 * offset (see dna_string_n::load). Returns the offset following the structure.
+	 */
+	uint64_t load(std::shared_ptr<mapped_file> file, uint64_t offset){
+
+		uint8_t* base = file->data();
+
+		n = *(uint64_t*)(base + offset);
+		nbytes = *(uint64_t*)(base + offset + 8);
+		n_superblocks = *(uint64_t*)(base + offset + 16);
+		n_blocks = *(uint64_t*)(base + offset + 24);
+		TERM = char(*(uint64_t*)(base + offset + 32));
+		n_terms = *(uint64_t*)(base + offset + 40);
+
+		offset = padded(offset + 48);
+
+		memory.reset();
+		superblock_memory = vector<p_rank>();
+		term_memory = vector<uint64_t>();
+
+		superblock_ranks = (p_rank*)(base + offset);
+		offset = padded(offset + n_superblocks*sizeof(p_rank));
+
+		data = base + offset;
+		offset = padded(offset + nbytes);
+
+		term_pos = (uint64_t*)(base + offset);
+		offset += n_terms*sizeof(uint64_t);
+
+		if(offset > file->size()){
+
+			throw make_error("truncated index file");
+
+		}
+
+		assert(uint64_t(data) % ALN_2B == 0);
+
+		mapping = file;
+
+		sample_terms();
+
+		return offset;
+
+	}
+
+	uint64_t size(){
+		return n;
+	}
+
+	/*
+	 * number of positions i > 0 such that S[i] != S[i-1], counted while encoding the blocks. Only for a string
+	 * built by this process: it is not serialized (index files store r in their header, see dna_bwt)
+	 */
+	uint64_t run_breaks(){
+		return breaks;
+	}
+
+	//bytes used by the structure
+	uint64_t bytes(){
+		return nbytes + n_superblocks*sizeof(p_rank) + n_terms*sizeof(uint64_t) + term_sample.size()*sizeof(uint64_t);
+	}
+
+	/*
+	 * hash of the sizes, of the terminator, of the superblock ranks and of the terminator positions (blocks excluded,
+	 * see dna_string_n::checksum)
+	 */
+	uint64_t checksum(){
+
+		uint64_t term = uint8_t(TERM);
+
+		uint64_t h = fnv1a(&n, sizeof(n));
+		h = fnv1a(&nbytes, sizeof(nbytes), h);
+		h = fnv1a(&n_superblocks, sizeof(n_superblocks), h);
+		h = fnv1a(&n_blocks, sizeof(n_blocks), h);
+		h = fnv1a(&term, sizeof(term), h);
+		h = fnv1a(&n_terms, sizeof(n_terms), h);
+		h = fnv1a(term_pos, n_terms*sizeof(uint64_t), h);
+
+		return fnv1a(superblock_ranks, n_superblocks*sizeof(p_rank), h);
+
+	}
+
+private:
+
+	//number of terminators in positions [0,i)
+	inline uint64_t terms_before(uint64_t i){
+
+		uint64_t s = i / TERM_SAMPLE_2B;
+
+		return std::lower_bound(term_pos + term_sample[s], term_pos + term_sample[s+1], i) - term_pos;
+
+	}
+
+	inline bool is_term(uint64_t i){
+
+		uint64_t s = i / TERM_SAMPLE_2B;
+
+		return std::binary_search(term_pos + term_sample[s], term_pos + term_sample[s+1], i);
+
+	}
+
+	//term_sample[s] = number of terminators before position s*TERM_SAMPLE_2B, for all the positions up to n (included)
+	void sample_terms(){
+
+		term_sample = vector<uint64_t>(n/TERM_SAMPLE_2B + 2);
+
+		uint64_t j = 0;
+
+		for(uint64_t s = 0; s < term_sample.size(); ++s){
+
+			while(j < n_terms and term_pos[j] < s*TERM_SAMPLE_2B) j++;
+			term_sample[s] = j;
+
+		}
+
+	}
+
+	//round offset up to the next multiple of ALN_2B
+	static uint64_t padded(uint64_t offset){
+		return ((offset + ALN_2B - 1)/ALN_2B)*ALN_2B;
+	}
+
+	//pad the stream with zeros up to the next 64-byte offset. Returns the number of written bytes
+	static uint64_t write_padding(std::ostream& out){
+
+		uint64_t pos = uint64_t(out.tellp());
+		uint64_t pad = padded(pos) - pos;
+
+		char zeros[ALN_2B] = {};
+		out.write(zeros, pad);
+
+		return pad;
+
+	}
+
+	static void skip_padding(std::istream& in){
+
+		uint64_t pos = uint64_t(in.tellg());
+		in.seekg(padded(pos));
+
+	}
+
+	/*
+	 * build the string of length n. fill(buf, from, len) writes characters [from, from+len) to buf. If sequential, 
+	 * the chunks are filled in order by the calling thread, 'threads' at a time; otherwise each chunk is filled by the
+	 * thread encoding it.
+	 */
+	template<class fill_t>
+	void build(uint64_t n, char TERM, int threads, bool sequential, fill_t fill){
+
+		this->TERM = TERM;
+		this->n = n;
+
+		n_superblocks = (n+1)/SUPERBLOCK_SIZE_2B + ((n+1)%SUPERBLOCK_SIZE_2B != 0);
+		n_blocks = (n+1)/BLOCK_SIZE_2B + ((n+1)%BLOCK_SIZE_2B != 0);
+		nbytes = (n_blocks * BYTES_PER_BLOCK_2B);//number of bytes effectively filled with data
+
+		superblock_memory = vector<p_rank>(n_superblocks);
+		superblock_ranks = superblock_memory.data();
+
+		//64-byte aligned, not initialized: every byte is written by the (parallel) encoding below
+		memory = std::unique_ptr<uint8_t[]>(new uint8_t[nbytes+ALN_2B]);
+		data = memory.get();
+		while(uint64_t(data) % ALN_2B != 0) data++;
+
+		//chunks of at most BLOCKS_PER_CHUNK_2B blocks, not crossing superblock boundaries
+		vector<uint64_t> chunk_start;
+
+		for(uint64_t bl = 0; bl < n_blocks; ){
+
+			chunk_start.push_back(bl);
+			bl = std::min(bl + BLOCKS_PER_CHUNK_2B, (bl/BLOCKS_PER_SUPERBLOCK_2B + 1)*BLOCKS_PER_SUPERBLOCK_2B);
+
+		}
+
+		chunk_start.push_back(n_blocks);
+
+		uint64_t n_chunks = chunk_start.size()-1;
+
+		vector<p_rank> chunk_rank(n_chunks); //number of A,C,G,T in each chunk (phase 1), then before each chunk inside its superblock (phase 2)
+		vector<vector<uint64_t> > chunk_terms(n_chunks); //terminator positions in each chunk
+		vector<uint64_t> chunk_breaks(n_chunks, 0); //run breaks inside each chunk (see run_breaks)
+		vector<char> chunk_first(n_chunks), chunk_last(n_chunks); //first and last character of each chunk
+
+		std::atomic<bool> error {false};
+		std::atomic<uint64_t> error_pos {n};
+		vector<char> error_char(n_chunks); //first forbidden character of each chunk
+
+		//chunk c followed by 'A' padding, so that the last block can be encoded with full 16-byte loads
+		auto read_chunk = [&](uint64_t c, vector<char> & buf){
+
+			buf.assign((chunk_start[c+1]-chunk_start[c])*BLOCK_SIZE_2B + 16, 'A');
+
+			uint64_t from = chunk_start[c]*BLOCK_SIZE_2B;
+			fill(buf.data(), std::min(from, n), std::min(chunk_start[c+1]*BLOCK_SIZE_2B, n) - std::min(from, n));
+
+		};
+
+		uint64_t batch = sequential ? uint64_t(threads) : n_chunks;
+		vector<vector<char> > batch_buf(sequential ? batch : 0);
+
+		//phase 1: read, validate and encode chunks
+		for(uint64_t first = 0; first < n_chunks; first += batch){
+
+			uint64_t last = std::min(n_chunks, first + batch);
+
+			if(sequential) for(uint64_t c = first; c < last; ++c) read_chunk(c, batch_buf[c-first]);
+
+			parallel_for_chunks(last - first, threads, [&](uint64_t i){
+
+				uint64_t c = first + i;
+
+				vector<char> own_buf;
+				if(not sequential) read_chunk(c, own_buf);
+
+				vector<char> & buf = sequential ? batch_buf[i] : own_buf;
+
+				uint64_t from = chunk_start[c]*BLOCK_SIZE_2B;
+				uint64_t len = std::min(chunk_start[c+1]*BLOCK_SIZE_2B, n) - std::min(from, n);
+
+				p_rank tot = {};
+
+				for(uint64_t bl = chunk_start[c]; bl < chunk_start[c+1]; ++bl){
+
+					uint64_t chars_in_block = std::min(uint64_t(BLOCK_SIZE_2B), len - std::min(len, (bl-chunk_start[c])*BLOCK_SIZE_2B));
+
+					if(not encode_block(bl, buf.data() + (bl-chunk_start[c])*BLOCK_SIZE_2B, chars_in_block, chunk_terms[c], chunk_breaks[c])){
+
+						//report the first forbidden character of the string
+						uint64_t pos = bl*BLOCK_SIZE_2B;
+						while(valid_char(buf[pos - from])) pos++;
+
+						error_char[c] = buf[pos - from];
+
+						uint64_t cur = error_pos;
+						while(pos < cur and not error_pos.compare_exchange_weak(cur, pos));
+
+						error = true;
+						return;
+
+					}
+
+					tot = tot + block_rank(bl/BLOCKS_PER_SUPERBLOCK_2B, bl%BLOCKS_PER_SUPERBLOCK_2B);
+
+					//break between the last character of the previous block and the first of this one
+					uint64_t b = (bl-chunk_start[c])*BLOCK_SIZE_2B;
+					if(b > 0 and b < len) chunk_breaks[c] += buf[b] != buf[b-1];
+
+				}
+
+				chunk_rank[c] = tot;
+
+				if(len > 0){
+
+					chunk_first[c] = buf[0];
+					chunk_last[c] = buf[len-1];
+
+				}
+
+			});
+
+		}
+
+		if(error){
+
+			//the chunk containing the first error
+			uint64_t e = std::upper_bound(chunk_start.begin(), chunk_start.end(), error_pos/BLOCK_SIZE_2B) - chunk_start.begin() - 1;
+			char c = error_char[e];
+
+			string solution = c == 'N' ? string("use option \"-b plain\" (or \"-b auto\").") :
+			"if the unknown character is the terminator, you can solve the problem by adding option \"-t " + std::to_string(int(c)) + "\".";
+
+			throw make_error("read forbidden character '", c, "' (ASCII code ", int(c), ") while reading the BWT. ",
+			"Only A,C,G,T, and ", TERM, " are admitted in the input BWT by the 2-bit representation!\n",
+			"Possible solution: ", solution);
+
+		}
+
+		breaks = 0;
+
+		for(uint64_t c = 0; c < n_chunks; ++c){
+
+			breaks += chunk_breaks[c];
+			if(c > 0 and chunk_start[c]*BLOCK_SIZE_2B < n) breaks += chunk_first[c] != chunk_last[c-1];
+
+		}
+
+		//prefix sum of the chunk totals: superblock ranks, and rank of each chunk inside its superblock
+		p_rank superblock_r = {};
+
+		for(uint64_t c = 0; c < n_chunks; ++c){
+
+			uint64_t superblock_number = chunk_start[c]/BLOCKS_PER_SUPERBLOCK_2B;
+
+			if(chunk_start[c]%BLOCKS_PER_SUPERBLOCK_2B == 0) superblock_ranks[superblock_number] = superblock_r;
+
+			p_rank tot = chunk_rank[c];
+
+			chunk_rank[c] = superblock_r - superblock_ranks[superblock_number];
+
+			superblock_r = superblock_r + tot;
+
+		}
+
+		//phase 2: block counters
+		parallel_for_chunks(n_chunks, threads, [&](uint64_t c){
+
+			p_rank block_r = chunk_rank[c];
+
+			for(uint64_t bl = chunk_start[c]; bl < chunk_start[c+1]; ++bl){
+
+				uint64_t superblock_number = bl/BLOCKS_PER_SUPERBLOCK_2B;
+				uint64_t block_number = bl%BLOCKS_PER_SUPERBLOCK_2B;
+
+				set_counters(superblock_number, block_number, block_r);
+				block_r = block_r + block_rank(superblock_number, block_number);
+
+			}
+
+		});
+
+		for(auto & t : chunk_terms) term_memory.insert(term_memory.end(), t.begin(), t.end());
+
+		n_terms = term_memory.size();
+		term_pos = term_memory.data();
+
+		sample_terms();
+
+		assert(check_rank());
+
+	}
+
+	inline bool valid_char(char c){
+
+		return c=='A' or c=='C' or c=='G' or c=='T' or c==TERM;
+
+	}
+
+	/*
+	 * encode the first len <= BLOCK_SIZE_2B characters of s in the bl-th block (characters after the len-th are encoded as A),
+	 * append the positions of its terminators to terms and add to breaks the number of run breaks among them. s must be
+	 * readable up to position BLOCK_SIZE_2B. Counters are not set. Returns false if s contains a forbidden character.
+	 */
+	bool encode_block(uint64_t bl, const char* s, uint64_t len, vector<uint64_t> & terms, uint64_t & breaks){
+
+		//bit planes and terminator mask, with the i-th character in bit i%64 of word i/64
+		uint64_t b0[3] = {}, b1[3] = {}, tm[3] = {}, ok[3] = {};
+
+#if defined(__SSE2__)
+
+		const __m128i A = _mm_set1_epi8('A'), C = _mm_set1_epi8('C'), G = _mm_set1_epi8('G');
+		const __m128i T = _mm_set1_epi8('T'), TM = _mm_set1_epi8(TERM);
+
+		for(int g = 0; g < 12; ++g){
+
+			__m128i x = _mm_loadu_si128((const __m128i*)(s + 16*g));
+
+			__m128i is_C = _mm_cmpeq_epi8(x, C);
+			__m128i is_G = _mm_cmpeq_epi8(x, G);
+			__m128i is_T = _mm_cmpeq_epi8(x, T);
+			__m128i is_TM = _mm_cmpeq_epi8(x, TM);
+
+			__m128i m0 = _mm_or_si128(is_C, is_T);
+			__m128i m1 = _mm_or_si128(is_G, is_T);
+			__m128i v = _mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(is_TM, _mm_cmpeq_epi8(x, A)));
+
+			int w = g/4, sh = 16*(g%4);
+
+			b0[w] |= uint64_t(uint16_t(_mm_movemask_epi8(m0))) << sh;
+			b1[w] |= uint64_t(uint16_t(_mm_movemask_epi8(m1))) << sh;
+			tm[w] |= uint64_t(uint16_t(_mm_movemask_epi8(is_TM))) << sh;
+			ok[w] |= uint64_t(uint16_t(_mm_movemask_epi8(v))) << sh;
+
+		}
+
+#else
+
+		for(int i = 0; i < BLOCK_SIZE_2B; ++i){
+
+			char c = s[i];
+			int w = i/64, sh = i%64;
+
+			b0[w] |= uint64_t(c=='C' or c=='T') << sh;
+			b1[w] |= uint64_t(c=='G' or c=='T') << sh;
+			tm[w] |= uint64_t(c==TERM) << sh;
+			ok[w] |= uint64_t(valid_char(c)) << sh;
+
+		}
+
+#endif
+
+		uint64_t superblock_number = bl / BLOCKS_PER_SUPERBLOCK_2B;
+		uint64_t block_number = bl % BLOCKS_PER_SUPERBLOCK_2B;
+
+		uint64_t* words = (uint64_t*)(data + superblock_number*BYTES_PER_SUPERBLOCK_2B + block_number*BYTES_PER_BLOCK_2B);
+
+		for(int w = 0; w < 3; ++w){
+
+			//characters after the len-th are A
+			uint64_t keep = prefix_mask64(len, w);
+
+			if((ok[w] & keep) != keep) return false;
+
+			words[w] = b0[w] & keep;
+			words[w+3] = b1[w] & keep;
+
+			for(uint64_t t = tm[w] & keep; t != 0; t &= t-1) terms.push_back(bl*BLOCK_SIZE_2B + 64*w + __builtin_ctzll(t));
+
+		}
+
+		//a terminator is encoded as A: its plane tells them apart
+		breaks += plane_breaks<3,3>({b0, b1, tm}, len);
+
+		return true;
+
+	}
+
+	/*
+	 * rank in block given as coordinates: superblock, block, offset in block. Terminators are counted as A
+	 */
+	inline p_rank block_rank(uint64_t superblock_number, uint64_t block_number, uint64_t block_off=BLOCK_SIZE_2B){
+
+		assert(block_off<=BLOCK_SIZE_2B);
+
+		//starting address of the block
+		uint8_t* start = data + superblock_number*BYTES_PER_SUPERBLOCK_2B + block_number*BYTES_PER_BLOCK_2B;
+
+		return rank_kernel.one(start, block_off);
+
+	}
+
+	bool check_rank(){
+
+		p_rank p = {};
+
+		bool res = true;
+
+		for(uint64_t i=0;i<size();++i){
+
+			if(p != parallel_rank(i)) res = false;
+
+			for(int c=0;c<alphabet::sigma;++c) p[c] += (operator[](i)==alphabet::letter(c));
+
+		}
+
+		if(p != parallel_rank(n)) res = false;
+
+		if(res){
+
+			cout << "rank is correct" << endl;
+
+		}else{
+
+			cout << "rank is not correct" << endl;
+
+		}
+
+		return res;
+
+	}
+
+	/*
+	 * check that the string contains exactly the same characters as the file in path
+	 */
+	bool check_content(string path){
+
+		ifstream ifs(path);
+
+		bool res = true;
+
+		for(uint64_t i=0;i<n;++i){
+
+			char c;
+			ifs.read((char*)&c, sizeof(char));
+
+			if(operator[](i) != c) res = false;
+
+		}
+
+		if(res){
+
+			cout << "string content is valid" << endl;
+
+		}else{
+
+			cout << "string content is not valid" << endl;
+
+		}
+
+		return res;
+
+	}
+
+	/*
+	 * set counters in the i-th block to r
+	 */
+	void set_counters(uint64_t superblock_number, uint64_t block_number, p_rank r){
+
+		uint8_t* start = data + superblock_number*BYTES_PER_SUPERBLOCK_2B + block_number*BYTES_PER_BLOCK_2B;
+		uint32_t * block_ranks = (uint32_t*)(start+48);
+
+		block_ranks[0] = r[alphabet::A];
+		block_ranks[1] = r[alphabet::C];
+		block_ranks[2] = r[alphabet::G];
+		block_ranks[3] = r[alphabet::T];
+
+		assert(get_counters(superblock_number,block_number) == r);
+
+	}
+
+	/*
+	 * get counters of the i-th block
+	 */
+	inline p_rank get_counters(uint64_t superblock_number, uint64_t superblock_off){
+
+		uint8_t* start = data + superblock_number*BYTES_PER_SUPERBLOCK_2B + superblock_off*BYTES_PER_BLOCK_2B;
+		uint32_t * block_ranks = (uint32_t*)(start+48);
+
+		return {
+			block_ranks[0],
+			block_ranks[1],
+			block_ranks[2],
+			block_ranks[3]
+		};
+
+	}
+
+	char TERM = '#';
+
+	//in-block rank kernel, selected at runtime for this CPU
+	block_rank2_kernels rank_kernel = block_rank2_kernel();
+
+	uint64_t n_superblocks = 0;
+	uint64_t n_blocks = 0;
+	uint64_t breaks = 0;	//see run_breaks()
+
+	std::unique_ptr<uint8_t[]> memory; //allocated memory (empty if the string is memory-mapped)
+
+	//data aligned with blocks of 64 bytes = 512 bits. Points either inside memory or inside mapping
+	uint8_t * data = NULL;
+
+	vector<p_rank> superblock_memory; //allocated superblock ranks (empty if the string is memory-mapped)
+	p_rank * superblock_ranks = NULL;
+
+	vector<uint64_t> term_memory; //allocated terminator positions (empty if the string is memory-mapped)
+	uint64_t * term_pos = NULL; //sorted terminator positions
+	uint64_t n_terms = 0;
+
+	vector<uint64_t> term_sample; //see sample_terms
+
+	std::shared_ptr<mapped_file> mapping; //keeps the mapped index alive
+
+	uint64_t nbytes = 0; //bytes used in data
+	uint64_t n = 0;
+
+};
+
+
+#endif /* INTERNAL_DNA_STRING_HPP_ */
@@ -14,10 +14,16 @@
  *
  *  Max string length: 2^64
  *
- *  Supports very efficient (1 cache miss) parallel rank for (A,C,G,N,T), and (1 cache miss) single rank for TERM
+ *  Supports very efficient (1 cache miss) parallel rank for (A,C,G,N,T), and (1 cache miss) single rank for TERM.
+ *  The in-block part of the rank is computed by a scalar or SIMD kernel chosen at runtime (see block_rank.hpp)
  *
  *  Data is stored and cache-aligned in blocks of 512 bits (64 bytes)
  *
+ *  The structure can be serialized and then either loaded (copy) or memory-mapped (zero-copy, see load(mapped_file,offset)):
+ *  the serialization format pads the superblock ranks and the blocks to 64-byte file offsets for this purpose. A
+ *  serialized string can also be left on disk (semi-external, see load_paged): only the superblock ranks are then kept
+ *  in memory, and the blocks are read through a cache of bounded size.
+ *
  *  Size of the string: 512/117 < 4.38n bits, where n = string length
  *
  *  512-bits Block layout:
@@ -37,74 +43,73 @@
 #define BLOCK_SIZE_N 117 					//number of characters inside a block
 #define BYTES_PER_BLOCK_N 64				//bytes in a block of 512 bits
 #define ALN_N 64							//alignment
+#define BLOCKS_PER_CHUNK_N 8192				//blocks encoded at once by a construction thread (about 1 MB of input)
 
 #include "include.hpp"
+#include "block_rank.hpp"
+#include "mapped_file.hpp"
+#include "block_cache.hpp"
+#include <memory>
+#include <atomic>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 class dna_string_n{
 
 public:
 
+	typedef dna_n_alphabet alphabet;
+
+	//written in index files (see dna_bwt::save_to_file)
+	static uint64_t type_id(){
+		return 0;
+	}
+
 	dna_string_n(){}
 
 	/*
-	 * constructor from ASCII file
+	 * Data and superblock_ranks point into buffers owned by the string (or into its mapping): a copy would point into the buffers of
+	 * the original. Moves keep the buffers where they are, so the pointers stay valid in the target (the moved-from
+	 * string is not to be used)
 	 */
-	dna_string_n(string path, char TERM = '#'){
-
-		this->TERM = TERM;
-
-		n = uint64_t(filesize(path));
-
-		n_superblocks = (n+1)/SUPERBLOCK_SIZE_N_N + ((n+1)%SUPERBLOCK_SIZE_N_N != 0);
-		n_blocks = (n+1)/BLOCK_SIZE_N + ((n+1)%BLOCK_SIZE_N != 0);
-		nbytes = (n_blocks * BYTES_PER_BLOCK_N);//number of bytes effectively filled with data
-
-		superblock_ranks = vector<p_rank_n>(n_superblocks);
-
-		/*
-		 * this block of code ensures that data is aligned by 64 bytes = 512 bits
-		 */
-		memory = vector<uint8_t>(nbytes+ALN_N,0);
-		data = memory.data();
-		while(uint64_t(data) % ALN_N != 0) data++;
+	dna_string_n(const dna_string_n&) = delete;
+	dna_string_n& operator=(const dna_string_n&) = delete;
 
-		//cout << "alignment of data: " << (void*)data << endl;
-
-		{
-
-			ifstream ifs(path);
-
-			string BUF(BLOCK_SIZE_N,'A');
-
-			for(uint64_t i = 0; i<n; ++i){
+	dna_string_n(dna_string_n&&) = default;
+	dna_string_n& operator=(dna_string_n&&) = default;
 
-				char c;
-
-				ifs.read((char*)&c, sizeof(char));
-
-				BUF[i%BLOCK_SIZE_N] = c;
+	/*
+	 * constructor from ASCII file. 
+	 *
+	 * The file is read in large chunks of blocks; chunks are validated and encoded in parallel by 'threads' 
+	 * threads (a chunk never crosses a superblock). Block and superblock counters are then fixed up with a 
+	 * two-level prefix sum: the (few) chunk totals are scanned serially, then each chunk sets the counters 
+	 * of its blocks in parallel.
+	 */
+	dna_string_n(string path, char TERM = '#', int threads = 1){
 
-				if(c!='A' and c!='C' and c!='G' and c!='N' and c!='T' and c!=TERM){
-					cout << "Error while reading file: read forbidden character '" <<  c << "' (ASCII code " << int(c) << ")." <<
-					"Only A,C,G,N,T, and " << TERM << " are admitted in the input BWT!" << endl <<
-					"Possible solution: if the unknown character is the terminator, you can solve the problem by adding option \"-t " << int(c) << "\"." << endl;
+		build(input_file_size(path), TERM, threads, false, [&](char* buf, uint64_t from, uint64_t len){
 
-					exit(1);
-				}
+			read_file_range(path, buf, from, len);
 
-				//buffer is full
-				if((i%BLOCK_SIZE_N) == BLOCK_SIZE_N-1) set(i/BLOCK_SIZE_N, BUF);
+		});
 
-			}
+		assert(check_content(path));
 
-			if(n % BLOCK_SIZE_N != 0) set(n/BLOCK_SIZE_N, BUF);
+	}
 
-		}
+	/*
+	 * constructor from a stream of n characters: read(buf, len) writes the next len characters of the string
+	 * to buf (e.g. a BWT computed on the fly, see pfp.hpp). read is called by one thread at a time, in order:
+	 * the chunks of 'threads' consecutive chunks are read, then encoded in parallel.
+	 */
+	template<class read_t>
+	dna_string_n(uint64_t n, read_t read, char TERM = '#', int threads = 1){
 
-		build_rank_support();
-
-		assert(check_content(path));
-		assert(check_rank());
+		build(n, TERM, threads, true, [&](char* buf, uint64_t, uint64_t len){ read(buf, len); });
 
 	}
 
@@ -130,8 +135,10 @@ public:
 		uint64_t block_number = superblock_off / BLOCK_SIZE_N;
 		uint64_t block_off = superblock_off % BLOCK_SIZE_N;
 
+		alignas(ALN_N) uint8_t scratch[BYTES_PER_BLOCK_N];
+
 		//chars[2,1,0] contains 1st, 2nd, 3rd most significant bits of the 117 characters (in the 117-bits prefix of each block of 128 bits)
-		__uint128_t* chars = (__uint128_t*)(data + superblock_number*BYTES_PER_SUPERBLOCK_N + block_number*BYTES_PER_BLOCK_N);
+		const __uint128_t* chars = (const __uint128_t*)block_address(superblock_number, block_number, scratch);
 
 		uint64_t b =	((chars[0]>>(128-(block_off+1)))&0x1) +
 						(((chars[1]>>(128-(block_off+1)))&0x1)<<1) +
@@ -156,10 +163,83 @@ public:
 		uint64_t block_number = superblock_off / BLOCK_SIZE_N;
 		uint64_t block_off = superblock_off % BLOCK_SIZE_N;
 
+		alignas(ALN_N) uint8_t scratch[BYTES_PER_BLOCK_N];
+		const uint8_t* start = block_address(superblock_number, block_number, scratch);
+
 		p_rank_n superblock_r = superblock_ranks[superblock_number];
-		p_rank_n block_r = get_counters(superblock_number,block_number);
+		p_rank_n block_r = get_counters(start);
+
+		return superblock_r + block_r + rank_kernel.one(start, block_off);
+
+	}
+
+	/*
+	 * Parallel rank of (A,C,G,N,T) at the k positions pos[0] <= pos[1] <= ... <= pos[k-1]: out[i] = parallel_rank(pos[i]).
+	 * Consecutive positions falling in the same block share the block lookup: the block and its counters are loaded 
+	 * once and all in-block ranks are computed by one multi-offset kernel call (per group of at most BLOCK_SIZE_N
+	 * positions: positions may repeat).
+	 */
+	void parallel_rank_multi(const uint64_t* pos, int k, p_rank_n* out){
+
+		uint64_t offs[BLOCK_SIZE_N];
+		alignas(ALN_N) uint8_t scratch[BYTES_PER_BLOCK_N];
+
+		int i = 0;
+
+		while(i<k){
+
+			assert(i == 0 or pos[i] >= pos[i-1]);
+
+			uint64_t superblock_number = pos[i] / SUPERBLOCK_SIZE_N_N;
+			uint64_t superblock_off = pos[i] % SUPERBLOCK_SIZE_N_N;
+			uint64_t block_number = superblock_off / BLOCK_SIZE_N;
+			uint64_t block_start = pos[i] - superblock_off % BLOCK_SIZE_N;
+
+			//positions in the same block
+			int j = i;
+			while(j<k and j-i < BLOCK_SIZE_N and pos[j] - block_start < BLOCK_SIZE_N){
+
+				offs[j-i] = pos[j] - block_start;
+				j++;
+
+			}
+
+			const uint8_t* start = block_address(superblock_number, block_number, scratch);
+
+			p_rank_n r = superblock_ranks[superblock_number] + get_counters(start);
+
+			rank_kernel.multi(start, offs, j-i, out+i);
+
+			for(int h=i;h<j;++h) out[h] = out[h] + r;
+
+			i = j;
+
+		}
+
+	}
+
+	/*
+	 * software prefetch of the block containing position i (a later rank at i will not wait for memory)
+	 */
+	inline void prefetch(uint64_t i){
+
+		//a string on disk is read through its cache, which has no asynchronous read
+		if(cache) return;
+
+		uint64_t superblock_number = i / SUPERBLOCK_SIZE_N_N;
+		uint64_t block_number = (i % SUPERBLOCK_SIZE_N_N) / BLOCK_SIZE_N;
+
+		__builtin_prefetch(data + superblock_number*BYTES_PER_SUPERBLOCK_N + block_number*BYTES_PER_BLOCK_N);
 
-		return superblock_r + block_r + block_rank(superblock_number, block_number, block_off);
+	}
+
+	/*
+	 * prefetch for the positions pos[0] <= ... <= pos[k-1]. Positions falling in the block of the previous one are skipped
+	 */
+	inline void prefetch_multi(const uint64_t* pos, int k){
+
+		for(int i=0;i<k;++i)
+			if(i == 0 or pos[i]/BLOCK_SIZE_N != pos[i-1]/BLOCK_SIZE_N) prefetch(pos[i]);
 
 	}
 
@@ -173,11 +253,11 @@ public:
 		if(c==TERM) return rank_non_dna(i);
 
 		switch(c){
-			case 'A' : return pr.A; break;
-			case 'C' : return pr.C; break;
-			case 'G' : return pr.G; break;
-			case 'N' : return pr.N; break;
-			case 'T' : return pr.T; break;
+			case 'A' : return pr[alphabet::A]; break;
+			case 'C' : return pr[alphabet::C]; break;
+			case 'G' : return pr[alphabet::G]; break;
+			case 'N' : return pr[alphabet::N]; break;
+			case 'T' : return pr[alphabet::T]; break;
 		}
 
 		return 0;
@@ -192,9 +272,9 @@ public:
 		assert(i<=n);
 		auto r = parallel_rank(i);
 
-		assert(r.A + r.C + r.G + r.T + r.N <= i);
+		assert(r.sum() <= i);
 
-		return i - (r.A + r.C + r.G + r.T + r.N);
+		return i - r.sum();
 
 	}
 
@@ -202,16 +282,24 @@ public:
 
 		uint64_t w_bytes = 0;
 
+		uint64_t term = uint8_t(TERM);
+
 		out.write((char*)&n,sizeof(n));
 		out.write((char*)&nbytes,sizeof(nbytes));
 		out.write((char*)&n_superblocks,sizeof(n_superblocks));
 		out.write((char*)&n_blocks,sizeof(n_blocks));
+		out.write((char*)&term,sizeof(term));
+
+		w_bytes += sizeof(n) + sizeof(nbytes) + sizeof(n_superblocks) + sizeof(n_blocks) + sizeof(term);
 
-		w_bytes += sizeof(n) + sizeof(nbytes) + sizeof(n_superblocks) + sizeof(n_blocks);
+		//superblock ranks and blocks start at 64-byte file offsets, so that they can be memory-mapped
+		w_bytes += write_padding(out);
 
-		out.write((char*)superblock_ranks.data(),n_superblocks*sizeof(p_rank_n));
+		out.write((char*)superblock_ranks,n_superblocks*sizeof(p_rank_n));
 		w_bytes += n_superblocks*sizeof(p_rank_n);
 
+		w_bytes += write_padding(out);
+
 		out.write((char*)data,nbytes*sizeof(uint8_t));
 		w_bytes += nbytes*sizeof(uint8_t);
 
@@ -221,16 +309,28 @@ public:
 
 	void load(std::istream& in) {
 
+		uint64_t term = 0;
+
 		in.read((char*)&n,sizeof(n));
 		in.read((char*)&nbytes,sizeof(nbytes));
 		in.read((char*)&n_superblocks,sizeof(n_superblocks));
 		in.read((char*)&n_blocks,sizeof(n_blocks));
+		in.read((char*)&term,sizeof(term));
 
-		superblock_ranks = vector<p_rank_n>(n_superblocks);
-		in.read((char*)superblock_ranks.data(),n_superblocks*sizeof(p_rank_n));
+		TERM = char(term);
 
-		memory = vector<uint8_t>(nbytes+ALN_N,0);
-		data = memory.data();
+		cache.reset();
+
+		skip_padding(in);
+
+		superblock_memory = vector<p_rank_n>(n_superblocks);
+		superblock_ranks = superblock_memory.data();
+		in.read((char*)superblock_ranks,n_superblocks*sizeof(p_rank_n));
+
+		skip_padding(in);
+
+		memory = std::unique_ptr<uint8_t[]>(new uint8_t[nbytes+ALN_N]);
+		data = memory.get();
 		while(uint64_t(data) % ALN_N != 0) data++;
 		in.read((char*)data,nbytes*sizeof(uint8_t));
 
@@ -238,133 +338,367 @@ public:
 
 	}
 
-	uint64_t size(){
-		return n;
+	/*
+	 * zero-copy load from a memory-mapped file containing the serialization of the string at the given
+	 * offset. Superblock ranks and blocks are not copied: they point straight into the (64-byte aligned) 
+	 * mapped region, which is kept alive by this object. Returns the offset following the structure.
+	 */
+	uint64_t load(std::shared_ptr<mapped_file> file, uint64_t offset){
+
+		uint8_t* base = file->data();
+
+		n = *(uint64_t*)(base + offset);
+		nbytes = *(uint64_t*)(base + offset + 8);
+		n_superblocks = *(uint64_t*)(base + offset + 16);
+		n_blocks = *(uint64_t*)(base + offset + 24);
+		TERM = char(*(uint64_t*)(base + offset + 32));
+
+		offset = padded(offset + 40);
+
+		memory.reset();
+		cache.reset();
+		superblock_memory = vector<p_rank_n>();
+
+		superblock_ranks = (p_rank_n*)(base + offset);
+		offset = padded(offset + n_superblocks*sizeof(p_rank_n));
+
+		data = base + offset;
+		offset += nbytes;
+
+		if(offset > file->size()){
+
+			throw make_error("truncated index file");
+
+		}
+
+		assert(uint64_t(data) % ALN_N == 0);
+
+		mapping = file;
+
+		return offset;
+
 	}
 
-private:
+	/*
+	 * semi-external load from the file at path containing the serialization of the string at the given offset: only
+	 * the superblock ranks are read in memory. The blocks (with their counters) stay on disk and are read through a
+	 * block_cache of at most cache_bytes bytes. Returns the offset following the structure.
+	 */
+	uint64_t load_paged(string path, uint64_t offset, uint64_t cache_bytes){
 
-	void build_rank_support(){
+		std::ifstream in(path, std::ios::binary);
 
-		p_rank_n superblock_r = {};
-		p_rank_n block_r = {};
+		uint64_t header[5] = {};
 
-		for(uint64_t bl = 0; bl < n_blocks-1; ++bl){
+		in.seekg(offset);
+		in.read((char*)header, sizeof(header));
 
-			uint64_t superblock_number = bl/BLOCKS_PER_SUPERBLOCK_N;
-			uint64_t block_number = bl%BLOCKS_PER_SUPERBLOCK_N;
+		n = header[0];
+		nbytes = header[1];
+		n_superblocks = header[2];
+		n_blocks = header[3];
+		TERM = char(header[4]);
 
-			if(block_number == 0){
+		offset = padded(offset + sizeof(header));
 
-				superblock_ranks[superblock_number]=superblock_r;
-				block_r = {};
+		memory.reset();
+		mapping.reset();
 
-			}
+		superblock_memory = vector<p_rank_n>(n_superblocks);
+		superblock_ranks = superblock_memory.data();
 
-			set_counters(superblock_number, block_number,block_r);
+		in.seekg(offset);
+		in.read((char*)superblock_ranks, n_superblocks*sizeof(p_rank_n));
 
-			p_rank_n local_rank = block_rank(superblock_number, block_number);
+		offset = padded(offset + n_superblocks*sizeof(p_rank_n));
 
-			block_r = block_r + local_rank;
-			superblock_r = superblock_r + local_rank;
+		if(not in or offset + nbytes > uint64_t(filesize(path))){
+
+			throw make_error("truncated index file");
 
 		}
 
-		uint64_t superblock_number = (n_blocks-1)/BLOCKS_PER_SUPERBLOCK_N;
-		uint64_t block_number = (n_blocks-1)%BLOCKS_PER_SUPERBLOCK_N;
+		data = NULL;
+		cache = std::make_shared<block_cache>(path, offset, nbytes, cache_bytes);
 
-		if(block_number == 0){
+		return offset + nbytes;
 
-			superblock_ranks[superblock_number]=superblock_r;
-			block_r = {};
+	}
 
-		}
+	//pages of blocks read from disk so far (string loaded with load_paged)
+	uint64_t pages_read(){
+		return cache ? cache->misses() : 0;
+	}
 
-		set_counters(superblock_number, block_number,block_r);
+	uint64_t size(){
+		return n;
+	}
 
+	/*
+	 * number of positions i > 0 such that S[i] != S[i-1], counted while encoding the blocks. Only for a string
+	 * built by this process: it is not serialized (index files store r in their header, see dna_bwt)
+	 */
+	uint64_t run_breaks(){
+		return breaks;
 	}
 
+	//bytes used by the structure
+	uint64_t bytes(){
+		return (cache ? cache->bytes() : nbytes) + n_superblocks*sizeof(p_rank_n);
+	}
 
 	/*
-	 * set i-th block to s. Assumption: s.length() == BLOCK_SIZE_N
+	 * hash of the sizes, of the terminator and of the superblock ranks. Does not touch the blocks, so 
+	 * that it can be verified on a memory-mapped string in negligible time.
 	 */
-	void set(uint64_t i, string & s){
+	uint64_t checksum(){
 
-		assert(s.length()==BLOCK_SIZE_N);
-		assert(i<n_blocks);
+		uint64_t term = uint8_t(TERM);
 
-		uint64_t superblock_number = i / BLOCKS_PER_SUPERBLOCK_N;
-		uint64_t block_number = i % BLOCKS_PER_SUPERBLOCK_N;
+		uint64_t h = fnv1a(&n, sizeof(n));
+		h = fnv1a(&nbytes, sizeof(nbytes), h);
+		h = fnv1a(&n_superblocks, sizeof(n_superblocks), h);
+		h = fnv1a(&n_blocks, sizeof(n_blocks), h);
+		h = fnv1a(&term, sizeof(term), h);
 
-		//a block contains 117 characters
-		//chars[2,1,0] contains 1st, 2nd, 3rd most significant bits of the 117 characters
-		__uint128_t* chars = (__uint128_t*)(data + superblock_number*BYTES_PER_SUPERBLOCK_N + block_number*BYTES_PER_BLOCK_N);
+		return fnv1a(superblock_ranks, n_superblocks*sizeof(p_rank_n), h);
+
+	}
+
+private:
+
+	//round offset up to the next multiple of ALN_N
+	static uint64_t padded(uint64_t offset){
+		return ((offset + ALN_N - 1)/ALN_N)*ALN_N;
+	}
+
+	//pad the stream with zeros up to the next 64-byte offset. Returns the number of written bytes
+	static uint64_t write_padding(std::ostream& out){
 
-		chars[2] = 0;
-		chars[1] = 0;
-		chars[0] = 0;
+		uint64_t pos = uint64_t(out.tellp());
+		uint64_t pad = padded(pos) - pos;
+
+		char zeros[ALN_N] = {};
+		out.write(zeros, pad);
+
+		return pad;
+
+	}
+
+	static void skip_padding(std::istream& in){
+
+		uint64_t pos = uint64_t(in.tellg());
+		in.seekg(padded(pos));
+
+	}
+
+	/*
+	 * build the string of length n. fill(buf, from, len) writes characters [from, from+len) to buf. If sequential, 
+	 * the chunks are filled in order by the calling thread, 'threads' at a time; otherwise each chunk is filled by the
+	 * thread encoding it.
+	 */
+	template<class fill_t>
+	void build(uint64_t n, char TERM, int threads, bool sequential, fill_t fill){
+
+		this->TERM = TERM;
+		this->n = n;
+
+		n_superblocks = (n+1)/SUPERBLOCK_SIZE_N_N + ((n+1)%SUPERBLOCK_SIZE_N_N != 0);
+		n_blocks = (n+1)/BLOCK_SIZE_N + ((n+1)%BLOCK_SIZE_N != 0);
+		nbytes = (n_blocks * BYTES_PER_BLOCK_N);//number of bytes effectively filled with data
+
+		superblock_memory = vector<p_rank_n>(n_superblocks);
+		superblock_ranks = superblock_memory.data();
 
 		/*
-		 * internal encoding (does not reflect lexicographic ordering, which is the standard alphabetical one)
-		 *
-		 * A     000
-		 * C     001
-		 * G     010
-		 * T     011
-		 * TERM  100
-		 * N     101
-		 *
+		 * this block of code ensures that data is aligned by 64 bytes = 512 bits. The memory is not initialized: 
+		 * every byte is written by the (parallel) encoding below, so pages are first touched by the encoding threads.
 		 */
+		memory = std::unique_ptr<uint8_t[]>(new uint8_t[nbytes+ALN_N]);
+		data = memory.get();
+		while(uint64_t(data) % ALN_N != 0) data++;
+
+		//cout << "alignment of data: " << (void*)data << endl;
+
+		//chunks of at most BLOCKS_PER_CHUNK_N blocks, not crossing superblock boundaries
+		vector<uint64_t> chunk_start;
+
+		for(uint64_t bl = 0; bl < n_blocks; ){
+
+			chunk_start.push_back(bl);
+			bl = std::min(bl + BLOCKS_PER_CHUNK_N, (bl/BLOCKS_PER_SUPERBLOCK_N + 1)*BLOCKS_PER_SUPERBLOCK_N);
+
+		}
+
+		chunk_start.push_back(n_blocks);
+
+		uint64_t n_chunks = chunk_start.size()-1;
+
+		vector<p_rank_n> chunk_rank(n_chunks); //number of A,C,G,N,T in each chunk (phase 1), then before each chunk inside its superblock (phase 2)
+		vector<uint64_t> chunk_breaks(n_chunks, 0); //run breaks inside each chunk (see run_breaks)
+		vector<char> chunk_first(n_chunks), chunk_last(n_chunks); //first and last character of each chunk
+
+		std::atomic<bool> error {false};
+		std::atomic<uint64_t> error_pos {n};
+		vector<char> error_char(n_chunks); //first forbidden character of each chunk
+
+		//chunk c followed by 16 'A' (code 000), so that the last block can be encoded with full 16-byte loads
+		auto read_chunk = [&](uint64_t c, vector<char> & buf){
+
+			buf.assign((chunk_start[c+1]-chunk_start[c])*BLOCK_SIZE_N + 16, 'A');
+
+			uint64_t from = chunk_start[c]*BLOCK_SIZE_N;
+			fill(buf.data(), std::min(from, n), std::min(chunk_start[c+1]*BLOCK_SIZE_N, n) - std::min(from, n));
+
+		};
+
+		uint64_t batch = sequential ? uint64_t(threads) : n_chunks;
+		vector<vector<char> > batch_buf(sequential ? batch : 0);
+
+		//phase 1: read, validate and encode chunks
+		for(uint64_t first = 0; first < n_chunks; first += batch){
+
+			uint64_t last = std::min(n_chunks, first + batch);
+
+			if(sequential) for(uint64_t c = first; c < last; ++c) read_chunk(c, batch_buf[c-first]);
+
+			parallel_for_chunks(last - first, threads, [&](uint64_t i){
+
+				uint64_t c = first + i;
+
+				vector<char> own_buf;
+				if(not sequential) read_chunk(c, own_buf);
+
+				vector<char> & buf = sequential ? batch_buf[i] : own_buf;
+
+				uint64_t from = chunk_start[c]*BLOCK_SIZE_N;
+				uint64_t len = std::min(chunk_start[c+1]*BLOCK_SIZE_N, n) - std::min(from, n);
 
-		for(auto c : s){
+				p_rank_n tot = {};
 
-			if(c==TERM){
+				for(uint64_t bl = chunk_start[c]; bl < chunk_start[c+1]; ++bl){
 
-				chars[2] = (chars[2] << 1) | __uint128_t(0x1);
-				chars[1] = chars[1] << 1;
-				chars[0] = chars[0] << 1;
+					uint64_t chars_in_block = std::min(uint64_t(BLOCK_SIZE_N), len - std::min(len, (bl-chunk_start[c])*BLOCK_SIZE_N));
 
-			}else{
+					if(not encode_block(bl, buf.data() + (bl-chunk_start[c])*BLOCK_SIZE_N, chars_in_block, chunk_breaks[c])){
 
-				switch(c){
+						//report the first forbidden character of the string
+						uint64_t pos = bl*BLOCK_SIZE_N;
+						while(valid_char(buf[pos - from])) pos++;
 
-				case 'A' : 	chars[2] = chars[2] << 1;
-							chars[1] = chars[1] << 1;
-							chars[0] = chars[0] << 1;break;
+						error_char[c] = buf[pos - from];
 
-				case 'C' : 	chars[2] = chars[2] << 1;
-							chars[1] = chars[1] << 1;
-							chars[0] = (chars[0] << 1) | __uint128_t(0x1);break;
+						uint64_t cur = error_pos;
+						while(pos < cur and not error_pos.compare_exchange_weak(cur, pos));
 
-				case 'G' : 	chars[2] = chars[2] << 1;
-							chars[1] = (chars[1] << 1) | __uint128_t(0x1);
-							chars[0] = chars[0] << 1;break;
+						error = true;
+						return;
 
-				case 'T' : 	chars[2] = chars[2] << 1;
-							chars[1] = (chars[1] << 1) | __uint128_t(0x1);
-							chars[0] = (chars[0] << 1) | __uint128_t(0x1);break;
+					}
+
+					tot = tot + block_rank(bl/BLOCKS_PER_SUPERBLOCK_N, bl%BLOCKS_PER_SUPERBLOCK_N);
+
+					//break between the last character of the previous block and the first of this one
+					uint64_t b = (bl-chunk_start[c])*BLOCK_SIZE_N;
+					if(b > 0 and b < len) chunk_breaks[c] += buf[b] != buf[b-1];
 
-				case 'N' : 	chars[2] = (chars[2] << 1) | __uint128_t(0x1);
-							chars[1] = chars[1] << 1;
-							chars[0] = (chars[0] << 1) | __uint128_t(0x1);break;
 				}
 
-			}
+				chunk_rank[c] = tot;
+
+				if(len > 0){
+
+					chunk_first[c] = buf[0];
+					chunk_last[c] = buf[len-1];
+
+				}
+
+			});
+
+		}
+
+		if(error){
+
+			//the chunk containing the first error
+			uint64_t e = std::upper_bound(chunk_start.begin(), chunk_start.end(), error_pos/BLOCK_SIZE_N) - chunk_start.begin() - 1;
+			char c = error_char[e];
+
+			throw make_error("read forbidden character '", c, "' (ASCII code ", int(c), ") while reading the BWT. ",
+			"Only A,C,G,N,T, and ", TERM, " are admitted in the input BWT!\n",
+			"Possible solution: if the unknown character is the terminator, you can solve the problem by adding option \"-t ", int(c), "\".");
 
 		}
 
-		//leave 11 (=128-117) bits free at the end of each 128-bit block. We will store N's partial rank here.
+		breaks = 0;
+
+		for(uint64_t c = 0; c < n_chunks; ++c){
 
-		chars[2] = chars[2] << 11;
-		chars[1] = chars[1] << 11;
-		chars[0] = chars[0] << 11;
+			breaks += chunk_breaks[c];
+			if(c > 0 and chunk_start[c]*BLOCK_SIZE_N < n) breaks += chunk_first[c] != chunk_last[c-1];
+
+		}
+
+		//prefix sum of the chunk totals: superblock ranks, and rank of each chunk inside its superblock
+		p_rank_n superblock_r = {};
+
+		for(uint64_t c = 0; c < n_chunks; ++c){
+
+			uint64_t superblock_number = chunk_start[c]/BLOCKS_PER_SUPERBLOCK_N;
+
+			if(chunk_start[c]%BLOCKS_PER_SUPERBLOCK_N == 0) superblock_ranks[superblock_number] = superblock_r;
+
+			p_rank_n tot = chunk_rank[c];
+
+			chunk_rank[c] = superblock_r - superblock_ranks[superblock_number];
+
+			superblock_r = superblock_r + tot;
+
+		}
+
+		//phase 2: block counters
+		parallel_for_chunks(n_chunks, threads, [&](uint64_t c){
+
+			p_rank_n block_r = chunk_rank[c];
+
+			for(uint64_t bl = chunk_start[c]; bl < chunk_start[c+1]; ++bl){
+
+				uint64_t superblock_number = bl/BLOCKS_PER_SUPERBLOCK_N;
+				uint64_t block_number = bl%BLOCKS_PER_SUPERBLOCK_N;
+
+				set_counters(superblock_number, block_number, block_r);
+				block_r = block_r + block_rank(superblock_number, block_number);
+
+			}
+
+		});
+
+		assert(check_rank());
+
+	}
+
+	inline bool valid_char(char c){
+
+		return c=='A' or c=='C' or c=='G' or c=='N' or c=='T' or c==TERM;
+
+	}
+
+	//reverse the bits of a 64-bit word
+	static inline uint64_t reverse_bits(uint64_t x){
+
+		x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+		x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+		x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+
+		return __builtin_bswap64(x);
 
 	}
 
 	/*
-	 * rank in block given as coordinates: superblock, block, offset in block
+	 * encode the first len <= BLOCK_SIZE_N characters of s in the bl-th block (characters after the len-th are encoded as A)
+	 * and add to breaks the number of run breaks among them. s must be readable up to position 128. Counters are not set.
+	 * Returns false if s contains a forbidden character.
 	 */
-	inline p_rank_n block_rank(uint64_t superblock_number, uint64_t block_number, uint64_t block_off=BLOCK_SIZE_N){
+	bool encode_block(uint64_t bl, const char* s, uint64_t len, uint64_t & breaks){
 
 		/*
 		 * internal encoding (does not reflect lexicographic ordering, which is the standard alphabetical one)
@@ -378,31 +712,110 @@ private:
 		 *
 		 */
 
-		assert(block_off<=BLOCK_SIZE_N);
+		//bit planes with the i-th character in the i-th bit (word 0: characters 0-63, word 1: characters 64-127)
+		uint64_t b0[2] = {}, b1[2] = {}, b2[2] = {}, ok[2] = {};
 
-		//starting address of the block
-		uint8_t* start = data + superblock_number*BYTES_PER_SUPERBLOCK_N + block_number*BYTES_PER_BLOCK_N;
+#if defined(__SSE2__)
 
-		//chars[0..3] contains 1st, 2nd, 3rd bits of the 128 characters
-		__uint128_t* chars = (__uint128_t*)(start);
+		const __m128i A = _mm_set1_epi8('A'), C = _mm_set1_epi8('C'), G = _mm_set1_epi8('G');
+		const __m128i N = _mm_set1_epi8('N'), T = _mm_set1_epi8('T'), TM = _mm_set1_epi8(TERM);
 
-		__uint128_t PAD = ((~__uint128_t(0))>>block_off);
+		for(int g = 0; g < 8; ++g){
 
-		//no character's code begins with 11, so we pad most 2 significant bits
-		__uint128_t b2 = chars[2] | PAD;
-		__uint128_t b1 = chars[1] | PAD;
-		__uint128_t b0 = chars[0];
+			__m128i x = _mm_loadu_si128((const __m128i*)(s + 16*g));
 
-		return {
+			__m128i is_C = _mm_cmpeq_epi8(x, C);
+			__m128i is_G = _mm_cmpeq_epi8(x, G);
+			__m128i is_N = _mm_cmpeq_epi8(x, N);
+			__m128i is_T = _mm_cmpeq_epi8(x, T);
+			__m128i is_TM = _mm_cmpeq_epi8(x, TM);
+
+			__m128i m0 = _mm_or_si128(_mm_or_si128(is_C, is_T), is_N);
+			__m128i m1 = _mm_or_si128(is_G, is_T);
+			__m128i m2 = _mm_or_si128(is_TM, is_N);
+			__m128i v = _mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(is_TM, _mm_cmpeq_epi8(x, A)));
+
+			int w = g/4, sh = 16*(g%4);
 
-			popcount128((~b2) & (~b1) & (~b0)), // A = 000
-			popcount128((~b2) & (~b1) & (b0)), // C = 001
-			popcount128((~b2) & (b1) & (~b0)), // G = 010
-			popcount128((b2) & (~b1) & (b0)), // N = 101
-			popcount128((~b2) & (b1) & (b0)), // T = 011
+			b0[w] |= uint64_t(uint16_t(_mm_movemask_epi8(m0))) << sh;
+			b1[w] |= uint64_t(uint16_t(_mm_movemask_epi8(m1))) << sh;
+			b2[w] |= uint64_t(uint16_t(_mm_movemask_epi8(m2))) << sh;
+			ok[w] |= uint64_t(uint16_t(_mm_movemask_epi8(v))) << sh;
 
+		}
+
+#else
+
+		for(int i = 0; i < 128; ++i){
+
+			char c = s[i];
+			int w = i/64, sh = i%64;
+
+			b0[w] |= uint64_t(c=='C' or c=='T' or c=='N') << sh;
+			b1[w] |= uint64_t(c=='G' or c=='T') << sh;
+			b2[w] |= uint64_t(c==TERM or c=='N') << sh;
+			ok[w] |= uint64_t(valid_char(c)) << sh;
+
+		}
+
+#endif
+
+		//characters after the len-th are A
+		uint64_t keep[2] = {
+			len >= 64 ? ~uint64_t(0) : (uint64_t(1) << len) - 1,
+			len >= 128 ? ~uint64_t(0) : (len <= 64 ? 0 : (uint64_t(1) << (len-64)) - 1)
 		};
 
+		if((ok[0] & keep[0]) != keep[0] or (ok[1] & keep[1]) != keep[1]) return false;
+
+		breaks += plane_breaks<3,2>({b0, b1, b2}, len);
+
+		uint64_t superblock_number = bl / BLOCKS_PER_SUPERBLOCK_N;
+		uint64_t block_number = bl % BLOCKS_PER_SUPERBLOCK_N;
+
+		//chars[2,1,0] contains 1st, 2nd, 3rd most significant bits of the 117 characters, first character in the most 
+		//significant bit. The 11 (=128-117) least significant bits are left free: we will store N's partial rank there.
+		__uint128_t* chars = (__uint128_t*)(data + superblock_number*BYTES_PER_SUPERBLOCK_N + block_number*BYTES_PER_BLOCK_N);
+
+		chars[0] = (__uint128_t(reverse_bits(b0[0] & keep[0])) << 64) | reverse_bits(b0[1] & keep[1]);
+		chars[1] = (__uint128_t(reverse_bits(b1[0] & keep[0])) << 64) | reverse_bits(b1[1] & keep[1]);
+		chars[2] = (__uint128_t(reverse_bits(b2[0] & keep[0])) << 64) | reverse_bits(b2[1] & keep[1]);
+
+		return true;
+
+	}
+
+	/*
+	 * address of the block given as coordinates: in memory, or, for a string on disk (see load_paged), its copy in
+	 * scratch (BYTES_PER_BLOCK_N bytes, 64-byte aligned) read through the cache
+	 */
+	inline const uint8_t* block_address(uint64_t superblock_number, uint64_t block_number, uint8_t* scratch){
+
+		uint64_t offset = superblock_number*BYTES_PER_SUPERBLOCK_N + block_number*BYTES_PER_BLOCK_N;
+
+		if(__builtin_expect(cache != NULL, 0)){
+
+			cache->read_block(offset, scratch, BYTES_PER_BLOCK_N);
+			return scratch;
+
+		}
+
+		return data + offset;
+
+	}
+
+	/*
+	 * rank in block given as coordinates: superblock, block, offset in block
+	 */
+	inline p_rank_n block_rank(uint64_t superblock_number, uint64_t block_number, uint64_t block_off=BLOCK_SIZE_N){
+
+		assert(block_off<=BLOCK_SIZE_N);
+
+		//starting address of the block
+		uint8_t* start = data + superblock_number*BYTES_PER_SUPERBLOCK_N + block_number*BYTES_PER_BLOCK_N;
+
+		return rank_kernel.one(start, block_off);
+
 	}
 
 	bool check_rank(){
@@ -418,19 +831,10 @@ private:
 			if(p != r){
 
 				res = false;
-				/*cout << "Error in local rank at position " << n << " "
-				<< p.A << "/" << r.A << " "
-				<< p.C << "/" << r.C << " "
-				<< p.G << "/" << r.G << " "
-				<< p.T << "/" << r.T << endl;*/
 
 			}
 
-			p.A += (operator[](i)=='A');
-			p.C += (operator[](i)=='C');
-			p.G += (operator[](i)=='G');
-			p.T += (operator[](i)=='T');
-			p.N += (operator[](i)=='N');
+			for(int c=0;c<alphabet::sigma;++c) p[c] += (operator[](i)==alphabet::letter(c));
 
 		}
 
@@ -439,11 +843,6 @@ private:
 		if(p != r){
 
 			res = false;
-			/*cout << "Error in local rank at position " << n << " "
-			<< p.A << "/" << r.A << " "
-			<< p.C << "/" << r.C << " "
-			<< p.G << "/" << r.G << " "
-			<< p.T << "/" << r.T << endl;*/
 
 		}
 
@@ -502,16 +901,16 @@ private:
 		uint8_t* start = data + superblock_number*BYTES_PER_SUPERBLOCK_N + block_number*BYTES_PER_BLOCK_N;
 		uint32_t * block_ranks = (uint32_t*)(start+48);
 
-		block_ranks[0] = r.A;
-		block_ranks[1] = r.C;
-		block_ranks[2] = r.G;
-		block_ranks[3] = r.T;
+		block_ranks[0] = r[alphabet::A];
+		block_ranks[1] = r[alphabet::C];
+		block_ranks[2] = r[alphabet::G];
+		block_ranks[3] = r[alphabet::T];
 
 		uint64_t * chars = (uint64_t*)(start);
 
-		chars[0] += (r.N & MASK);
-		chars[2] += ((r.N>>11) & MASK);
-		chars[4] += ((r.N>>22) & MASK);
+		chars[0] += (r[alphabet::N] & MASK);
+		chars[2] += ((r[alphabet::N]>>11) & MASK);
+		chars[4] += ((r[alphabet::N]>>22) & MASK);
 
 		//the 32 bits of N counter are stored in the length-11 suffixes of chars[0,2,4]
 		uint64_t rank_N = (chars[0]&MASK) + ((chars[2]&MASK)<<11) + ((chars[4]&MASK)<<22);
@@ -525,11 +924,18 @@ private:
 	 */
 	inline p_rank_n get_counters(uint64_t superblock_number, uint64_t superblock_off){
 
-		//block start
-		uint8_t* start = data + superblock_number*BYTES_PER_SUPERBLOCK_N + superblock_off*BYTES_PER_BLOCK_N;
-		uint32_t * block_ranks = (uint32_t*)(start+48);
+		return get_counters(data + superblock_number*BYTES_PER_SUPERBLOCK_N + superblock_off*BYTES_PER_BLOCK_N);
 
-		uint64_t * chars = (uint64_t*)(start);
+	}
+
+	/*
+	 * get counters of the block starting at address start
+	 */
+	inline p_rank_n get_counters(const uint8_t* start){
+
+		const uint32_t * block_ranks = (const uint32_t*)(start+48);
+
+		const uint64_t * chars = (const uint64_t*)(start);
 
 		//the 32 bits of N counter are stored in the length-11 suffixes of chars[0,2,4]
 		uint64_t rank_N = (chars[0]&MASK) + ((chars[2]&MASK)<<11) + ((chars[4]&MASK)<<22);
@@ -546,17 +952,27 @@ private:
 
 	char TERM = '#';
 
+	//in-block rank kernel (scalar or SIMD), selected at runtime for this CPU
+	block_rank_kernels rank_kernel = block_rank_kernel();
+
 	static const uint64_t MASK = (uint64_t(1)<<11)-1;
 
 	uint64_t n_superblocks = 0;
 	uint64_t n_blocks = 0;
+	uint64_t breaks = 0;	//see run_breaks()
 
-	vector<uint8_t> memory; //allocated memory
+	std::unique_ptr<uint8_t[]> memory; //allocated memory (empty if the string is memory-mapped)
 
-	//data aligned with blocks of 64 bytes = 512 bits
+	//data aligned with blocks of 64 bytes = 512 bits. Points either inside memory or inside mapping (NULL if the
+	//blocks are on disk, read through cache)
 	uint8_t * data = NULL;
 
-	vector<p_rank_n> superblock_ranks;
+	std::shared_ptr<block_cache> cache;
+
+	vector<p_rank_n> superblock_memory; //allocated superblock ranks (empty if the string is memory-mapped)
+	p_rank_n * superblock_ranks = NULL;
+
+	std::shared_ptr<mapped_file> mapping; //keeps the mapped index alive
 
 	uint64_t nbytes = 0; //bytes used in data
 	uint64_t n = 0;
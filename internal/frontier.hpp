@@ -0,0 +1,215 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * frontier.hpp
+ *
+ *  Support for the level-synchronous traversal of the Weiner tree (see visit_levels in rho.cpp).
+ *
+ *  frontier_store<T> is an append-only sequence of trivially copyable records (the nodes of a level, or what the
+ *  traversal keeps about them) that is read back in ranges. The last records are kept in a memory buffer of bounded
+ *  size; when the buffer is full, it is appended to an anonymous temporary file (tmpfile(), removed at exit), so
+ *  that a level may be larger than the memory. frontier_reader reads a store sequentially, one chunk at a time.
+ *
+ *  radix_sort_queries sorts the rank queries of a batch of nodes (BWT position, index of the answer) by position,
+ *  with an LSD radix sort on the bits that positions < n actually have: the ranks can then be computed in one
+ *  sequential sweep over the BWT blocks.
+ *
+ */
+
+#ifndef INTERNAL_FRONTIER_HPP_
+#define INTERNAL_FRONTIER_HPP_
+
+#include "include.hpp"
+#include <cstdio>
+
+#define FRONTIER_BUFFER 67108864	//default bytes of a frontier_store kept in memory (64 MB)
+#define RADIX_BITS 11				//bits sorted by each pass of radix_sort_queries
+
+template<class T>
+class frontier_store{
+
+public:
+
+	/*
+	 * records beyond buffer_bytes are written to a temporary file
+	 */
+	frontier_store(uint64_t buffer_bytes = FRONTIER_BUFFER) : capacity(std::max(uint64_t(1), buffer_bytes/sizeof(T))){}
+
+	~frontier_store(){
+
+		if(file != NULL) fclose(file);
+
+	}
+
+	frontier_store(const frontier_store&) = delete;
+	frontier_store& operator=(const frontier_store&) = delete;
+
+	inline void push_back(const T & x){
+
+		if(buffer.size() == capacity) flush();
+
+		buffer.push_back(x);
+
+	}
+
+	/*
+	 * copy records [from, from+len) to out
+	 */
+	void read(uint64_t from, uint64_t len, T* out){
+
+		assert(from + len <= size());
+
+		//part on disk
+		if(from < on_disk){
+
+			uint64_t k = std::min(len, on_disk - from);
+
+			fseeko(file, off_t(from*sizeof(T)), SEEK_SET);
+
+			if(fread(out, sizeof(T), k, file) != k){
+
+				throw make_error("cannot read the temporary file of a frontier");
+
+			}
+
+			from += k;
+			len -= k;
+			out += k;
+
+		}
+
+		if(len > 0) std::copy(buffer.begin() + (from - on_disk), buffer.begin() + (from - on_disk + len), out);
+
+	}
+
+	uint64_t size(){
+		return on_disk + buffer.size();
+	}
+
+	//empty the store (the temporary file is kept, and overwritten)
+	void clear(){
+
+		buffer.clear();
+		on_disk = 0;
+
+	}
+
+private:
+
+	void flush(){
+
+		if(file == NULL) file = tmpfile();
+
+		if(file == NULL){
+
+			throw make_error("cannot create a temporary file for a frontier");
+
+		}
+
+		fseeko(file, off_t(on_disk*sizeof(T)), SEEK_SET);
+
+		if(fwrite(buffer.data(), sizeof(T), buffer.size(), file) != buffer.size()){
+
+			throw make_error("cannot write the temporary file of a frontier (disk full?)");
+
+		}
+
+		on_disk += buffer.size();
+		buffer.clear();
+
+	}
+
+	uint64_t capacity = 0; //records in the buffer
+	vector<T> buffer;
+	uint64_t on_disk = 0;
+	FILE* file = NULL;
+
+};
+
+/*
+ * sequential reader of a frontier_store, from its first record, in chunks of 'chunk' records
+ */
+template<class T>
+class frontier_reader{
+
+public:
+
+	frontier_reader(frontier_store<T> & store, uint64_t chunk = 65536) : store(store), chunk(chunk){}
+
+	inline T & next(){
+
+		if(i == buffer.size()){
+
+			uint64_t len = std::min(chunk, store.size() - read);
+			assert(len > 0);
+
+			buffer.resize(len);
+			store.read(read, len, buffer.data());
+
+			read += len;
+			i = 0;
+
+		}
+
+		return buffer[i++];
+
+	}
+
+private:
+
+	frontier_store<T> & store;
+	uint64_t chunk = 0;
+	vector<T> buffer;
+	uint64_t i = 0;
+	uint64_t read = 0; //records copied from the store
+
+};
+
+//rank query: BWT position, and index of its answer
+struct rank_query{
+
+	uint64_t pos;
+	uint64_t idx;
+
+};
+
+/*
+ * sort the queries by position (all positions are <= n). tmp is scratch space
+ */
+inline void radix_sort_queries(vector<rank_query> & q, vector<rank_query> & tmp, uint64_t n){
+
+	const uint64_t B = uint64_t(1) << RADIX_BITS;
+
+	uint64_t bits = 64 - __builtin_clzll(n | 1);
+
+	tmp.resize(q.size());
+
+	vector<uint64_t> count(B);
+
+	for(uint64_t shift = 0; shift < bits; shift += RADIX_BITS){
+
+		std::fill(count.begin(), count.end(), 0);
+
+		for(auto & x : q) count[(x.pos >> shift) & (B-1)]++;
+
+		uint64_t sum = 0;
+
+		for(uint64_t d = 0; d < B; ++d){
+
+			uint64_t c = count[d];
+			count[d] = sum;
+			sum += c;
+
+		}
+
+		for(auto & x : q) tmp[count[(x.pos >> shift) & (B-1)]++] = x;
+
+		q.swap(tmp);
+
+	}
+
+}
+
+#endif /* INTERNAL_FRONTIER_HPP_ */
@@ -6,9 +6,26 @@
 #define INCLUDE_HPP_
 
 #include <fstream>
+#include <iostream>
 #include <vector>
 #include <cassert>
 #include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <array>
+#include <bitset>
+#include <utility>
+#include <type_traits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -16,145 +33,330 @@ typedef pair<uint64_t,uint64_t> range_t;
 
 //const char TERM = '#';
 
-std::ifstream::pos_type filesize(string filename){
+inline std::ifstream::pos_type filesize(string filename){
     std::ifstream in(filename.c_str(), std::ifstream::ate | std::ifstream::binary);
     return in.tellg();
 }
 
 /*
- * representation of a right-maximal substring (SA node) as a list of BWT intervals
+ * 64-bit FNV-1a hash of len bytes, continuing from hash h
  */
-struct sa_node{
+inline uint64_t fnv1a(const void* bytes, uint64_t len, uint64_t h = 0xcbf29ce484222325ULL){
 
-	//right-maximal substring: string W such that Wa_1, ..., Wa_k occur in the text for
-	//at least k>=2 characters a_1, ..., a_k
+	const uint8_t* b = (const uint8_t*)bytes;
 
-	uint64_t first_TERM;
-	uint64_t first_A;
-	uint64_t first_C;
-	uint64_t first_G;
-	uint64_t first_T;
-	uint64_t last;
+	for(uint64_t i=0;i<len;++i){
 
-	//depth = |W|
-	uint64_t depth;
+		h ^= b[i];
+		h *= 0x100000001b3ULL;
 
-	uint64_t key(){
-		return first_TERM;
+	}
+
+	return h;
+
+}
+
+/*
+ * exception thrown on invalid input and on I/O errors: the arguments are written, as by operator<<, into its message
+ */
+template<class... T>
+inline std::runtime_error make_error(const T&... parts){
+
+	std::ostringstream msg;
+
+	int unused[] = {0, ((msg << parts), 0)...};
+	(void)unused;
+
+	return std::runtime_error(msg.str());
+
+}
+
+/*
+ * call fn(t) for t = 0, ..., threads-1, each on its own thread (t = 0 on the calling thread), and wait for all of
+ * them. The first exception thrown by one of the calls is rethrown once all the threads have returned
+ */
+template<class F>
+inline void run_threads(int threads, F fn){
+
+	std::exception_ptr error;
+	std::mutex m;
+
+	auto guarded = [&](int t){
+
+		try{
+
+			fn(t);
+
+		}catch(...){
+
+			std::lock_guard<std::mutex> lock(m);
+			if(not error) error = std::current_exception();
+
+		}
+
+	};
+
+	vector<std::thread> workers;
+
+	for(int t = 1; t < threads; ++t) workers.push_back(std::thread(guarded, t));
+
+	guarded(0);
+
+	for(auto & w : workers) w.join();
+
+	if(error) std::rethrow_exception(error);
+
+}
+
+/*
+ * call fn(c) for c = 0, ..., n_chunks-1 using the given number of threads. Chunks are handed out dynamically; after
+ * an exception no new chunk is started, and the exception is rethrown (see run_threads)
+ */
+template<class F>
+inline void parallel_for_chunks(uint64_t n_chunks, int threads, F fn){
+
+	std::atomic<uint64_t> next {0};
+
+	run_threads(int(std::min(uint64_t(threads), n_chunks)), [&](int){
+
+		try{
+
+			for(uint64_t c = next++; c < n_chunks; c = next++) fn(c);
+
+		}catch(...){
+
+			next = n_chunks;
+			throw;
+
+		}
+
+	});
+
+}
+
+/*
+ * compile-time loop: calls f(std::integral_constant<int,0>()), ..., f(std::integral_constant<int,N-1>()). The
+ * per-letter loops below use it, so that they are unrolled and every alphabet gets its own straight-line code.
+ */
+template<class F, int... I>
+__attribute__((always_inline)) inline void static_for_impl(F& f, std::integer_sequence<int, I...>){
+
+	int unused[] = {0, (f(std::integral_constant<int, I>()), 0)...};
+	(void)unused;
+
+}
+
+template<int N, class F>
+__attribute__((always_inline)) inline void static_for(F f){
+
+	static_for_impl(f, std::make_integer_sequence<int, N>());
+
+}
+
+/*
+ * alphabet descriptors. An alphabet has sigma letters, in lexicographic order, plus the terminator (smaller than
+ * every letter, not counted in sigma). Letters are identified by their index c = 0, ..., sigma-1; letter(c) is
+ * the ASCII character of the c-th letter.
+ */
+struct dna_alphabet{
+
+	static constexpr int sigma = 4;
+	enum { A, C, G, T };
+
+	static constexpr char letter(int c){
+		return "ACGT"[c];
 	}
 
 };
 
-struct sa_node_n{
+struct dna_n_alphabet{
+
+	static constexpr int sigma = 5;
+	enum { A, C, G, N, T };
+
+	static constexpr char letter(int c){
+		return "ACGNT"[c];
+	}
+
+};
+
+/*
+ * byte alphabets (proteins, text, ...): at most S letters, whose characters are known only at runtime (the c-th
+ * smallest byte of the BWT other than the terminator is letter c, see byte_string). Letters c >= the actual
+ * alphabet size have empty intervals.
+ */
+template<int S>
+struct byte_alphabet{
+
+	static constexpr int sigma = S;
+
+};
+
+/*
+ * representation of a right-maximal substring (SA node) as a list of BWT intervals
+ */
+template<class alphabet>
+struct alpha_node{
+
+	typedef alphabet alphabet_t;
 
 	//right-maximal substring: string W such that Wa_1, ..., Wa_k occur in the text for
 	//at least k>=2 characters a_1, ..., a_k
 
-	uint64_t first_TERM;
-	uint64_t first_A;
-	uint64_t first_C;
-	uint64_t first_G;
-	uint64_t first_N;
-	uint64_t first_T;
-	uint64_t last;
+	//bounds[0] = first position of the interval of W.TERM, bounds[c+1] = first position of the interval of
+	//W.letter(c), bounds[sigma+1] = last position (excluded) of the interval of W
+	std::array<uint64_t, alphabet::sigma+2> bounds;
 
 	//depth = |W|
 	uint64_t depth;
 
-	uint64_t key(){
-		return first_TERM;
+	uint64_t key() const{
+		return bounds[0];
+	}
+
+	uint64_t first() const{
+		return bounds[0];
+	}
+
+	uint64_t last() const{
+		return bounds[alphabet::sigma+1];
 	}
 
 };
 
+typedef alpha_node<dna_alphabet> sa_node;
+typedef alpha_node<dna_n_alphabet> sa_node_n;
+
 /*
- * file contains 'N' characters
+ * size in bytes of the input file in path; throws if it is not a readable regular file
  */
-bool hasN(string filename){
+inline uint64_t input_file_size(string path){
+
+	struct stat st;
 
-	std:ifstream i(filename);
+	if(stat(path.c_str(), &st) != 0 or not S_ISREG(st.st_mode) or access(path.c_str(), R_OK) != 0)
+		throw make_error("cannot open file ", path);
 
-	char c;
+	return uint64_t(st.st_size);
 
-	while (i.get(c)){
+}
 
-		if(c=='N') return true;
+/*
+ * read the len bytes at offset 'from' of the file in path into buf, with pread on a descriptor of the caller (the
+ * chunked constructors read their chunks from several threads). Throws if the file cannot be opened or is shorter
+ */
+inline void read_file_range(string path, char* buf, uint64_t from, uint64_t len){
+
+	int fd = open(path.c_str(), O_RDONLY);
+
+	if(fd < 0) throw make_error("cannot open file ", path);
+
+	uint64_t done = 0;
+
+	while(done < len){
+
+		ssize_t r = pread(fd, buf + done, len - done, from + done);
+
+		if(r <= 0) break;
+		done += r;
 
 	}
 
-	return false;
+	close(fd);
 
-}
+	if(done < len) throw make_error("cannot read file ", path, " (", from + done, " bytes read, expected ", from + len, ")");
 
-uint64_t node_size(sa_node s){
-	return s.last - s.first_TERM;
 }
 
-uint64_t node_size(pair<sa_node, sa_node> p){
-	return node_size(p.first) + node_size(p.second);
-}
+/*
+ * file contains 'N' characters. Scans the file in 1 MB chunks and stops at the first N.
+ */
+inline bool hasN(string filename){
 
-uint64_t node_size(sa_node_n s){
-	return s.last - s.first_TERM;
-}
+	std::ifstream i(filename, std::ios::binary);
 
-uint64_t node_size(pair<sa_node_n, sa_node_n> p){
-	return node_size(p.first) + node_size(p.second);
-}
+	vector<char> buf(1<<20);
+
+	while(i.read(buf.data(), buf.size()) or i.gcount() > 0){
 
-void print_node(sa_node n){
+		if(memchr(buf.data(), 'N', i.gcount()) != NULL) return true;
 
-	cout << "[" << 	n.first_TERM << ", " <<
-					n.first_A << ", " <<
-					n.first_C << ", " <<
-					n.first_G << ", " <<
-					n.first_T << ", " <<
-					n.last << "]" << endl;
+	}
+
+	return false;
 
 }
 
-void print_node(sa_node_n n){
+/*
+ * number of occurrences of each byte in the file. Scans the file in 1 MB chunks (four partial counts, so that
+ * consecutive equal bytes do not wait for each other's increment).
+ */
+inline std::array<uint64_t, 256> char_counts(string filename){
+
+	std::ifstream i(filename, std::ios::binary);
+
+	if(not i) throw make_error("cannot open file ", filename);
+
+	vector<char> buf(1<<20);
+	vector<uint64_t> cnt(4*256, 0);
+
+	while(i.read(buf.data(), buf.size()) or i.gcount() > 0){
 
-	cout << "[" << 	n.first_TERM << ", " <<
-					n.first_A << ", " <<
-					n.first_C << ", " <<
-					n.first_G << ", " <<
-					n.first_N << ", " <<
-					n.first_T << ", " <<
-					n.last << "]" << endl;
+		const uint8_t* b = (const uint8_t*)buf.data();
+		uint64_t len = i.gcount();
+		uint64_t j = 0;
+
+		for(;j+4<=len;j+=4){
+
+			cnt[b[j]]++;
+			cnt[256 + b[j+1]]++;
+			cnt[512 + b[j+2]]++;
+			cnt[768 + b[j+3]]++;
+
+		}
+
+		for(;j<len;++j) cnt[b[j]]++;
+
+	}
+
+	std::array<uint64_t, 256> counts;
+
+	for(int c=0;c<256;++c) counts[c] = cnt[c] + cnt[256+c] + cnt[512+c] + cnt[768+c];
+
+	return counts;
 
 }
 
-sa_node merge_nodes(sa_node a, sa_node b){
+template<class alphabet>
+inline uint64_t node_size(const alpha_node<alphabet>& s){
+	return s.last() - s.first();
+}
 
-	assert(a.depth == b.depth);
+template<class alphabet>
+inline uint64_t node_size(const pair<alpha_node<alphabet>, alpha_node<alphabet> >& p){
+	return node_size(p.first) + node_size(p.second);
+}
 
-	return {
-		a.first_TERM + b.first_TERM,
-		a.first_A + b.first_A,
-		a.first_C + b.first_C,
-		a.first_G + b.first_G,
-		a.first_T + b.first_T,
-		a.last + b.last,
-		a.depth
-	};
+template<class alphabet>
+void print_node(const alpha_node<alphabet>& n){
+
+	cout << "[";
+	for(int i=0;i<alphabet::sigma+1;++i) cout << n.bounds[i] << ", ";
+	cout << n.last() << "]" << endl;
 
 }
 
-sa_node_n merge_nodes(sa_node_n a, sa_node_n b){
+template<class alphabet>
+alpha_node<alphabet> merge_nodes(const alpha_node<alphabet>& a, const alpha_node<alphabet>& b){
 
 	assert(a.depth == b.depth);
 
-	return {
-		a.first_TERM + b.first_TERM,
-		a.first_A + b.first_A,
-		a.first_C + b.first_C,
-		a.first_G + b.first_G,
-		a.first_N + b.first_N,
-		a.first_T + b.first_T,
-		a.last + b.last,
-		a.depth
-	};
+	alpha_node<alphabet> m;
+
+	static_for<alphabet::sigma+2>([&](int i){ m.bounds[i] = a.bounds[i] + b.bounds[i]; });
+	m.depth = a.depth;
+
+	return m;
 
 }
 
@@ -192,214 +394,248 @@ inline uint64_t leaf_size(pair<sa_leaf, sa_leaf> P){
 }
 
 
-struct p_range{
+//BWT intervals reached by LF from an interval, one per letter
+template<class alphabet>
+using alpha_range = std::array<range_t, alphabet::sigma>;
 
-	range_t A;
-	range_t C;
-	range_t G;
-	range_t T;
+//nodes reached by LF from a node, one per letter
+template<class alphabet>
+using alpha_p_node = std::array<alpha_node<alphabet>, alphabet::sigma>;
 
-};
+typedef alpha_range<dna_alphabet> p_range;
+typedef alpha_range<dna_n_alphabet> p_range_n;
+typedef alpha_p_node<dna_alphabet> p_node;
+typedef alpha_p_node<dna_n_alphabet> p_node_n;
 
-struct p_node{
+/*
+ * set of right extensions (or of Weiner links) of a node: bit 0 = terminator, bit c+1 = letter c
+ */
+template<class alphabet>
+using flags = std::bitset<alphabet::sigma+1>;
 
-	sa_node A;
-	sa_node C;
-	sa_node G;
-	sa_node T;
+template<class alphabet>
+void print_nodes(const alpha_p_node<alphabet>& p){
 
-};
+	for(auto & n : p) print_node(n);
 
-struct p_range_n{
+}
 
-	range_t A;
-	range_t C;
-	range_t G;
-	range_t N;
-	range_t T;
+/*
+ * parallel rank: number of occurrences of each letter (terminator excluded), indexed by letter
+ */
+template<class alphabet>
+struct alpha_rank{
 
-};
+	std::array<uint64_t, alphabet::sigma> count;
 
-struct p_node_n{
+	uint64_t& operator[](int c){
+		return count[c];
+	}
 
-	sa_node_n A;
-	sa_node_n C;
-	sa_node_n G;
-	sa_node_n N;
-	sa_node_n T;
+	uint64_t operator[](int c) const{
+		return count[c];
+	}
 
-};
+	//total number of letters
+	uint64_t sum() const{
 
-struct flags{
-	bool TM,A,C,G,N,T;
-};
+		uint64_t s = 0;
+		static_for<alphabet::sigma>([&](int c){ s += count[c]; });
 
-void print_nodes(p_node p){
+		return s;
 
-	print_node(p.A);
-	print_node(p.C);
-	print_node(p.G);
-	print_node(p.T);
+	}
 
-}
+	alpha_rank operator+(const alpha_rank& a) const{
 
-struct p_rank{
+		alpha_rank r;
+		static_for<alphabet::sigma>([&](int c){ r.count[c] = count[c] + a.count[c]; });
 
-public:
+		return r;
 
-	uint64_t A;
-	uint64_t C;
-	uint64_t G;
-	uint64_t T;
+	}
+
+	alpha_rank operator-(const alpha_rank& a) const{
 
-	p_rank operator+(const p_rank& a) const{
+		alpha_rank r;
+		static_for<alphabet::sigma>([&](int c){ r.count[c] = count[c] - a.count[c]; });
 
-		return {
-			a.A + A,
-			a.C + C,
-			a.G + G,
-			a.T + T
-		};
+		return r;
 
 	}
 
-	bool operator==(const p_rank& a) const{
+	bool operator==(const alpha_rank& a) const{
 
-		return a.A == A and a.C == C and a.G == G and a.T == T;
+		return count == a.count;
 
 	}
 
-	bool operator!=(const p_rank& a) const{
+	bool operator!=(const alpha_rank& a) const{
 
-		return a.A != A or a.C != C or a.G != G or a.T != T;
+		return count != a.count;
 
 	}
 
-	bool operator<=(const p_rank& a) const{
+	bool operator<=(const alpha_rank& a) const{
+
+		bool le = true;
+		static_for<alphabet::sigma>([&](int c){ le &= count[c] <= a.count[c]; });
 
-		return A <= a.A and C <= a.C and G <= a.G and T <= a.T;
+		return le;
 
 	}
 
 };
 
-struct p_rank_n{
+typedef alpha_rank<dna_alphabet> p_rank;
+typedef alpha_rank<dna_n_alphabet> p_rank_n;
 
-public:
+template<class alphabet>
+inline alpha_range<alphabet> fold_ranks(const alpha_rank<alphabet> &a, const alpha_rank<alphabet> &b){
 
-	uint64_t A;
-	uint64_t C;
-	uint64_t G;
-	uint64_t N;
-	uint64_t T;
+	alpha_range<alphabet> r;
+	static_for<alphabet::sigma>([&](int c){ r[c] = {a[c], b[c]}; });
 
-	p_rank_n operator+(const p_rank_n& a) const{
+	return r;
 
-		return {
-			a.A + A,
-			a.C + C,
-			a.G + G,
-			a.N + N,
-			a.T + T
-		};
+}
 
-	}
+inline uint64_t popcount128(__uint128_t x){
 
-	bool operator==(const p_rank_n& a) const{
+	return __builtin_popcountll(uint64_t(x>>64)) + __builtin_popcountll( x & 0xFFFFFFFFFFFFFFFF );
 
-		return a.A == A and a.C == C and a.G == G and a.N == N and a.T == T;
+}
 
-	}
+/*
+ * right extensions of string(N): bit e is set iff bounds[e+1] > bounds[e] (e = 0: terminator, e = c+1: letter c).
+ * The set is built in 64-bit words (one for the DNA alphabets), faster than setting the bits one by one.
+ */
+template<class alphabet>
+__attribute__((always_inline)) inline flags<alphabet> right_extensions(const alpha_node<alphabet>& N){
 
-	bool operator!=(const p_rank_n& a) const{
+	const int words = (alphabet::sigma + 64)/64;
 
-		return a.A != A or a.C != C or a.G != G or a.N != N or a.T != T;
+	uint64_t m[words] = {};
 
-	}
+	static_for<alphabet::sigma+1>([&](int e){ m[e/64] |= uint64_t(N.bounds[e+1] > N.bounds[e]) << (e%64); });
 
-	bool operator<=(const p_rank_n& a) const{
+	flags<alphabet> f(m[words-1]);
 
-		return A <= a.A and C <= a.C and G <= a.G and N <= a.N and T <= a.T;
+	for(int w=words-2;w>=0;--w){
 
-	}
+		f <<= 64;
+		f |= flags<alphabet>(m[w]);
 
-};
+	}
 
-inline p_range fold_ranks(p_rank &a, p_rank &b){
+	return f;
 
-	return {{a.A, b.A},{a.C, b.C},{a.G, b.G},{a.T, b.T}};
+}
 
+template<class alphabet>
+inline bool empty_node(const alpha_node<alphabet>& N){
+	return N.last() == N.first();
 }
 
-inline p_range_n fold_ranks(p_rank_n &a, p_rank_n &b){
+template<class alphabet>
+__attribute__((always_inline)) inline int number_of_right_ext(const alpha_node<alphabet>& N){
 
-	return {{a.A, b.A},{a.C, b.C},{a.G, b.G},{a.N, b.N},{a.T, b.T}};
+	int k = 0;
+	static_for<alphabet::sigma+1>([&](int e){ k += N.bounds[e+1] > N.bounds[e]; });
+
+	return k;
 
 }
 
-inline uint64_t popcount128(__uint128_t x){
+inline void compare_exchange(uint64_t * size, uint8_t * pos, int i, int j){
 
-	return __builtin_popcountll(uint64_t(x>>64)) + __builtin_popcountll( x & 0xFFFFFFFFFFFFFFFF );
+	bool swap = size[j] < size[i] or (size[j] == size[i] and pos[j] < pos[i]);
 
-}
+	uint64_t s_i = swap ? size[j] : size[i];
+	uint64_t s_j = swap ? size[i] : size[j];
+	uint8_t p_i = swap ? pos[j] : pos[i];
+	uint8_t p_j = swap ? pos[i] : pos[j];
 
-inline bool has_right_ext_TERM(sa_node N){
-	return N.first_A > N.first_TERM;
-}
-inline bool has_right_ext_A(sa_node N){
-	return N.first_C > N.first_A;
-}
-inline bool has_right_ext_C(sa_node N){
-	return N.first_G > N.first_C;
-}
-inline bool has_right_ext_G(sa_node N){
-	return N.first_T > N.first_G;
-}
-inline bool has_right_ext_T(sa_node N){
-	return N.last > N.first_T;
-}
+	size[i] = s_i; size[j] = s_j;
+	pos[i] = p_i; pos[j] = p_j;
 
-inline bool has_right_ext_TERM(sa_node_n N){
-	return N.first_A > N.first_TERM;
-}
-inline bool has_right_ext_A(sa_node_n N){
-	return N.first_C > N.first_A;
-}
-inline bool has_right_ext_C(sa_node_n N){
-	return N.first_G > N.first_C;
-}
-inline bool has_right_ext_G(sa_node_n N){
-	return N.first_N > N.first_G;
-}
-inline bool has_right_ext_N(sa_node_n N){
-	return N.first_T > N.first_N;
-}
-inline bool has_right_ext_T(sa_node_n N){
-	return N.last > N.first_T;
 }
 
-inline bool empty_node(sa_node_n N){
-	return N.last == N.first_TERM;
-}
+/*
+ * sort the t Weiner children by increasing size, ties broken by position: same order as the insertion sort 
+ * std::sort performs on so few elements. For t <= 5 (DNA alphabets): optimal sorting network for 5 keys 
+ * (9 branch-free compare-exchanges) on (size,position) keys, absent nodes get the largest keys. Larger 
+ * alphabets use a stable insertion sort of the keys.
+ */
+template<class node_t>
+inline void sort_nodes_by_size(node_t * nodes, int t){
 
-uint8_t number_of_right_ext(sa_node N){
+	if(t < 2) return;
 
-	return 	uint8_t(N.last>N.first_T) +
-			uint8_t(N.first_T>N.first_G) +
-			uint8_t(N.first_G>N.first_C) +
-			uint8_t(N.first_C>N.first_A) +
-			uint8_t(N.first_A>N.first_TERM);
+	if(t > 5){
 
-}
+		//stable insertion sort of the (size,position) keys, then the nodes (large, for large alphabets) are
+		//moved once each, following the cycles of the permutation
+		std::pair<uint64_t,int> key[node_t::alphabet_t::sigma];
+
+		for(int i=0;i<t;++i){
+
+			std::pair<uint64_t,int> k = {node_size(nodes[i]), i};
+			int j = i;
+
+			for(;j>0 and key[j-1].first > k.first;--j) key[j] = key[j-1];
+
+			key[j] = k;
+
+		}
+
+		for(int i=0;i<t;++i){
+
+			if(key[i].second < 0 or key[i].second == i) continue;
+
+			node_t x = nodes[i];
+			int j = i;
+
+			//position j receives the node at key[j].second
+			while(key[j].second != i){
+
+				int next = key[j].second;
+
+				nodes[j] = nodes[next];
+				key[j].second = -1;
+				j = next;
+
+			}
+
+			nodes[j] = x;
+			key[j].second = -1;
+
+		}
+
+		return;
+
+	}
+
+	uint64_t size[5];
+	uint8_t pos[5];
+
+	for(int i=0;i<5;++i){
+
+		size[i] = i < t ? node_size(nodes[i]) : ~uint64_t(0);
+		pos[i] = uint8_t(i);
+
+	}
+
+	compare_exchange(size, pos, 0, 1); compare_exchange(size, pos, 3, 4);
+	compare_exchange(size, pos, 2, 4); compare_exchange(size, pos, 2, 3);
+	compare_exchange(size, pos, 0, 3); compare_exchange(size, pos, 0, 2);
+	compare_exchange(size, pos, 1, 4); compare_exchange(size, pos, 1, 3);
+	compare_exchange(size, pos, 1, 2);
 
-uint8_t number_of_right_ext(sa_node_n N){
+	node_t sorted[5];
 
-	return 	uint8_t(N.last>N.first_T) +
-			uint8_t(N.first_T>N.first_N) +
-			uint8_t(N.first_N>N.first_G) +
-			uint8_t(N.first_G>N.first_C) +
-			uint8_t(N.first_C>N.first_A) +
-			uint8_t(N.first_A>N.first_TERM);
+	for(int i=0;i<t;++i) sorted[i] = nodes[pos[i]];
+	for(int i=0;i<t;++i) nodes[i] = sorted[i];
 
 }
 
@@ -0,0 +1,122 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * index_file.hpp
+ *
+ *  Header of the index files written by dna_bwt::save_to_file and byte_bwt::save_to_file.
+ *
+ */
+
+#ifndef INTERNAL_INDEX_FILE_HPP_
+#define INTERNAL_INDEX_FILE_HPP_
+
+#include "include.hpp"
+#include <cstddef>
+
+/*
+ * header of an index file (see dna_bwt_n::save_to_file). The serialized structure follows the header.
+ */
+struct index_header{
+
+	char magic[8];
+	uint64_t version;
+	uint64_t TERM;
+	uint64_t n;			//BWT length
+	uint64_t runs;		//number of BWT runs
+	uint64_t checksum;	//checksum of the metadata of the index (see dna_bwt_n::checksum), verified at every load
+	uint64_t string_type;	//type of the BWT string (str_type::type_id()): 0 dna_string_n, 1 rle_string_n, 2 dna_string, 3 byte_string
+	uint64_t data_checksum;	//checksum of the whole serialized structure, blocks included (see index_data_checksum)
+
+};
+
+#define INDEX_MAGIC "RHOINDEX"
+#define INDEX_VERSION 3
+
+/*
+ * type of the BWT string (str_type::type_id()) stored in the index file at path
+ */
+inline uint64_t index_string_type(string path){
+
+	index_header h = {};
+
+	std::ifstream in(path, std::ios::binary);
+
+	if(not in.is_open()) throw make_error("cannot open index file ", path, ": ", strerror(errno));
+
+	in.read((char*)&h, sizeof(h));
+
+	if(not in or not std::equal(h.magic, h.magic+8, INDEX_MAGIC)){
+
+		throw make_error(path, " is not a valid index file");
+
+	}
+
+	return h.string_type;
+
+}
+
+/*
+ * checksum of the serialized structure stored in the index file at path: fnv1a of all the bytes after the header.
+ * Equal to fnv1a(data + sizeof(index_header), size - sizeof(index_header)) on the mapped file
+ */
+inline uint64_t index_data_checksum(string path){
+
+	std::ifstream in(path, std::ios::binary);
+
+	if(not in.is_open()) throw make_error("cannot open index file ", path, ": ", strerror(errno));
+
+	in.seekg(sizeof(index_header));
+
+	vector<char> buf(uint64_t(1)<<20);
+	uint64_t h = fnv1a(NULL, 0);
+
+	while(in){
+
+		in.read(buf.data(), buf.size());
+		h = fnv1a(buf.data(), uint64_t(in.gcount()), h);
+
+	}
+
+	if(in.bad()) throw make_error("cannot read index file ", path);
+
+	return h;
+
+}
+
+/*
+ * store index_data_checksum(path) in the header of the index file at path, once the structure has been written
+ */
+inline void seal_index_file(string path){
+
+	uint64_t h = index_data_checksum(path);
+
+	std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+	f.seekp(offsetof(index_header, data_checksum));
+	f.write((char*)&h, sizeof(h));
+	f.close();
+
+	if(not f){
+
+		throw make_error("cannot write index file ", path);
+
+	}
+
+}
+
+/*
+ * data_checksum = checksum of the serialized structure of the index file at path, as loaded
+ */
+inline void check_data_checksum(index_header & h, uint64_t data_checksum, string path){
+
+	if(h.data_checksum != data_checksum){
+
+		throw make_error("index file ", path, " is corrupted (checksum mismatch in the data)");
+
+	}
+
+}
+
+
+#endif /* INTERNAL_INDEX_FILE_HPP_ */
@@ -0,0 +1,89 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * mapped_file.hpp
+ *
+ *  Read-only memory mapping of a whole file (POSIX mmap).
+ *
+ *  The mapping is shared (MAP_SHARED): pages live in the page cache, so a warm reload costs no copy and
+ *  several processes mapping the same index share one physical copy of it. The mapping starts at a page
+ *  boundary, hence a structure stored at a file offset multiple of 64 is 64-byte aligned in memory.
+ *
+ */
+
+#ifndef INTERNAL_MAPPED_FILE_HPP_
+#define INTERNAL_MAPPED_FILE_HPP_
+
+#include "include.hpp"
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class mapped_file{
+
+public:
+
+	mapped_file(std::string path){
+
+		int fd = open(path.c_str(), O_RDONLY);
+
+		if(fd < 0){
+
+			throw make_error("cannot open file ", path, ": ", strerror(errno));
+
+		}
+
+		struct stat st;
+		fstat(fd, &st);
+		nbytes = uint64_t(st.st_size);
+
+		if(nbytes > 0){
+
+			void* addr = mmap(NULL, nbytes, PROT_READ, MAP_SHARED, fd, 0);
+
+			if(addr == MAP_FAILED){
+
+				throw make_error("cannot map file ", path, " in memory");
+
+			}
+
+			base = (uint8_t*)addr;
+
+		}
+
+		close(fd);
+
+	}
+
+	~mapped_file(){
+
+		if(base != NULL) munmap(base, nbytes);
+
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	uint8_t* data(){
+		return base;
+	}
+
+	uint64_t size(){
+		return nbytes;
+	}
+
+private:
+
+	uint8_t* base = NULL;
+	uint64_t nbytes = 0;
+
+};
+
+#endif /* INTERNAL_MAPPED_FILE_HPP_ */
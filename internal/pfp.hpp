@@ -0,0 +1,710 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * pfp.hpp
+ *
+ *  BWT of the DNA sequences of a FASTA file by prefix-free parsing (PFP: Boucher, Gagie, Kuhnle, Langmead, Manzini
+ *  and Mun, "Prefix-free parsing for building big BWTs", 2019).
+ *
+ *  Let S be the concatenation of the sequences of the file (headers and line breaks removed, lower case turned to
+ *  upper case, characters other than A,C,G,T turned to N), separated by a character # (PFP_SEP), and T = $^w S $^w,
+ *  where $ < # are smaller than all letters. Every sequence is thus followed by a terminator: # for all of them
+ *  but the last one, $ for the last one. In the BWT all the terminators are written as TERM, so that the BWT is the
+ *  one of a string collection (records with an empty sequence are skipped).
+ *  A window of w characters of T is a trigger if it is $^w, or if it contains no $ and its Karp-Rabin fingerprint
+ *  is 0 modulo PFP_MODULUS. Cutting T at the triggers gives the parse: a sequence of phrases, each of which starts
+ *  and ends with a trigger (consecutive phrases overlap by w characters). The dictionary is the set of distinct
+ *  phrases. On repetitive collections both the parse and the dictionary are much smaller than S.
+ *
+ *  The BWT of S$ (one terminator per sequence) is computed from the suffix array of the dictionary and from the suffix array of the parse (where
+ *  each phrase is replaced by its lexicographic rank), never from S:
+ *
+ *  - every position of S is at offset k < |D|-w of exactly one occurrence of a phrase D. Since no proper suffix
+ *    longer than w of a phrase is a prefix of another one, suffixes of S starting with different phrase suffixes
+ *    D[k..] are sorted as D[k..]. The groups of equal phrase suffixes are found by scanning the suffix array and
+ *    the LCP array of the dictionary.
+ *  - inside a group, the suffixes of S are sorted as the suffixes of the parse following the occurrences of the
+ *    phrases, i.e. by the position of those suffixes in the suffix array of the parse. For each phrase, the
+ *    sorted list of these positions is computed once from the suffix array of the parse.
+ *  - the BWT character is D[k-1] if k > 0, and the character preceding the occurrence of D otherwise. When all
+ *    the phrases of a group have k > 0 and the same D[k-1], the group is a run and the lists are not read.
+ *
+ *  Time and space are linear in the sizes of the parse and of the dictionary. The FASTA file is read in blocks of
+ *  PFP_BLOCK characters: the triggers of a block, the fingerprints of its phrases and the insertions in the
+ *  dictionary (split in one shard per thread) are computed in parallel. The BWT is then produced in order, a
+ *  character at a time, by read() (it is never stored: see the stream constructors of dna_string_n and dna_string).
+ *
+ *  The parse and the dictionary are limited to 2^32 - 2 phrases and characters.
+ *
+ */
+
+#ifndef INTERNAL_PFP_HPP_
+#define INTERNAL_PFP_HPP_
+
+#include "include.hpp"
+#include "sais.hpp"
+#include <unordered_map>
+#include <thread>
+#include <cctype>
+
+#define PFP_WINDOW 10			//length w of the windows
+#define PFP_MODULUS 100			//a window is a trigger if its fingerprint is 0 modulo PFP_MODULUS (expected phrase length)
+#define PFP_BLOCK 67108864		//FASTA characters parsed at once (64 MB)
+#define PFP_EOW 1				//end of phrase in the text of the dictionary
+#define PFP_DOLLAR 2			//the $ of T
+#define PFP_SEP 3				//the separator # between two sequences of S
+
+class pfp_bwt{
+
+public:
+
+	/*
+	 * parse the FASTA file at path with the given number of threads. TERM is the terminator written in the BWT
+	 */
+	pfp_bwt(string path, char TERM = '#', int threads = 1) : TERM(TERM), threads(threads){
+
+		parse(path);
+		sort_dictionary();
+		sort_parse();
+
+	}
+
+	//BWT length: length of S (separators included), plus the terminator
+	uint64_t size(){
+		return n + 1;
+	}
+
+	//number of (non-empty) sequences, i.e. of terminators in the BWT
+	uint64_t sequences(){
+		return separators + 1;
+	}
+
+	bool contains_N(){
+		return has_N;
+	}
+
+	//number of phrases of the parse
+	uint64_t parse_length(){
+		return p_len;
+	}
+
+	//number of phrases of the dictionary, and their total length
+	uint64_t dictionary_phrases(){
+		return d;
+	}
+
+	uint64_t dictionary_length(){
+		return dict.size();
+	}
+
+	/*
+	 * write the next len characters of the BWT to buf
+	 */
+	void read(char* buf, uint64_t len){
+
+		while(len > 0){
+
+			if(run_len > 0){
+
+				uint64_t l = std::min(len, run_len);
+
+				std::fill(buf, buf + l, run_char);
+				buf += l;
+				len -= l;
+				run_len -= l;
+				emitted += l;
+
+			}else if(merged_pos < merged.size()){
+
+				uint64_t l = std::min(len, uint64_t(merged.size() - merged_pos));
+
+				std::copy(merged.begin() + merged_pos, merged.begin() + merged_pos + l, buf);
+				merged_pos += l;
+				buf += l;
+				len -= l;
+				emitted += l;
+
+			}else if(not next_group()){
+
+				throw make_error("the prefix-free parsing produced ", emitted, " BWT characters, expected ", size());
+
+			}
+
+		}
+
+	}
+
+private:
+
+	//constants as enumerators: unlike static members they need no definition outside the class, which the header
+	//could not provide without being defined again in every translation unit including it
+	enum : uint64_t { w = PFP_WINDOW };
+
+	//Karp-Rabin fingerprints modulo the prime 2^61-1. The base is not a power of two: modulo 2^61-1, multiplying by
+	//a power of two only rotates the bits. No homopolymer window (e.g. a run of N) is a trigger with this base
+	enum : uint64_t { KR_PRIME = (uint64_t(1)<<61) - 1, KR_BASE = 1099511628211ULL };
+
+	static uint64_t mod_mul(uint64_t a, uint64_t b){
+
+		__uint128_t x = __uint128_t(a)*b;
+		uint64_t r = uint64_t(x & KR_PRIME) + uint64_t(x >> 61);
+
+		return r >= KR_PRIME ? r - KR_PRIME : r;
+
+	}
+
+	static uint64_t mod_add(uint64_t a, uint64_t b){
+
+		uint64_t r = a + b;
+		return r >= KR_PRIME ? r - KR_PRIME : r;
+
+	}
+
+	static uint64_t mod_sub(uint64_t a, uint64_t b){
+
+		return a >= b ? a - b : a + KR_PRIME - b;
+
+	}
+
+	//phrases of one shard of the dictionary (see insert_phrases)
+	struct shard_t{
+
+		unordered_map<uint64_t, uint32_t> id; //fingerprint -> local identifier
+		vector<string> phrases;
+
+	};
+
+	/*
+	 * run fn(t) for t = 0, ..., threads-1, each on its own thread (see run_threads)
+	 */
+	template<class F>
+	void parallel_for(F fn){
+
+		run_threads(threads, fn);
+
+	}
+
+	/*
+	 * append to seq the DNA characters of the next (at most) max bytes of the FASTA file. Returns false at the end of the file
+	 */
+	bool read_fasta(ifstream & in, vector<char> & seq, uint64_t max){
+
+		vector<char> raw(max);
+
+		in.read(raw.data(), max);
+		uint64_t len = in.gcount();
+
+		//DNA character of each byte: 0 for white space, N for the characters other than A,C,G,T (any case)
+		std::array<char, 256> code;
+
+		for(int c = 0; c < 256; ++c) code[c] = isspace(c) ? 0 : 'N';
+		for(char c : {'A','C','G','T'}) code[uint8_t(c)] = code[uint8_t(tolower(c))] = c;
+
+		uint64_t out = seq.size();
+		seq.resize(out + len + w);
+
+		for(uint64_t i = 0; i < len; ++i){
+
+			char c = raw[i];
+
+			if(c == '\n' or c == '\r'){
+
+				header = false;
+				line_start = true;
+				continue;
+
+			}
+
+			if(header) continue;
+
+			if(line_start and (c == '>' or c == ';')){
+
+				header = true;
+				sep_pending = sep_pending or (c == '>' and has_sequence);
+				continue;
+
+			}
+
+			line_start = false;
+
+			c = code[uint8_t(c)];
+
+			if(c == 0) continue;
+
+			//the separator of the previous sequence, in place of the '>' of its header (plus the slack of w characters of seq)
+			if(sep_pending){
+
+				seq[out++] = PFP_SEP;
+				separators++;
+				sep_pending = false;
+
+			}
+
+			has_N = has_N or c == 'N';
+			has_sequence = true;
+			seq[out++] = c;
+
+		}
+
+		seq.resize(out);
+
+		return len == max;
+
+	}
+
+	/*
+	 * true iff the window of w characters starting at buf is a trigger, given its fingerprint h
+	 */
+	static bool is_trigger(uint64_t h){
+		return h % PFP_MODULUS == 0;
+	}
+
+	/*
+	 * trigger windows starting in buf[from..to), with to <= buf.size() - w + 1, in increasing order
+	 */
+	void find_triggers(const vector<char> & buf, uint64_t from, uint64_t to, vector<uint64_t> & triggers){
+
+		uint64_t h = 0;
+		uint64_t last_dollar = 0; //one past the last $ in the current window
+
+		for(uint64_t i = from; i < to + w - 1; ++i){
+
+			//slide the window to buf[i-w+1..i]
+			if(i >= from + w) h = mod_sub(h, mod_mul(uint8_t(buf[i-w]), top));
+			h = mod_add(mod_mul(h, KR_BASE), uint8_t(buf[i]));
+
+			if(buf[i] == PFP_DOLLAR) last_dollar = i+1;
+
+			if(i + 1 >= from + w){
+
+				uint64_t start = i + 1 - w;
+
+				if(last_dollar <= start and is_trigger(h)) triggers.push_back(start);
+
+			}
+
+		}
+
+	}
+
+	/*
+	 * parse the FASTA file: fill the dictionary shards and the parse (local identifiers, see insert_phrases)
+	 */
+	void parse(string path){
+
+		ifstream in(path, std::ios::binary);
+
+		if(not in.good()){
+
+			throw make_error("cannot open FASTA file ", path);
+
+		}
+
+		top = 1;
+		for(uint64_t i = 1; i < w; ++i) top = mod_mul(top, KR_BASE);
+
+		shards = vector<shard_t>(threads);
+
+		//buf = the last (open) phrase, followed by the characters read so far. T starts with $^w, a trigger
+		vector<char> buf(w, PFP_DOLLAR);
+		bool more = true;
+
+		while(more){
+
+			uint64_t old_size = buf.size();
+
+			more = read_fasta(in, buf, PFP_BLOCK);
+			n += buf.size() - old_size;
+
+			if(buf.size() > old_size) last_char = buf.back();
+
+			if(not more) buf.insert(buf.end(), w, PFP_DOLLAR); //T ends with $^w
+
+			//triggers starting at 1, ..., buf.size()-w (buf[0..] is the start of a phrase), found in parallel
+			uint64_t windows = buf.size() - w;
+			vector<vector<uint64_t> > thread_triggers(threads);
+
+			parallel_for([&](int t){
+
+				uint64_t from = 1 + windows*t/threads;
+				uint64_t to = 1 + windows*(t+1)/threads;
+
+				if(from < to) find_triggers(buf, from, to, thread_triggers[t]);
+
+			});
+
+			vector<uint64_t> starts {0};
+			for(auto & tt : thread_triggers) starts.insert(starts.end(), tt.begin(), tt.end());
+
+			if(not more) starts.push_back(buf.size() - w);
+
+			//each phrase ends with the w characters of the next trigger
+			insert_phrases(buf, starts);
+
+			//the last trigger starts the open phrase. At the end of T, it is the final $^w and its phrase is closed
+			buf.erase(buf.begin(), buf.begin() + starts.back());
+
+		}
+
+		if(n == 0){
+
+			throw make_error("the FASTA file ", path, " contains no sequence");
+
+		}
+
+	}
+
+	/*
+	 * insert in the dictionary the phrases buf[starts[i]..starts[i+1]+w), and append them to the parse. Phrases are
+	 * split in shards by fingerprint: thread t inserts the phrases of shard t, so that no locking is needed. Their
+	 * identifier in the parse is (local identifier in the shard) * threads + shard.
+	 */
+	void insert_phrases(const vector<char> & buf, const vector<uint64_t> & starts){
+
+		uint64_t m = starts.size() - 1;
+		uint64_t old_size = tmp_parse.size();
+
+		tmp_parse.resize(old_size + m);
+
+		vector<uint64_t> fp(m);
+
+		parallel_for([&](int t){
+
+			for(uint64_t i = m*t/threads; i < m*(t+1)/threads; ++i)
+				fp[i] = fnv1a(buf.data() + starts[i], starts[i+1] + w - starts[i]);
+
+		});
+
+		parallel_for([&](int t){
+
+			shard_t & shard = shards[t];
+
+			for(uint64_t i = 0; i < m; ++i){
+
+				if(fp[i] % threads != uint64_t(t)) continue;
+
+				const char* phrase = buf.data() + starts[i];
+				uint64_t len = starts[i+1] + w - starts[i];
+
+				auto it = shard.id.find(fp[i]);
+
+				uint64_t local;
+
+				if(it == shard.id.end()){
+
+					local = shard.phrases.size();
+					shard.id[fp[i]] = uint32_t(local);
+					shard.phrases.push_back(string(phrase, len));
+
+				}else{
+
+					local = it->second;
+
+					if(shard.phrases[local].size() != len or not std::equal(phrase, phrase + len, shard.phrases[local].begin())){
+
+						throw make_error("fingerprint collision between two phrases of the prefix-free parsing");
+
+					}
+
+				}
+
+				tmp_parse[old_size + i] = local * threads + t;
+
+			}
+
+		});
+
+	}
+
+	/*
+	 * text of the dictionary (phrases separated by PFP_EOW, then 0), its suffix array, the LCP array and the
+	 * lexicographic rank of each phrase. Phrase identifiers become dense: shard by shard, in local order.
+	 */
+	void sort_dictionary(){
+
+		vector<uint64_t> shard_offset(threads + 1, 0);
+
+		for(int t = 0; t < threads; ++t) shard_offset[t+1] = shard_offset[t] + shards[t].phrases.size();
+
+		d = shard_offset[threads];
+
+		//phrase identifiers in the parse: from local to dense
+		parallel_for([&](int t){
+
+			for(uint64_t i = tmp_parse.size()*t/threads; i < tmp_parse.size()*(t+1)/threads; ++i)
+				tmp_parse[i] = shard_offset[tmp_parse[i] % threads] + tmp_parse[i] / threads;
+
+		});
+
+		for(auto & shard : shards){
+
+			for(auto & phrase : shard.phrases){
+
+				phrase_start.push_back(dict.size());
+				dict.insert(dict.end(), phrase.begin(), phrase.end());
+				dict.push_back(PFP_EOW);
+
+			}
+
+			shard = shard_t();
+
+		}
+
+		phrase_start.push_back(dict.size());
+		dict.push_back(0);
+
+		dict_phrase = vector<uint32_t>(dict.size());
+
+		for(uint64_t g = 0; g < d; ++g)
+			std::fill(dict_phrase.begin() + phrase_start[g], dict_phrase.begin() + phrase_start[g+1], uint32_t(g));
+
+		if(dict.size() >= uint64_t(uint32_t(-1)) or tmp_parse.size() + 1 >= uint64_t(uint32_t(-1))){
+
+			throw make_error("the prefix-free parsing has too many phrases (", tmp_parse.size(), ", total length ", dict.size(), ")");
+
+		}
+
+		dict_SA = vector<uint32_t>(dict.size());
+		sais((const uint8_t*)dict.data(), dict_SA.data(), uint32_t(dict.size()), uint32_t(256));
+
+		dict_LCP = lcp_array((const uint8_t*)dict.data(), dict_SA.data(), uint32_t(dict.size()));
+
+		//phrases in lexicographic order: no phrase is a prefix of another one
+		rank = vector<uint32_t>(d);
+		uint32_t r = 0;
+
+		for(uint64_t i = 0; i < dict.size(); ++i){
+
+			uint32_t pos = dict_SA[i];
+
+			if(dict[pos] != 0 and (pos == 0 or dict[pos-1] == PFP_EOW)) rank[phrase_of(pos)] = ++r;
+
+		}
+
+	}
+
+	/*
+	 * suffix array of the parse (phrases replaced by their rank), then, for each phrase, the sorted positions in it
+	 * of the suffixes following its occurrences and the character preceding each occurrence
+	 */
+	void sort_parse(){
+
+		p_len = tmp_parse.size();
+
+		vector<uint32_t> P(p_len + 1);
+
+		for(uint64_t i = 0; i < p_len; ++i) P[i] = rank[tmp_parse[i]];
+		P[p_len] = 0;
+
+		tmp_parse = vector<uint64_t>();
+
+		vector<uint32_t> SA(p_len + 1);
+		sais(P.data(), SA.data(), uint32_t(p_len + 1), uint32_t(d + 1));
+
+		//occurrence lists, indexed by rank
+		occ_start = vector<uint64_t>(d + 2, 0);
+
+		for(uint64_t i = 0; i < p_len; ++i) occ_start[P[i] + 1]++;
+		for(uint64_t j = 1; j <= d + 1; ++j) occ_start[j] += occ_start[j-1];
+
+		vector<uint64_t> fill(occ_start.begin(), occ_start.end());
+
+		occ = vector<uint32_t>(p_len);
+		occ_prev = vector<char>(p_len);
+
+		for(uint64_t r = 0; r <= p_len; ++r){
+
+			if(SA[r] == 0) continue;
+
+			uint64_t q = SA[r] - 1; //occurrence of phrase P[q], followed by the suffix of rank r
+			uint64_t slot = fill[P[q]]++;
+
+			occ[slot] = uint32_t(r);
+
+			//character preceding the occurrence (the first phrase starts with $^w and its offset 0 is not used)
+			if(q > 0){
+
+				uint64_t prev = by_rank(P[q-1]);
+				occ_prev[slot] = dict[phrase_start[prev+1] - 1 - w - 1];
+
+			}
+
+		}
+
+		//the smallest suffix, $^w at the end of T, is preceded by the last character of S
+		run_char = last_char;
+		run_len = 1;
+
+	}
+
+	//phrase containing position pos of the dictionary text
+	uint64_t phrase_of(uint64_t pos){
+
+		return dict_phrase[pos];
+
+	}
+
+	//phrase of the given rank
+	uint64_t by_rank(uint32_t r){
+
+		if(rank_to_phrase.size() == 0){
+
+			rank_to_phrase = vector<uint32_t>(d + 1);
+			for(uint64_t g = 0; g < d; ++g) rank_to_phrase[rank[g]] = uint32_t(g);
+
+		}
+
+		return rank_to_phrase[r];
+
+	}
+
+	char bwt_char(char c){
+		return c == PFP_DOLLAR or c == PFP_SEP ? TERM : c;
+	}
+
+	/*
+	 * the suffix of the dictionary at position i of its suffix array is used iff it is a suffix D[k..] of a phrase D with
+	 * |D[k..]| > w that does not start with $. Returns its length, or 0 if not used
+	 */
+	uint64_t used_suffix(uint64_t i, uint64_t & g){
+
+		uint32_t pos = dict_SA[i];
+
+		if(dict[pos] == 0 or dict[pos] == PFP_EOW or dict[pos] == PFP_DOLLAR) return 0;
+
+		g = phrase_of(pos);
+
+		uint64_t len = phrase_start[g+1] - 1 - pos;
+
+		return len > w ? len : 0;
+
+	}
+
+	/*
+	 * BWT characters of the next group of equal phrase suffixes, in run_char/run_len or in merged.
+	 * Returns false if there are no more groups
+	 */
+	bool next_group(){
+
+		uint64_t g = 0;
+		uint64_t len = 0;
+
+		while(sa_pos < dict_SA.size() and (len = used_suffix(sa_pos, g)) == 0) sa_pos++;
+
+		if(sa_pos == dict_SA.size()) return false;
+
+		//phrases and offsets of the group
+		group.clear();
+		group.push_back({g, dict_SA[sa_pos] - phrase_start[g]});
+
+		uint64_t lcp = uint64_t(-1);
+
+		for(sa_pos++; sa_pos < dict_SA.size(); sa_pos++){
+
+			lcp = std::min(lcp, uint64_t(dict_LCP[sa_pos]));
+
+			uint64_t g2 = 0;
+			uint64_t len2 = used_suffix(sa_pos, g2);
+
+			if(len2 == 0) continue;
+			if(len2 != len or lcp < len) break;
+
+			group.push_back({g2, dict_SA[sa_pos] - phrase_start[g2]});
+
+		}
+
+		//a run, if all the phrases are preceded by the same character inside them
+		bool run = true;
+		uint64_t count = 0;
+
+		for(auto & e : group){
+
+			run = run and e.second > 0 and dict[phrase_start[e.first] + e.second - 1] == dict[phrase_start[group[0].first] + group[0].second - 1];
+			count += occ_start[rank[e.first] + 1] - occ_start[rank[e.first]];
+
+		}
+
+		if(run){
+
+			run_char = bwt_char(dict[phrase_start[group[0].first] + group[0].second - 1]);
+			run_len = count;
+
+			return true;
+
+		}
+
+		//otherwise merge the occurrences of the phrases by the rank of the suffix following them
+		vector<pair<uint32_t, char> > all;
+		all.reserve(count);
+
+		for(auto & e : group){
+
+			uint64_t j = rank[e.first];
+			char c = e.second > 0 ? dict[phrase_start[e.first] + e.second - 1] : 0;
+
+			for(uint64_t s = occ_start[j]; s < occ_start[j+1]; ++s) all.push_back({occ[s], e.second > 0 ? c : occ_prev[s]});
+
+		}
+
+		std::sort(all.begin(), all.end());
+
+		merged.resize(all.size());
+		for(uint64_t i = 0; i < all.size(); ++i) merged[i] = bwt_char(all[i].second);
+
+		merged_pos = 0;
+
+		return true;
+
+	}
+
+	char TERM = '#';
+	int threads = 1;
+
+	uint64_t n = 0; //length of S
+	bool has_N = false;
+	char last_char = 0;
+
+	//FASTA reader state
+	bool header = false;
+	bool line_start = true;
+	bool has_sequence = false; //a DNA character has been read
+	bool sep_pending = false; //a new sequence starts: a separator precedes its first character
+	uint64_t separators = 0;
+
+	uint64_t top = 1; //KR_BASE^(w-1)
+
+	//parsing
+	vector<shard_t> shards;
+	vector<uint64_t> tmp_parse;
+
+	uint64_t d = 0; //phrases in the dictionary
+	uint64_t p_len = 0; //phrases in the parse
+
+	vector<char> dict; //text of the dictionary
+	vector<uint64_t> phrase_start; //start of each phrase in dict, then dict.size()-1
+	vector<uint32_t> dict_SA;
+	vector<uint32_t> dict_LCP;
+	vector<uint32_t> dict_phrase; //phrase of each position of dict
+	vector<uint32_t> rank; //lexicographic rank (from 1) of each phrase
+	vector<uint32_t> rank_to_phrase;
+
+	//occurrences of the phrase of rank j: occ[occ_start[j]..occ_start[j+1]), positions in the suffix array of the parse
+	//of the suffixes following them, sorted. occ_prev = character preceding each occurrence
+	vector<uint64_t> occ_start;
+	vector<uint32_t> occ;
+	vector<char> occ_prev;
+
+	//output
+	uint64_t sa_pos = 0; //next position of dict_SA
+	vector<pair<uint64_t, uint64_t> > group; //(phrase, offset)
+	char run_char = 0;
+	uint64_t run_len = 0;
+	vector<char> merged;
+	uint64_t merged_pos = 0;
+	uint64_t emitted = 0;
+
+};
+
+#endif /* INTERNAL_PFP_HPP_ */
@@ -0,0 +1,146 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * progress_reporter.hpp
+ *
+ *  Background thread printing the progress of a long computation at fixed time intervals.
+ *
+ *  The workers never print nor synchronize: they only update their own counters with relaxed atomic
+ *  stores, which the reporter samples (through the function passed to the constructor) once per
+ *  interval. Progress is measured as a "mass" that grows to a known total; the ETA assumes that the
+ *  remaining mass will be consumed at the average rate observed so far.
+ *
+ */
+
+#ifndef INTERNAL_PROGRESS_REPORTER_HPP_
+#define INTERNAL_PROGRESS_REPORTER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+class progress_reporter{
+
+public:
+
+	struct sample{
+
+		uint64_t nodes = 0;	//visited nodes
+		uint64_t lf = 0;	//LF calls (rank queries on the BWT)
+		uint64_t mass = 0;	//consumed mass, at most the total mass
+		uint64_t depth = 0;	//current recursion depth (maximum over the workers)
+
+	};
+
+	/*
+	 * start reporting every 'interval' seconds. total_mass > 0
+	 */
+	progress_reporter(std::function<sample()> sampler, uint64_t total_mass, double interval) :
+		sampler(sampler), total_mass(total_mass), interval(interval){
+
+		reporter = std::thread([this](){ loop(); });
+
+	}
+
+	~progress_reporter(){
+
+		stop();
+
+	}
+
+	progress_reporter(const progress_reporter&) = delete;
+	progress_reporter& operator=(const progress_reporter&) = delete;
+
+	/*
+	 * stop the reporter thread (it wakes up immediately)
+	 */
+	void stop(){
+
+		{
+			std::lock_guard<std::mutex> lock(m);
+			done = true;
+		}
+
+		cv.notify_one();
+
+		if(reporter.joinable()) reporter.join();
+
+	}
+
+	/*
+	 * resident set size of this process in bytes (0 if /proc is not available)
+	 */
+	static uint64_t resident_memory(){
+
+		FILE* f = fopen("/proc/self/statm", "r");
+		if(f == NULL) return 0;
+
+		unsigned long long size = 0, resident = 0;
+		int read = fscanf(f, "%llu %llu", &size, &resident);
+		fclose(f);
+
+		return read == 2 ? resident * uint64_t(sysconf(_SC_PAGESIZE)) : 0;
+
+	}
+
+private:
+
+	void loop(){
+
+		using clock = std::chrono::steady_clock;
+
+		auto start = clock::now();
+		auto last_time = start;
+		sample last;
+
+		std::unique_lock<std::mutex> lock(m);
+
+		while(not cv.wait_for(lock, std::chrono::duration<double>(interval), [this](){ return done; })){
+
+			auto now = clock::now();
+			sample s = sampler();
+
+			double elapsed = std::chrono::duration<double>(now - start).count();
+			double dt = std::chrono::duration<double>(now - last_time).count();
+			double done_frac = double(s.mass)/double(total_mass);
+
+			std::cout << "[" << uint64_t(elapsed) << " s] " <<
+			double(uint64_t(done_frac*1000))/10 << "% done, ETA ";
+
+			if(done_frac > 0) std::cout << uint64_t(elapsed*(1-done_frac)/done_frac) << " s";
+			else std::cout << "unknown";
+
+			std::cout << " | " << uint64_t(double(s.nodes - last.nodes)/dt) << " nodes/s" <<
+			" | " << uint64_t(double(s.lf - last.lf)/dt) << " LF calls/s" <<
+			" | depth " << s.depth <<
+			" | RSS " << resident_memory()/(uint64_t(1)<<20) << " MB" << std::endl;
+
+			last = s;
+			last_time = now;
+
+		}
+
+	}
+
+	std::function<sample()> sampler;
+	uint64_t total_mass;
+	double interval;
+
+	std::mutex m;
+	std::condition_variable cv;
+	bool done = false;
+
+	std::thread reporter;
+
+};
+
+#endif /* INTERNAL_PROGRESS_REPORTER_HPP_ */
@@ -0,0 +1,670 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * rle_string_n.hpp
+ *
+ *  Run-length encoded string with rank on DNA alphabet: {A,C,G,N,T,TERM}. Same interface as dna_string_n,
+ *  so that it can be used as string type of dna_bwt_n (see dna_bwt_n.hpp).
+ *
+ *  Meant for repetitive BWTs, where the number r of equal-letter runs is much smaller than the length n:
+ *  space is about 3 bytes per run plus 8 bytes every 2^shift characters, where 2^shift ~ n/(number of blocks),
+ *  instead of the 4.38n bits of dna_string_n.
+ *
+ *  Runs are stored in cache-aligned blocks of 128 bytes:
+ *
+ *  | 64-bit position of the first character of the block | 5 x 64-bit rank of A,C,G,N,T before the block |
+ *  | 80 bytes: runs, each encoded with 1-10 bytes |
+ *
+ *  A run (c,len) is encoded as: first byte = 3-bit code of c | 4 low bits of len-1 | continuation bit, then
+ *  7 more bits of len-1 per byte while the continuation bit is set. Runs never cross blocks.
+ *
+ *  Rank and access at position i: the block containing i is found by a binary search between the two samples
+ *  that surround i (sample[j] = block containing position j*2^shift), then the runs of the block are scanned.
+ *
+ *  The structure can be serialized and then either loaded (copy) or memory-mapped (zero-copy), as dna_string_n.
+ *
+ */
+
+#ifndef INTERNAL_RLE_STRING_N_HPP_
+#define INTERNAL_RLE_STRING_N_HPP_
+
+#define RLE_PAYLOAD_N 80		//bytes of runs in a block
+#define ALN_RLE_N 64			//alignment
+
+#include "include.hpp"
+#include "mapped_file.hpp"
+#include <memory>
+#include <cstring>
+
+class rle_string_n{
+
+public:
+
+	typedef dna_n_alphabet alphabet;
+
+	//written in index files (see dna_bwt::save_to_file)
+	static uint64_t type_id(){
+		return 1;
+	}
+
+	rle_string_n(){}
+
+	/*
+	 * Blocks and samples point into buffers owned by the string (or into its mapping): a copy would point into the buffers of
+	 * the original. Moves keep the buffers where they are, so the pointers stay valid in the target (the moved-from
+	 * string is not to be used)
+	 */
+	rle_string_n(const rle_string_n&) = delete;
+	rle_string_n& operator=(const rle_string_n&) = delete;
+
+	rle_string_n(rle_string_n&&) = default;
+	rle_string_n& operator=(rle_string_n&&) = default;
+
+	/*
+	 * constructor from ASCII file. The file is read sequentially and each run is encoded as soon as it ends;
+	 * the construction is I/O bound and serial: the thread count is accepted for interface compatibility with the
+	 * other strings, but ignored (-p does not speed up the construction of -b rle).
+	 */
+	rle_string_n(string path, char TERM = '#', int /*threads*/ = 1){
+
+		this->TERM = TERM;
+
+		n = input_file_size(path);
+
+		ifstream ifs(path, ios::binary);
+
+		vector<rle_block> building;
+		uint64_t used = RLE_PAYLOAD_N; //bytes used in the last block (full: the first run opens a block)
+
+		uint64_t counts[6] = {};
+
+		uint8_t run_code = 0;
+		uint64_t run_len = 0;
+		uint64_t pos = 0; //position of the first character of the current run
+
+		//encode the run (run_code, run_len), which starts at position pos
+		auto append_run = [&](){
+
+			uint8_t bytes[10];
+			int nb = encode_run(run_code, run_len, bytes);
+
+			if(used + nb > RLE_PAYLOAD_N){
+
+				building.push_back(rle_block());
+				rle_block & b = building.back();
+
+				b.start = pos;
+				for(int c=0;c<5;++c) b.rank[c] = counts[c];
+
+				used = 0;
+
+			}
+
+			std::copy(bytes, bytes+nb, building.back().runs + used);
+			used += nb;
+
+			counts[run_code] += run_len;
+			breaks += pos > 0;
+
+		};
+
+		const uint64_t BUF_SIZE = 1<<20;
+		vector<char> buf(BUF_SIZE);
+
+		for(uint64_t from = 0; from < n; from += BUF_SIZE){
+
+			uint64_t len = std::min(BUF_SIZE, n - from);
+			ifs.read(buf.data(), len);
+
+			if(not ifs) throw make_error("cannot read file ", path);
+
+			for(uint64_t j=0;j<len;++j){
+
+				int code = char_code(buf[j]);
+
+				if(code < 0){
+
+					throw make_error("read forbidden character '", buf[j], "' (ASCII code ", int(buf[j]), ") while reading the BWT. ",
+					"Only A,C,G,N,T, and ", TERM, " are admitted in the input BWT!\n",
+					"Possible solution: if the unknown character is the terminator, you can solve the problem by adding option \"-t ", int(buf[j]), "\".");
+
+				}
+
+				if(run_len > 0 and code == run_code){
+
+					run_len++;
+
+				}else{
+
+					if(run_len > 0) append_run();
+
+					pos = from + j;
+					run_code = code;
+					run_len = 1;
+
+				}
+
+			}
+
+		}
+
+		if(run_len > 0) append_run();
+
+		for(int c=0;c<5;++c) totals[c] = counts[c];
+
+		n_blocks = building.size();
+
+		block_memory = std::unique_ptr<uint8_t[]>(new uint8_t[n_blocks*sizeof(rle_block)+ALN_RLE_N]);
+		uint8_t* aligned = block_memory.get();
+		while(uint64_t(aligned) % ALN_RLE_N != 0) aligned++;
+
+		blocks = (rle_block*)aligned;
+		if(n_blocks > 0) memcpy(blocks, building.data(), n_blocks*sizeof(rle_block));
+
+		build_samples();
+
+		assert(check_content(path));
+
+	}
+
+	/*
+	 * access
+	 */
+	char operator[](uint64_t i){
+
+		assert(i < n);
+
+		run_scanner s(blocks[find_block(i)]);
+		s.advance(i);
+
+		return code_char(s.code);
+
+	}
+
+	/*
+	 * Parallel rank of (A,C,G,N,T) at position i.
+	 */
+	p_rank_n parallel_rank(uint64_t i){
+
+		assert(i <= n);
+
+		if(i == n) return totals_rank();
+
+		run_scanner s(blocks[find_block(i)]);
+
+		return s.rank(i);
+
+	}
+
+	/*
+	 * Parallel rank of (A,C,G,N,T) at the k positions pos[0] <= pos[1] <= ... <= pos[k-1]: out[i] = parallel_rank(pos[i]).
+	 * Consecutive positions falling in the same block are answered by a single scan of the block.
+	 */
+	void parallel_rank_multi(const uint64_t* pos, int k, p_rank_n* out){
+
+		int i = 0;
+
+		while(i<k){
+
+			assert(i == 0 or pos[i] >= pos[i-1]);
+
+			if(pos[i] == n){
+
+				out[i++] = totals_rank();
+				continue;
+
+			}
+
+			uint64_t b = find_block(pos[i]);
+			uint64_t end = b+1 < n_blocks ? blocks[b+1].start : n;
+
+			run_scanner s(blocks[b]);
+
+			while(i<k and pos[i] < end){
+
+				out[i] = s.rank(pos[i]);
+				i++;
+
+			}
+
+		}
+
+	}
+
+	/*
+	 * software prefetch of the sample and of the block containing position i (the block is found through
+	 * the sample, so this is useful only if the sample is already cached, e.g. for close positions)
+	 */
+	inline void prefetch(uint64_t i){
+
+		if(i >= n) return;
+
+		uint8_t* b = (uint8_t*)(blocks + samples[i >> shift]);
+
+		__builtin_prefetch(b);
+		__builtin_prefetch(b + 64);
+
+	}
+
+	/*
+	 * prefetch for the positions pos[0] <= ... <= pos[k-1]
+	 */
+	inline void prefetch_multi(const uint64_t* pos, int k){
+
+		for(int i=0;i<k;++i)
+			if(i == 0 or (pos[i] >> shift) != (pos[i-1] >> shift)) prefetch(pos[i]);
+
+	}
+
+	/*
+	 * standard rank. c can be A,C,G,T, or TERM
+	 */
+	uint64_t rank(uint64_t i, uint8_t c){
+
+		p_rank_n pr = parallel_rank(i);
+
+		if(c==TERM) return i - pr.sum();
+
+		int code = char_code(c);
+
+		return code >= 0 and code < alphabet::sigma ? pr[code] : 0;
+
+	}
+
+	uint64_t serialize(std::ostream& out){
+
+		uint64_t w_bytes = 0;
+
+		uint64_t term = uint8_t(TERM);
+
+		out.write((char*)&n,sizeof(n));
+		out.write((char*)&n_blocks,sizeof(n_blocks));
+		out.write((char*)&shift,sizeof(shift));
+		out.write((char*)&n_samples,sizeof(n_samples));
+		out.write((char*)&term,sizeof(term));
+		out.write((char*)totals,sizeof(totals));
+
+		w_bytes += 5*sizeof(uint64_t) + sizeof(totals);
+
+		//blocks and samples start at 64-byte file offsets, so that they can be memory-mapped
+		w_bytes += write_padding(out);
+
+		out.write((char*)blocks,n_blocks*sizeof(rle_block));
+		w_bytes += n_blocks*sizeof(rle_block);
+
+		w_bytes += write_padding(out);
+
+		out.write((char*)samples,n_samples*sizeof(uint64_t));
+		w_bytes += n_samples*sizeof(uint64_t);
+
+		return w_bytes;
+
+	}
+
+	void load(std::istream& in) {
+
+		uint64_t term = 0;
+
+		in.read((char*)&n,sizeof(n));
+		in.read((char*)&n_blocks,sizeof(n_blocks));
+		in.read((char*)&shift,sizeof(shift));
+		in.read((char*)&n_samples,sizeof(n_samples));
+		in.read((char*)&term,sizeof(term));
+		in.read((char*)totals,sizeof(totals));
+
+		TERM = char(term);
+
+		skip_padding(in);
+
+		block_memory = std::unique_ptr<uint8_t[]>(new uint8_t[n_blocks*sizeof(rle_block)+ALN_RLE_N]);
+		uint8_t* aligned = block_memory.get();
+		while(uint64_t(aligned) % ALN_RLE_N != 0) aligned++;
+
+		blocks = (rle_block*)aligned;
+		in.read((char*)blocks,n_blocks*sizeof(rle_block));
+
+		skip_padding(in);
+
+		sample_memory = vector<uint64_t>(n_samples);
+		samples = sample_memory.data();
+		in.read((char*)samples,n_samples*sizeof(uint64_t));
+
+	}
+
+	/*
+	 * zero-copy load from a memory-mapped file containing the serialization of the string at the given
+	 * offset. Blocks and samples point straight into the mapped region. Returns the offset following the structure.
+	 */
+	uint64_t load(std::shared_ptr<mapped_file> file, uint64_t offset){
+
+		uint8_t* base = file->data();
+		uint64_t* header = (uint64_t*)(base + offset);
+
+		n = header[0];
+		n_blocks = header[1];
+		shift = header[2];
+		n_samples = header[3];
+		TERM = char(header[4]);
+		for(int c=0;c<5;++c) totals[c] = header[5+c];
+
+		offset = padded(offset + 10*sizeof(uint64_t));
+
+		block_memory.reset();
+		sample_memory = vector<uint64_t>();
+
+		blocks = (rle_block*)(base + offset);
+		offset = padded(offset + n_blocks*sizeof(rle_block));
+
+		samples = (uint64_t*)(base + offset);
+		offset += n_samples*sizeof(uint64_t);
+
+		if(offset > file->size()){
+
+			throw make_error("truncated index file");
+
+		}
+
+		mapping = file;
+
+		return offset;
+
+	}
+
+	uint64_t size(){
+		return n;
+	}
+
+	/*
+	 * number of positions i > 0 such that S[i] != S[i-1] (runs - 1), counted while encoding the runs. Only for a
+	 * string built by this process: it is not serialized (index files store r in their header, see dna_bwt)
+	 */
+	uint64_t run_breaks(){
+		return breaks;
+	}
+
+	//bytes used by the structure
+	uint64_t bytes(){
+		return n_blocks*sizeof(rle_block) + n_samples*sizeof(uint64_t);
+	}
+
+	/*
+	 * hash of the sizes, of the terminator and of the letter counts. Does not touch blocks nor samples.
+	 */
+	uint64_t checksum(){
+
+		uint64_t term = uint8_t(TERM);
+
+		uint64_t h = fnv1a(&n, sizeof(n));
+		h = fnv1a(&n_blocks, sizeof(n_blocks), h);
+		h = fnv1a(&shift, sizeof(shift), h);
+		h = fnv1a(&n_samples, sizeof(n_samples), h);
+		h = fnv1a(&term, sizeof(term), h);
+
+		return fnv1a(totals, sizeof(totals), h);
+
+	}
+
+private:
+
+	struct rle_block{
+
+		uint64_t start = 0;		//position of the first character of the block
+		uint64_t rank[5] = {};	//number of A,C,G,N,T before the block
+		uint8_t runs[RLE_PAYLOAD_N] = {};
+
+	};
+
+	/*
+	 * decodes the runs of a block one after the other, keeping the rank before the current run
+	 */
+	struct run_scanner{
+
+		const uint8_t* p;
+		uint64_t pos;			//position of the first character of the current run
+		uint64_t len = 0;		//length of the current run
+		uint8_t code = 0;		//code of the character of the current run
+		uint64_t counts[6];		//rank of the codes before the current run (code 5 = TERM, not used)
+
+		run_scanner(rle_block & b) : p(b.runs), pos(b.start){
+
+			for(int c=0;c<5;++c) counts[c] = b.rank[c];
+			counts[5] = 0;
+
+			next();
+
+		}
+
+		inline void next(){
+
+			uint8_t x = *p++;
+
+			code = x & 7;
+			len = (x >> 3) & 15;
+
+			int s = 4;
+
+			while(x & 128){
+
+				x = *p++;
+				len |= uint64_t(x & 127) << s;
+				s += 7;
+
+			}
+
+			len++;
+
+		}
+
+		//move to the run containing position i >= pos (i must be inside the block)
+		inline void advance(uint64_t i){
+
+			while(pos + len <= i){
+
+				counts[code] += len;
+				pos += len;
+				next();
+
+			}
+
+		}
+
+		inline p_rank_n rank(uint64_t i){
+
+			advance(i);
+
+			p_rank_n r = {counts[0], counts[1], counts[2], counts[3], counts[4]};
+
+			//the code of a letter is its index in the alphabet (TERM, code sigma, is not counted)
+			if(code < alphabet::sigma) r[code] += i - pos;
+
+			return r;
+
+		}
+
+	};
+
+	//codes: A=0, C=1, G=2, N=3, T=4 (the letter indices of dna_n_alphabet), TERM=5; -1 = forbidden character
+	inline int char_code(char c){
+
+		switch(c){
+			case 'A' : return 0;
+			case 'C' : return 1;
+			case 'G' : return 2;
+			case 'N' : return 3;
+			case 'T' : return 4;
+		}
+
+		return c == TERM ? 5 : -1;
+
+	}
+
+	inline char code_char(uint8_t code){
+
+		const char chars[5] = {'A','C','G','N','T'};
+		return code < 5 ? chars[code] : TERM;
+
+	}
+
+	//encode run (code,len) in bytes. Returns the number of bytes used (at most 10)
+	static int encode_run(uint8_t code, uint64_t len, uint8_t* bytes){
+
+		uint64_t l = len-1;
+		int nb = 0;
+
+		uint8_t x = code | ((l & 15) << 3);
+		l >>= 4;
+
+		while(l > 0){
+
+			bytes[nb++] = x | 128;
+			x = l & 127;
+			l >>= 7;
+
+		}
+
+		bytes[nb++] = x;
+
+		return nb;
+
+	}
+
+	p_rank_n totals_rank(){
+		return {totals[0], totals[1], totals[2], totals[3], totals[4]};
+	}
+
+	/*
+	 * samples[j] = block containing position j*2^shift, where 2^shift is the largest power of two not
+	 * exceeding the average number of characters per block (at least one sample per block on average)
+	 */
+	void build_samples(){
+
+		shift = 0;
+		while(n_blocks > 0 and (n >> (shift+1)) >= n_blocks) shift++;
+
+		n_samples = (n >> shift) + 1;
+
+		sample_memory = vector<uint64_t>(n_samples);
+		samples = sample_memory.data();
+
+		uint64_t b = 0;
+
+		for(uint64_t j=0;j<n_samples;++j){
+
+			uint64_t p = j << shift;
+			while(b+1 < n_blocks and blocks[b+1].start <= p) b++;
+
+			samples[j] = b;
+
+		}
+
+	}
+
+	//block containing position i < n: binary search between the samples surrounding i
+	inline uint64_t find_block(uint64_t i){
+
+		uint64_t j = i >> shift;
+
+		uint64_t lo = samples[j];
+		uint64_t hi = j+1 < n_samples ? samples[j+1] : n_blocks-1; //block containing i is in [lo,hi]
+
+		while(lo < hi){
+
+			uint64_t mid = (lo + hi + 1)/2;
+
+			if(blocks[mid].start <= i) lo = mid;
+			else hi = mid-1;
+
+		}
+
+		return lo;
+
+	}
+
+	//round offset up to the next multiple of ALN_RLE_N
+	static uint64_t padded(uint64_t offset){
+		return ((offset + ALN_RLE_N - 1)/ALN_RLE_N)*ALN_RLE_N;
+	}
+
+	//pad the stream with zeros up to the next 64-byte offset. Returns the number of written bytes
+	static uint64_t write_padding(std::ostream& out){
+
+		uint64_t pos = uint64_t(out.tellp());
+		uint64_t pad = padded(pos) - pos;
+
+		char zeros[ALN_RLE_N] = {};
+		out.write(zeros, pad);
+
+		return pad;
+
+	}
+
+	static void skip_padding(std::istream& in){
+
+		uint64_t pos = uint64_t(in.tellg());
+		in.seekg(padded(pos));
+
+	}
+
+	/*
+	 * check that the string contains exactly the same characters as the file in path, and that
+	 * the rank at the end of the string is correct
+	 */
+	bool check_content(string path){
+
+		ifstream ifs(path);
+
+		bool res = true;
+		p_rank_n p = {};
+
+		for(uint64_t i=0;i<n;++i){
+
+			char c;
+			ifs.read((char*)&c, sizeof(char));
+
+			if(operator[](i) != c) res = false;
+			if(parallel_rank(i) != p) res = false;
+
+			int code = char_code(c);
+			if(code >= 0 and code < alphabet::sigma) p[code]++;
+
+		}
+
+		if(parallel_rank(n) != p) res = false;
+
+		if(res){
+
+			cout << "string content is valid" << endl;
+
+		}else{
+
+			cout << "string content is not valid" << endl;
+
+		}
+
+		return res;
+
+	}
+
+	char TERM = '#';
+
+	uint64_t n = 0;
+	uint64_t n_blocks = 0;
+	uint64_t breaks = 0;	//see run_breaks()
+	uint64_t shift = 0;
+	uint64_t n_samples = 0;
+	uint64_t totals[5] = {}; //number of A,C,G,N,T in the string
+
+	std::unique_ptr<uint8_t[]> block_memory;
+	rle_block* blocks = NULL;
+
+	vector<uint64_t> sample_memory;
+	uint64_t* samples = NULL;
+
+	//if memory-mapped, blocks and samples point into this file
+	std::shared_ptr<mapped_file> mapping;
+
+};
+
+#endif /* INTERNAL_RLE_STRING_N_HPP_ */
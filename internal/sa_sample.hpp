@@ -0,0 +1,290 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * sa_sample.hpp
+ *
+ *  Regular sample of the suffix array of a BWT index (any of the BWT classes: dna_bwt, byte_bwt), with locate: the
+ *  text position of the suffix at a given BWT position. Built from the BWT alone, with one backward walk of LF over
+ *  the text: neither the text nor the suffix array are ever stored.
+ *
+ *  LF maps the BWT position of the suffix starting at i to the one of the suffix starting at i-1; on a terminator,
+ *  LF maps its k-th occurrence in the BWT to the k-th suffix starting with a terminator. For a BWT with one
+ *  terminator this permutation is a single cycle, the text. For a string collection it may have several cycles,
+ *  each made of one or more strings: text positions are then offsets in the concatenation of the cycles, in the
+ *  order in which they are found from the suffixes starting with a terminator (for a single text, the usual ones).
+ *
+ *  The suffixes starting at a multiple of the rate and at the first position of each cycle are sampled: a bitvector
+ *  with rank marks their BWT positions, and their text positions are stored in BWT order. Locating a position takes
+ *  less than rate LF steps. Space: n bits (plus 1/8 for the ranks) and 64 bits per sample.
+ *
+ *  locate(positions) processes a batch of queries in rounds of one LF step each. At each round the pending queries
+ *  are sorted by BWT position, so that the BWT blocks are accessed in increasing order and queries falling in the
+ *  same block share its cache misses.
+ *
+ */
+
+#ifndef INTERNAL_SA_SAMPLE_HPP_
+#define INTERNAL_SA_SAMPLE_HPP_
+
+#include "include.hpp"
+#include <thread>
+
+template<class bwt_t>
+class sa_sample{
+
+public:
+
+	sa_sample(){}
+
+	/*
+	 * sample one suffix every 'rate' text positions of the BWT indexed by bwt (which must outlive the sample)
+	 */
+	sa_sample(bwt_t & bwt, uint64_t rate) : bwt(&bwt), rate(rate){
+
+		assert(rate > 0);
+
+		n = bwt.size();
+		TERM = bwt.terminator();
+
+		build_F();
+
+		//(BWT position, text position) of the samples
+		vector<pair<uint64_t, uint64_t> > samples;
+
+		//the suffixes starting with a terminator are the first d of the BWT; every cycle of LF goes through them
+		uint64_t d = bwt.rank(n, uint8_t(TERM));
+		vector<bool> visited(d, false);
+
+		if(d == 0){
+
+			throw make_error("the BWT contains no terminator: its suffix array cannot be sampled");
+
+		}
+
+		uint64_t offset = 0; //first text position of the current cycle
+
+		for(uint64_t t = 0; t < d; ++t){
+
+			if(visited[t]) continue;
+
+			//walk the cycle from t: the suffix at t is the terminator at the end of the cycle. k = steps from t
+			uint64_t first = samples.size();
+			uint64_t i = t;
+			uint64_t k = 0;
+
+			do{
+
+				if(i < d) visited[i] = true;
+
+				uint64_t j = LF(i);
+
+				//the suffix at the start of the cycle (its LF goes back to t) is always sampled: locate never crosses cycles
+				if(k % rate == 0 or j == t) samples.push_back({i, k});
+
+				i = j;
+				k++;
+
+			}while(i != t);
+
+			//k = length of the cycle: steps become text positions
+			for(uint64_t s = first; s < samples.size(); ++s) samples[s].second = offset + k - 1 - samples[s].second;
+
+			offset += k;
+
+		}
+
+		assert(offset == n);
+
+		std::sort(samples.begin(), samples.end());
+
+		sampled = vector<uint64_t>((n + 63)/64, 0);
+		text_pos = vector<uint64_t>(samples.size());
+
+		for(uint64_t s = 0; s < samples.size(); ++s){
+
+			sampled[samples[s].first/64] |= uint64_t(1) << (samples[s].first%64);
+			text_pos[s] = samples[s].second;
+
+		}
+
+		block_rank = vector<uint64_t>(sampled.size()/8 + 1, 0);
+
+		uint64_t ones = 0;
+
+		for(uint64_t w = 0; w < sampled.size(); ++w){
+
+			if(w % 8 == 0) block_rank[w/8] = ones;
+			ones += __builtin_popcountll(sampled[w]);
+
+		}
+
+	}
+
+	/*
+	 * text position of the suffix at BWT position i
+	 */
+	uint64_t locate(uint64_t i){
+
+		uint64_t steps = 0;
+
+		while(not is_sampled(i)){
+
+			i = LF(i);
+			steps++;
+
+		}
+
+		return text_pos[rank_sampled(i)] + steps;
+
+	}
+
+	/*
+	 * text positions of the suffixes at the given BWT positions (in the same order), with the given number of
+	 * threads. Queries are advanced in rounds of one LF step, sorted by BWT position at each round
+	 */
+	vector<uint64_t> locate(const vector<uint64_t> & positions, int threads = 1){
+
+		vector<uint64_t> result(positions.size());
+
+		//query: current BWT position, LF steps done, index in positions
+		struct query_t{
+
+			uint64_t i;
+			uint64_t steps;
+			uint64_t idx;
+
+		};
+
+		vector<query_t> queries(positions.size());
+
+		for(uint64_t q = 0; q < positions.size(); ++q) queries[q] = {positions[q], 0, q};
+
+		//each thread takes a slice of the queries sorted by BWT position
+		std::sort(queries.begin(), queries.end(), [](const query_t & a, const query_t & b){ return a.i < b.i; });
+
+		auto worker = [&](int t){
+
+			uint64_t from = queries.size()*t/threads;
+			uint64_t to = queries.size()*(t+1)/threads;
+
+			while(from < to){
+
+				//resolve the queries on a sample, advance the others by one LF step (compacted at the start of the slice)
+				uint64_t pending = from;
+
+				for(uint64_t q = from; q < to; ++q){
+
+					query_t x = queries[q];
+
+					if(is_sampled(x.i)){
+
+						result[x.idx] = text_pos[rank_sampled(x.i)] + x.steps;
+
+					}else{
+
+						x.i = LF(x.i);
+						x.steps++;
+						queries[pending++] = x;
+
+					}
+
+				}
+
+				to = pending;
+
+				std::sort(queries.begin() + from, queries.begin() + to, [](const query_t & a, const query_t & b){ return a.i < b.i; });
+
+			}
+
+		};
+
+		run_threads(threads, worker);
+
+		return result;
+
+	}
+
+	uint64_t sampling_rate(){
+		return rate;
+	}
+
+	//number of sampled suffixes
+	uint64_t samples(){
+		return text_pos.size();
+	}
+
+	//bytes used by the sample
+	uint64_t bytes(){
+		return (sampled.size() + block_rank.size() + text_pos.size())*sizeof(uint64_t);
+	}
+
+private:
+
+	//LF of BWT position i
+	inline uint64_t LF(uint64_t i){
+
+		uint8_t c = uint8_t((*bwt)[i]);
+
+		return F[c] + bwt->rank(i, c);
+
+	}
+
+	inline bool is_sampled(uint64_t i){
+
+		return (sampled[i/64] >> (i%64)) & 1;
+
+	}
+
+	//number of samples before BWT position i
+	inline uint64_t rank_sampled(uint64_t i){
+
+		uint64_t r = block_rank[i/512];
+
+		for(uint64_t w = (i/512)*8; w < i/64; ++w) r += __builtin_popcountll(sampled[w]);
+
+		return r + __builtin_popcountll(sampled[i/64] & ((uint64_t(1) << (i%64)) - 1));
+
+	}
+
+	/*
+	 * F[c] = first BWT position of the suffixes starting with byte c: the terminator first, then the other
+	 * bytes in increasing order
+	 */
+	void build_F(){
+
+		F.fill(n);
+
+		uint64_t f = 0;
+
+		F[uint8_t(TERM)] = 0;
+		f += bwt->rank(n, uint8_t(TERM));
+
+		for(int c = 0; c < 256; ++c){
+
+			if(c == uint8_t(TERM)) continue;
+
+			F[c] = f;
+			f += bwt->rank(n, uint8_t(c));
+
+		}
+
+		assert(f == n);
+
+	}
+
+	bwt_t * bwt = NULL;
+	uint64_t rate = 0;
+	uint64_t n = 0;
+	char TERM = '#';
+
+	std::array<uint64_t, 256> F {};
+
+	vector<uint64_t> sampled; //BWT positions of the samples
+	vector<uint64_t> block_rank; //samples before each block of 512 BWT positions
+	vector<uint64_t> text_pos; //text positions of the samples, in BWT order
+
+};
+
+#endif /* INTERNAL_SA_SAMPLE_HPP_ */
@@ -0,0 +1,236 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * sais.hpp
+ *
+ *  Suffix array of a string on an integer alphabet by induced sorting (SA-IS, Nong, Zhang and Chan 2009), and the
+ *  LCP array from it (Kasai et al. 2001). Used by the prefix-free parsing (pfp.hpp) on its dictionary and on its parse.
+ *
+ *  The string s[0..n-1] must end with a unique 0 (the sentinel), and its other characters must be in [1, K).
+ *  index_t is the type of the suffix array entries (uint32_t for strings shorter than 2^32 - 1).
+ *
+ */
+
+#ifndef INTERNAL_SAIS_HPP_
+#define INTERNAL_SAIS_HPP_
+
+#include "include.hpp"
+
+template<class char_t, class index_t>
+class sais_builder{
+
+public:
+
+	/*
+	 * SA[0..n-1] = suffix array of s[0..n-1]
+	 */
+	static void build(const char_t* s, index_t* SA, index_t n, index_t K){
+
+		assert(n > 0 and s[n-1] == 0);
+
+		if(n == 1){
+
+			SA[0] = 0;
+			return;
+
+		}
+
+		//type of each suffix: S (true) or L (false)
+		vector<bool> t(n);
+
+		t[n-1] = true;
+		for(index_t i = n-1; i > 0; --i) t[i-1] = s[i-1] < s[i] or (s[i-1] == s[i] and t[i]);
+
+		auto is_lms = [&](index_t i){ return i > 0 and t[i] and not t[i-1]; };
+
+		vector<index_t> bucket(K);
+
+		//step 1: sort the LMS substrings
+		std::fill(SA, SA+n, EMPTY);
+
+		bucket_ends(s, n, K, bucket);
+		for(index_t i = 1; i < n; ++i) if(is_lms(i)) SA[--bucket[s[i]]] = i;
+
+		induce(s, SA, n, K, t, bucket);
+
+		//compact the sorted LMS substrings in SA[0..n1-1]
+		index_t n1 = 0;
+		for(index_t i = 0; i < n; ++i) if(is_lms(SA[i])) SA[n1++] = SA[i];
+
+		//name the LMS substrings: the name of the one at position i goes to SA[n1 + i/2] (LMS positions are at least 2 apart)
+		std::fill(SA+n1, SA+n, EMPTY);
+
+		index_t name = 0;
+		index_t prev = EMPTY;
+
+		for(index_t i = 0; i < n1; ++i){
+
+			index_t pos = SA[i];
+
+			if(prev == EMPTY or not equal_lms(s, n, t, pos, prev)) name++;
+
+			prev = pos;
+			SA[n1 + pos/2] = name - 1;
+
+		}
+
+		for(index_t i = n, j = n; i > n1; --i) if(SA[i-1] != EMPTY) SA[--j] = SA[i-1];
+
+		//step 2: suffix array SA1 = SA[0..n1-1] of the reduced string s1 = SA[n-n1..n-1]
+		index_t* SA1 = SA;
+		index_t* s1 = SA + n - n1;
+
+		if(name < n1) sais_builder<index_t, index_t>::build(s1, SA1, n1, name);
+		else for(index_t i = 0; i < n1; ++i) SA1[s1[i]] = i;
+
+		//step 3: induce the suffix array of s from the sorted LMS suffixes
+		for(index_t i = 1, j = 0; i < n; ++i) if(is_lms(i)) s1[j++] = i;
+		for(index_t i = 0; i < n1; ++i) SA1[i] = s1[SA1[i]];
+
+		std::fill(SA+n1, SA+n, EMPTY);
+
+		bucket_ends(s, n, K, bucket);
+
+		for(index_t i = n1; i > 0; --i){
+
+			index_t j = SA[i-1];
+			SA[i-1] = EMPTY;
+			SA[--bucket[s[j]]] = j;
+
+		}
+
+		induce(s, SA, n, K, t, bucket);
+
+	}
+
+private:
+
+	static constexpr index_t EMPTY = index_t(-1);
+
+	static void bucket_starts(const char_t* s, index_t n, index_t K, vector<index_t> & bucket){
+
+		std::fill(bucket.begin(), bucket.end(), 0);
+		for(index_t i = 0; i < n; ++i) bucket[s[i]]++;
+
+		index_t sum = 0;
+		for(index_t c = 0; c < K; ++c){
+
+			index_t b = bucket[c];
+			bucket[c] = sum;
+			sum += b;
+
+		}
+
+	}
+
+	static void bucket_ends(const char_t* s, index_t n, index_t K, vector<index_t> & bucket){
+
+		std::fill(bucket.begin(), bucket.end(), 0);
+		for(index_t i = 0; i < n; ++i) bucket[s[i]]++;
+
+		index_t sum = 0;
+		for(index_t c = 0; c < K; ++c){
+
+			sum += bucket[c];
+			bucket[c] = sum;
+
+		}
+
+	}
+
+	//induce the L-type suffixes from the S-type ones in SA, then the S-type suffixes from the L-type ones
+	static void induce(const char_t* s, index_t* SA, index_t n, index_t K, vector<bool> & t, vector<index_t> & bucket){
+
+		bucket_starts(s, n, K, bucket);
+
+		for(index_t i = 0; i < n; ++i){
+
+			index_t j = SA[i];
+			if(j != EMPTY and j > 0 and not t[j-1]) SA[bucket[s[j-1]]++] = j-1;
+
+		}
+
+		bucket_ends(s, n, K, bucket);
+
+		for(index_t i = n; i > 0; --i){
+
+			index_t j = SA[i-1];
+			if(j != EMPTY and j > 0 and t[j-1]) SA[--bucket[s[j-1]]] = j-1;
+
+		}
+
+	}
+
+	//true iff the LMS substrings starting at a and b are equal (same characters and types, up to the next LMS position)
+	static bool equal_lms(const char_t* s, index_t n, vector<bool> & t, index_t a, index_t b){
+
+		if(a == n-1 or b == n-1) return false;
+
+		for(index_t d = 0; ; ++d){
+
+			bool lms_a = d > 0 and t[a+d] and not t[a+d-1];
+			bool lms_b = d > 0 and t[b+d] and not t[b+d-1];
+
+			if(s[a+d] != s[b+d] or t[a+d] != t[b+d]) return false;
+			if(lms_a and lms_b) return true;
+			if(lms_a != lms_b) return false;
+
+		}
+
+	}
+
+};
+
+template<class char_t, class index_t>
+constexpr index_t sais_builder<char_t, index_t>::EMPTY;
+
+/*
+ * suffix array of s[0..n-1], which ends with a unique 0; the other characters are in [1, K)
+ */
+template<class char_t, class index_t>
+void sais(const char_t* s, index_t* SA, index_t n, index_t K){
+
+	sais_builder<char_t, index_t>::build(s, SA, n, K);
+
+}
+
+/*
+ * LCP array of s[0..n-1] given its suffix array: LCP[i] = longest common prefix of the suffixes SA[i-1] and SA[i]
+ * (LCP[0] = 0), through the permuted LCP array
+ */
+template<class char_t, class index_t>
+vector<index_t> lcp_array(const char_t* s, const index_t* SA, index_t n){
+
+	vector<index_t> ISA(n);
+	for(index_t i = 0; i < n; ++i) ISA[SA[i]] = i;
+
+	vector<index_t> PLCP(n);
+	index_t h = 0;
+
+	for(index_t i = 0; i < n; ++i){
+
+		if(ISA[i] == 0){
+
+			PLCP[i] = h = 0;
+			continue;
+
+		}
+
+		index_t j = SA[ISA[i]-1];
+		while(i+h < n and j+h < n and s[i+h] == s[j+h]) h++;
+
+		PLCP[i] = h;
+		if(h > 0) h--;
+
+	}
+
+	//reuse ISA for the LCP array
+	for(index_t i = 0; i < n; ++i) ISA[i] = PLCP[SA[i]];
+
+	return ISA;
+
+}
+
+#endif /* INTERNAL_SAIS_HPP_ */
@@ -0,0 +1,385 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * suffixient_set.hpp
+ *
+ *  The BWT positions of the right-extensions paid by the traversal of the Weiner tree (see rho.cpp), stored on disk
+ *  as an Elias-Fano sparse bitvector. For each paid right-extension c of a node W, the recorded position is the
+ *  first position of the BWT interval of Wc, i.e. a suffix starting with Wc. Positions recorded more than once
+ *  (e.g. for Wc and for a right-maximal Wc followed by its first extension) are stored once.
+ *
+ *  suffixient_writer never holds an n-bit vector: positions are appended to a buffer per thread; a full buffer is
+ *  sorted and written as a run to a temporary file (path + ".runs"). close() merges the runs (with one read buffer
+ *  per run) into the Elias-Fano encoding: the low bits are streamed to the file, only the high bits (about 2 bits
+ *  per position) are kept in memory. The same encoding is used for the set in text coordinates (see sa_sample.hpp),
+ *  whose universe is also n.
+ *
+ *  File layout (64-bit little-endian words): n (universe: positions are < n), m (number of positions), l (low
+ *  bits per position), then the ceil(m*l/64) words of the low bits (position i at bits [i*l, (i+1)*l)), then the
+ *  words of the high bits: m + (n>>l) + 1 bits, where the i-th position (from 0) sets bit (position>>l) + i.
+ *
+ */
+
+#ifndef INTERNAL_SUFFIXIENT_SET_HPP_
+#define INTERNAL_SUFFIXIENT_SET_HPP_
+
+#include "include.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <thread>
+#include <queue>
+#include <cstdio>
+
+#define SUFFIXIENT_RUN 4194304		//positions buffered by a thread before they are sorted and written as a run (32 MB)
+#define SUFFIXIENT_READ 65536		//positions of a run read at once by the merge
+
+/*
+ * Elias-Fano encoding of an increasing sequence of positions in [0, n), written to a file (layout above) as the
+ * positions are added. m_max bounds the number of positions and is used to choose l. Repeated positions are
+ * stored once.
+ */
+class elias_fano_writer{
+
+public:
+
+	elias_fano_writer(string path, uint64_t n, uint64_t m_max) : path(path), n(n), out(path, std::ios::binary | std::ios::trunc){
+
+		if(not out){
+
+			throw make_error("cannot write suffixient set file ", path);
+
+		}
+
+		while(m_max > 0 and (n / m_max) >> (l+1) > 0) l++;
+
+		uint64_t header[3] = {n, 0, l};
+		out.write((char*)header, sizeof(header));
+
+		high = vector<uint64_t>((m_max + (n >> l) + 1 + 63)/64, 0);
+
+	}
+
+	void add(uint64_t pos){
+
+		assert(pos < n and (m == 0 or pos >= last));
+
+		if(m > 0 and pos == last) return;
+
+		last = pos;
+
+		//low bits, streamed
+		uint64_t low = l == 0 ? 0 : pos & ((uint64_t(1) << l) - 1);
+
+		low_word |= low << low_bits;
+		low_bits += l;
+
+		if(low_bits >= 64){
+
+			out.write((char*)&low_word, sizeof(low_word));
+			low_bits -= 64;
+			low_word = low_bits == 0 ? 0 : low >> (l - low_bits);
+
+		}
+
+		uint64_t h = (pos >> l) + m;
+		high[h/64] |= uint64_t(1) << (h%64);
+
+		m++;
+
+	}
+
+	/*
+	 * write the high bits and the number of positions. Returns the number of positions
+	 */
+	uint64_t close(){
+
+		if(low_bits > 0) out.write((char*)&low_word, sizeof(low_word));
+
+		high.resize((m + (n >> l) + 1 + 63)/64);
+		out.write((char*)high.data(), high.size()*sizeof(uint64_t));
+
+		uint64_t header[3] = {n, m, l};
+		out.seekp(0);
+		out.write((char*)header, sizeof(header));
+		out.close();
+
+		if(not out){
+
+			throw make_error("cannot write suffixient set file ", path);
+
+		}
+
+		return m;
+
+	}
+
+private:
+
+	string path;
+	uint64_t n = 0;
+	std::ofstream out;
+
+	uint64_t l = 0;
+	uint64_t m = 0;
+	uint64_t last = 0;
+
+	uint64_t low_word = 0;
+	uint64_t low_bits = 0; //bits in low_word
+	vector<uint64_t> high;
+
+};
+
+class suffixient_writer{
+
+public:
+
+	/*
+	 * positions will be in [0, n)
+	 */
+	suffixient_writer(string path, uint64_t n) : path(path), tmp_path(path + ".runs"), n(n){
+
+		static std::atomic<uint64_t> writers {0};
+		id = ++writers;
+
+		tmp.open(tmp_path, std::ios::binary | std::ios::trunc);
+
+		if(not tmp){
+
+			throw make_error("cannot write temporary file ", tmp_path);
+
+		}
+
+	}
+
+	~suffixient_writer(){
+
+		if(tmp.is_open()){
+
+			tmp.close();
+			std::remove(tmp_path.c_str());
+
+		}
+
+	}
+
+	suffixient_writer(const suffixient_writer&) = delete;
+	suffixient_writer& operator=(const suffixient_writer&) = delete;
+
+	/*
+	 * record BWT position pos. Can be called concurrently by several threads
+	 */
+	inline void add(uint64_t pos){
+
+		assert(pos < n);
+
+		vector<uint64_t> & b = buffer();
+
+		b.push_back(pos);
+
+		if(b.size() == SUFFIXIENT_RUN) spill(b);
+
+	}
+
+	/*
+	 * write the file once all positions have been added (no add() may be running). Returns the number of
+	 * distinct positions
+	 */
+	uint64_t close(){
+
+		for(auto & b : buffers) spill(*b.second);
+
+		buffers.clear();
+		tmp.close();
+
+		if(not tmp){
+
+			throw make_error("cannot write temporary file ", tmp_path);
+
+		}
+
+		uint64_t m = merge();
+
+		std::remove(tmp_path.c_str());
+
+		return m;
+
+	}
+
+private:
+
+	//sorted run of the temporary file: offset (in positions) and length
+	struct run_t{
+
+		uint64_t offset;
+		uint64_t length;
+
+	};
+
+	//buffer of the calling thread, created at its first call. The buffers of a writer are kept by thread id, so that a
+	//thread alternating between writers finds its buffer again; the thread-local cache avoids the lock on each add
+	vector<uint64_t> & buffer(){
+
+		static thread_local uint64_t owner = 0;
+		static thread_local vector<uint64_t> * local = NULL;
+
+		if(owner != id){
+
+			std::lock_guard<std::mutex> lock(mutex);
+
+			auto & b = buffers[std::this_thread::get_id()];
+
+			if(not b){
+
+				b = std::unique_ptr<vector<uint64_t> >(new vector<uint64_t>);
+				b->reserve(SUFFIXIENT_RUN);
+
+			}
+
+			local = b.get();
+			owner = id;
+
+		}
+
+		return *local;
+
+	}
+
+	void spill(vector<uint64_t> & b){
+
+		if(b.size() == 0) return;
+
+		std::sort(b.begin(), b.end());
+		b.erase(std::unique(b.begin(), b.end()), b.end());
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		runs.push_back({written, b.size()});
+		tmp.write((char*)b.data(), b.size()*sizeof(uint64_t));
+		written += b.size();
+		b.clear();
+
+	}
+
+	/*
+	 * k-way merge of the runs into the Elias-Fano file. Returns the number of distinct positions
+	 */
+	uint64_t merge(){
+
+		std::ifstream in(tmp_path, std::ios::binary);
+
+		//written is an upper bound to the number of distinct positions
+		elias_fano_writer out(path, n, written);
+
+		//one read buffer per run
+		vector<vector<uint64_t> > in_buf(runs.size());
+		vector<uint64_t> in_pos(runs.size(), 0);
+		vector<uint64_t> in_read(runs.size(), 0);
+
+		auto fill = [&](uint64_t r){
+
+			uint64_t len = std::min(uint64_t(SUFFIXIENT_READ), runs[r].length - in_read[r]);
+
+			in_buf[r].resize(len);
+			in.seekg((runs[r].offset + in_read[r])*sizeof(uint64_t));
+			in.read((char*)in_buf[r].data(), len*sizeof(uint64_t));
+
+			in_read[r] += len;
+			in_pos[r] = 0;
+
+			return len > 0;
+
+		};
+
+		typedef pair<uint64_t, uint64_t> entry; //(position, run)
+		std::priority_queue<entry, vector<entry>, std::greater<entry> > heap;
+
+		for(uint64_t r = 0; r < runs.size(); ++r) if(fill(r)) heap.push({in_buf[r][0], r});
+
+		while(not heap.empty()){
+
+			uint64_t pos = heap.top().first;
+			uint64_t r = heap.top().second;
+			heap.pop();
+
+			if(++in_pos[r] < in_buf[r].size() or fill(r)) heap.push({in_buf[r][in_pos[r]], r});
+
+			out.add(pos);
+
+		}
+
+		return out.close();
+
+	}
+
+	string path;
+	string tmp_path;
+	uint64_t n = 0;
+	uint64_t id = 0; //distinguishes the thread-local buffers of successive writers
+
+	std::mutex mutex;
+	std::map<std::thread::id, std::unique_ptr<vector<uint64_t> > > buffers;
+	std::ofstream tmp;
+	vector<run_t> runs;
+	uint64_t written = 0; //positions in the temporary file
+
+};
+
+/*
+ * positions of a suffixient set file written by suffixient_writer, in increasing order
+ */
+inline vector<uint64_t> load_suffixient_set(string path){
+
+	std::ifstream in(path, std::ios::binary);
+
+	uint64_t header[3] = {};
+	in.read((char*)header, sizeof(header));
+
+	uint64_t n = header[0], m = header[1], l = header[2];
+
+	if(not in or l >= 64){
+
+		throw make_error(path, " is not a valid suffixient set file");
+
+	}
+
+	vector<uint64_t> low((m*l + 63)/64);
+	vector<uint64_t> high((m + (n >> l) + 1 + 63)/64);
+
+	in.read((char*)low.data(), low.size()*sizeof(uint64_t));
+	in.read((char*)high.data(), high.size()*sizeof(uint64_t));
+
+	if(not in){
+
+		throw make_error("truncated suffixient set file ", path);
+
+	}
+
+	vector<uint64_t> pos(m);
+	uint64_t i = 0;
+
+	for(uint64_t w = 0; w < high.size() and i < m; ++w){
+
+		for(uint64_t bits = high[w]; bits != 0 and i < m; bits &= bits - 1){
+
+			uint64_t h = w*64 + __builtin_ctzll(bits) - i;
+
+			uint64_t b = i*l;
+			uint64_t lo = l == 0 ? 0 : low[b/64] >> (b%64);
+			if(l > 0 and b%64 + l > 64) lo |= low[b/64 + 1] << (64 - b%64);
+			if(l > 0) lo &= (uint64_t(1) << l) - 1;
+
+			pos[i++] = (h << l) | lo;
+
+		}
+
+	}
+
+	return pos;
+
+}
+
+#endif /* INTERNAL_SUFFIXIENT_SET_HPP_ */
@@ -0,0 +1,318 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * work_stealing_pool.hpp
+ *
+ *  Minimal fork-join thread pool with work stealing.
+ *
+ *  Every worker owns a deque of tasks: the owner pushes and pops at the back (LIFO, good locality),
+ *  idle workers steal from the front (FIFO, i.e. the oldest and typically largest tasks).
+ *
+ *  A task that waits for its children (join) does not block: it keeps executing tasks from its own
+ *  deque or stolen from other workers until the children are done. Tasks are expected to be coarse
+ *  (e.g. whole subtrees of the Weiner tree), so deques are simply protected by a mutex.
+ *
+ *  A worker that finds no task yields for a few rounds, then sleeps on a condition variable until a task is
+ *  spawned (or, if it is waiting, until a task is done), so that idle workers do not take the cores.
+ *
+ *  The thread calling run() acts as worker 0; the pool spawns (threads-1) additional workers.
+ *
+ *  An exception thrown by a task is caught by the pool, which marks the task done and skips the tasks that have
+ *  not started yet: run() rethrows it once all the workers have stopped. A task that spawned children must wait
+ *  for them before its exception leaves it, since they refer to its frame.
+ *
+ */
+
+#ifndef INTERNAL_WORK_STEALING_POOL_HPP_
+#define INTERNAL_WORK_STEALING_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+
+class work_stealing_pool{
+
+public:
+
+	struct task{
+
+		std::function<void()> fn;
+		std::atomic<bool> done {false};
+
+	};
+
+	work_stealing_pool(int threads) : n_workers(std::max(threads,1)), deques(std::max(threads,1)){}
+
+	work_stealing_pool(const work_stealing_pool&) = delete;
+	work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+	int threads(){
+		return n_workers;
+	}
+
+	/*
+	 * id of the calling worker (0 = thread that called run()). Valid only inside tasks.
+	 */
+	static int worker_id(){
+		return current_worker();
+	}
+
+	/*
+	 * execute fn on worker 0 while the other workers steal the tasks it spawns. Returns when fn has returned; the
+	 * first exception thrown by fn or by a task is rethrown
+	 */
+	void run(std::function<void()> fn){
+
+		stop = false;
+		failed = false;
+		error = nullptr;
+		current_worker() = 0;
+
+		std::vector<std::thread> workers;
+
+		for(int w=1;w<n_workers;++w)
+			workers.push_back(std::thread([this, w](){ worker_loop(w); }));
+
+		try{
+
+			fn();
+
+		}catch(...){
+
+			fail();
+
+		}
+
+		stop = true;
+		wake_all();
+		for(auto & t : workers) t.join();
+
+		if(error) std::rethrow_exception(error);
+
+	}
+
+	/*
+	 * make t available for execution. t must outlive the matching wait(t).
+	 */
+	void spawn(task & t){
+
+		auto & d = deques[current_worker()];
+
+		{
+
+			std::lock_guard<std::mutex> lock(d.m);
+			d.tasks.push_back(&t);
+			queued++;
+
+		}
+
+		if(sleepers.load() > 0){
+
+			std::lock_guard<std::mutex> lock(idle_mutex);
+			idle_cv.notify_one();
+
+		}
+
+	}
+
+	/*
+	 * help executing tasks until t is done
+	 */
+	void wait(task & t){
+
+		int w = current_worker();
+		uint64_t seed = w+1;
+		int rounds = 0;
+
+		while(not t.done.load(std::memory_order_acquire)){
+
+			task* x = pop(w);
+			if(x == NULL) x = steal(w, seed);
+
+			if(x != NULL){
+
+				execute(x);
+				rounds = 0;
+
+			}else idle(rounds, &t.done);
+
+		}
+
+	}
+
+private:
+
+	struct worker_deque{
+
+		std::mutex m;
+		std::deque<task*> tasks;
+
+	};
+
+	static int & current_worker(){
+		static thread_local int id = 0;
+		return id;
+	}
+
+	void worker_loop(int w){
+
+		current_worker() = w;
+		uint64_t seed = w+1;
+		int rounds = 0;
+
+		while(not stop.load(std::memory_order_acquire)){
+
+			task* x = pop(w);
+			if(x == NULL) x = steal(w, seed);
+
+			if(x != NULL){
+
+				execute(x);
+				rounds = 0;
+
+			}else idle(rounds, NULL);
+
+		}
+
+	}
+
+	void execute(task* x){
+
+		if(not failed.load(std::memory_order_relaxed)){
+
+			try{
+
+				x->fn();
+
+			}catch(...){
+
+				fail();
+
+			}
+
+		}
+
+		x->done.store(true);
+
+		//a worker waiting for x may sleep
+		if(sleepers.load() > 0) wake_all();
+
+	}
+
+	/*
+	 * no task found: yield for the first rounds, then sleep until a task is queued, the pool stops or done (if not
+	 * NULL) is set. The sleeper count is raised before the condition is checked and the counters are sequentially
+	 * consistent: spawn() and execute() then either see the sleeper and notify it, or the sleeper sees their task
+	 */
+	void idle(int & rounds, const std::atomic<bool>* done){
+
+		if(++rounds < SPIN_ROUNDS){
+
+			std::this_thread::yield();
+			return;
+
+		}
+
+		rounds = 0;
+		sleepers++;
+
+		{
+
+			std::unique_lock<std::mutex> lock(idle_mutex);
+			idle_cv.wait(lock, [&](){ return queued.load() > 0 or stop.load() or (done != NULL and done->load()); });
+
+		}
+
+		sleepers--;
+
+	}
+
+	void wake_all(){
+
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		idle_cv.notify_all();
+
+	}
+
+	//record the exception being handled, if it is the first one
+	void fail(){
+
+		std::lock_guard<std::mutex> lock(error_mutex);
+
+		if(not error) error = std::current_exception();
+		failed = true;
+
+	}
+
+	task* pop(int w){
+
+		auto & d = deques[w];
+
+		std::lock_guard<std::mutex> lock(d.m);
+
+		if(d.tasks.empty()) return NULL;
+
+		task* x = d.tasks.back();
+		d.tasks.pop_back();
+		queued--;
+		return x;
+
+	}
+
+	//try once every other worker, starting from a pseudo-random victim
+	task* steal(int w, uint64_t & seed){
+
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		int start = int((seed >> 33) % uint64_t(n_workers));
+
+		for(int i=0;i<n_workers;++i){
+
+			int v = (start+i)%n_workers;
+			if(v == w) continue;
+
+			auto & d = deques[v];
+
+			std::lock_guard<std::mutex> lock(d.m);
+
+			if(not d.tasks.empty()){
+
+				task* x = d.tasks.front();
+				d.tasks.pop_front();
+				queued--;
+				return x;
+
+			}
+
+		}
+
+		return NULL;
+
+	}
+
+	//rounds of yield before an idle worker sleeps
+	static const int SPIN_ROUNDS = 64;
+
+	int n_workers;
+	std::vector<worker_deque> deques;
+	std::atomic<bool> stop {false};
+
+	std::atomic<int64_t> queued {0};	//tasks in the deques
+	std::atomic<int> sleepers {0};		//workers in idle_cv (or about to be)
+	std::mutex idle_mutex;
+	std::condition_variable idle_cv;
+
+	std::atomic<bool> failed {false};
+	std::mutex error_mutex;
+	std::exception_ptr error;
+
+};
+
+#endif /* INTERNAL_WORK_STEALING_POOL_HPP_ */
@@ -0,0 +1,1875 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * librho.cpp
+ *
+ *  Implementation of librho.hpp: the navigations of the Weiner tree computing rho, and the indexes they run on.
+ *
+ *  Created on: Dec 11, 2023
+ *      Author: Nicola Prezza
+ */
+
+#include "librho.hpp"
+#include <iostream>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "internal/dna_bwt_n.hpp"
+#include "internal/dna_bwt.hpp"
+#include "internal/byte_bwt.hpp"
+#include "internal/pfp.hpp"
+#include "internal/suffixient_set.hpp"
+#include "internal/sa_sample.hpp"
+#include "internal/frontier.hpp"
+#include "internal/work_stealing_pool.hpp"
+#include "internal/progress_reporter.hpp"
+#include <stack>
+#include <algorithm>
+
+using namespace std;
+
+//seconds between two progress reports
+const double REPORT_INTERVAL = 5;
+
+/*
+ * state of one navigation (rho_context::compute_rho), shared by the functions of the traversal
+ */
+struct traversal_context{
+
+	rho_options opt;
+
+	uint64_t n = 0; //BWT length
+
+	//subtrees whose BWT interval is at least this large are split further (parallel, interleaved and checkpointed
+	//traversals)
+	uint64_t grain = 0;
+
+	//memory (bytes) of the level-synchronous traversal: half for the batches of queries, half for the frontier buffers
+	uint64_t frontier_memory = 8*uint64_t(FRONTIER_BUFFER);
+
+	std::unique_ptr<suffixient_writer> suffixient; //necessary+suffixient BWT positions, if opt.output_suffixient is given
+
+};
+
+//cout, or a stream discarding its output if the steps of the computation are not printed
+inline std::ostream & log_out(const rho_options & opt){
+
+	static thread_local std::ostream null_stream(NULL);
+
+	return opt.verbose ? cout : null_stream;
+
+}
+
+/*
+ * visited nodes (right-maximal substrings W) of each string depth |W|, of one thread, from which delta is
+ * computed (see print_measures): letters[k] = sum over the W of length k of their right-extensions by a
+ * letter; ending[k] = number of W of length k followed by a terminator
+ */
+struct depth_histogram{
+
+	vector<uint64_t> nodes;
+	vector<uint64_t> letters;
+	vector<uint64_t> ending;
+
+	inline void add(uint64_t depth, uint64_t n_letters, bool term){
+
+		if(depth >= nodes.size()){
+
+			uint64_t size = std::max(depth + 1, 2*nodes.size());
+
+			nodes.resize(size, 0);
+			letters.resize(size, 0);
+			ending.resize(size, 0);
+
+		}
+
+		nodes[depth]++;
+		letters[depth] += n_letters;
+		ending[depth] += term;
+
+	}
+
+	void merge(depth_histogram & h){
+
+		if(h.nodes.size() > nodes.size()){
+
+			nodes.resize(h.nodes.size(), 0);
+			letters.resize(h.nodes.size(), 0);
+			ending.resize(h.nodes.size(), 0);
+
+		}
+
+		for(uint64_t k=0;k<h.nodes.size();++k){
+
+			nodes[k] += h.nodes[k];
+			letters[k] += h.letters[k];
+			ending[k] += h.ending[k];
+
+		}
+
+	}
+
+};
+
+/*
+ * counters of one thread of the traversal. Those sampled by the progress reporter are atomics written 
+ * only by their thread, with relaxed load+store (plain moves, no locked instruction). The struct is 
+ * aligned to (and its size rounded up to) a cache line, so that threads do not write to the same line.
+ */
+struct alignas(64) traversal_stats{
+
+	std::atomic<uint64_t> nodes {0};
+	std::atomic<uint64_t> lf {0};		//rank queries on the BWT (LF calls, each for all the letters)
+	std::atomic<uint64_t> mass {0};	//sum over visited nodes of their interval minus the intervals of their children
+	std::atomic<uint64_t> depth {0};	//current recursion depth
+	uint64_t wl_leaves = 0;
+	uint64_t rec_depth = 0;
+	uint64_t max_rec_depth = 0;
+	depth_histogram hist;
+
+};
+
+static_assert(sizeof(traversal_stats) % 64 == 0, "traversal_stats must fill whole cache lines");
+
+/*
+ * allocator honouring the alignment of T: before C++17, operator new (and so std::allocator) only guarantees
+ * 16 bytes
+ */
+template<class T>
+struct aligned_allocator{
+
+	typedef T value_type;
+
+	aligned_allocator(){}
+	template<class U> aligned_allocator(const aligned_allocator<U>&){}
+
+	T* allocate(size_t k){
+
+		void* p = NULL;
+		if(posix_memalign(&p, alignof(T), k*sizeof(T)) != 0) throw std::bad_alloc();
+		return (T*)p;
+
+	}
+
+	void deallocate(T* p, size_t){
+		free(p);
+	}
+
+};
+
+template<class T, class U>
+bool operator==(const aligned_allocator<T>&, const aligned_allocator<U>&){ return true; }
+
+template<class T, class U>
+bool operator!=(const aligned_allocator<T>&, const aligned_allocator<U>&){ return false; }
+
+//counters of the threads of a traversal, one per thread
+typedef vector<traversal_stats, aligned_allocator<traversal_stats> > stats_vector;
+
+inline void relaxed_add(std::atomic<uint64_t>& counter, uint64_t delta){
+	counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+//count a visited node x with t children. The intervals of the children are disjoint sub-intervals
+//of that of x (shifted by LF), so the mass counted over the whole traversal telescopes to n = size(root)
+template<class node_t>
+inline void count_node(traversal_stats& st, node_t& x, node_t* children, int t){
+
+	uint64_t mass = node_size(x);
+	for(int i=0;i<t;++i) mass -= node_size(children[i]);
+
+	relaxed_add(st.nodes, 1);
+	relaxed_add(st.mass, mass);
+
+	auto x_ext = right_extensions(x);
+	st.hist.add(x.depth, x_ext.count() - x_ext[0], x_ext[0]);
+
+}
+
+//right-extensions of a node of type node_t (see flags in include.hpp)
+template<class node_t>
+using node_flags = flags<typename node_t::alphabet_t>;
+
+//with output_suffixient: record, for each right-extension c paid on x, the first BWT position of string(x)c
+template<class node_t>
+inline void record_paid(traversal_context& ctx, node_t& x, node_flags<node_t> paid){
+
+	if(not ctx.suffixient) return;
+
+	for(size_t e = paid._Find_first(); e < paid.size(); e = paid._Find_next(e)) ctx.suffixient->add(x.bounds[e]);
+
+}
+
+//x is a leaf of the Weiner tree: pay all the right extensions of string(x). Returns the cost.
+template<class node_t>
+inline uint64_t pay_leaf(traversal_context& ctx, node_t& x, node_flags<node_t>& covered_from_wchildren){
+
+	node_flags<node_t> x_ext = right_extensions(x);
+
+	covered_from_wchildren |= x_ext;
+	record_paid(ctx, x, x_ext);
+
+	return x_ext.count();
+
+}
+
+//x is an internal node of the Weiner tree, tmp_covered_children are the right-extensions covered by all
+//its children but the last one, whose right-extensions are last_ext: pay the right-extensions that are
+//not covered (one bit operation for all the letters). Returns the cost.
+template<class node_t>
+inline uint64_t pay_right_extensions(	traversal_context& ctx,
+										node_t& x, 
+										node_flags<node_t> last_ext, 
+										node_flags<node_t>& tmp_covered_children, 
+										node_flags<node_t>& covered_from_wchildren){
+
+	//right-extensions that have to be covered on node x
+	node_flags<node_t> paid = right_extensions(x) & ~tmp_covered_children & ~last_ext;
+
+	covered_from_wchildren |= paid;
+	record_paid(ctx, x, paid);
+
+	return paid.count();
+
+}
+
+template<class node_t>
+inline uint64_t pay_right_extensions(	traversal_context& ctx,
+										node_t& x, 
+										node_t& last_child, 
+										node_flags<node_t>& tmp_covered_children, 
+										node_flags<node_t>& covered_from_wchildren){
+
+	return pay_right_extensions(ctx, x, right_extensions(last_child), tmp_covered_children, covered_from_wchildren);
+
+}
+
+template<size_t E>
+inline void merge_flags(std::bitset<E>& dst, std::bitset<E>& src){
+
+	dst |= src;
+
+}
+
+//cost and covered right-extensions of a subtree (what process_node returns and ORs into its flag)
+template<class node_t>
+struct subtree_result{
+
+	uint64_t rho = 0;
+	node_flags<node_t> covered;
+
+};
+
+/*
+ * activation of the DFS on an internal node x. The recursion of the original algorithm is replaced 
+ * by a stack of these frames: the node and the flags that the recursive process_node kept in its
+ * locals live here. node_t = sa_node_t of the BWT (sa_node or sa_node_n).
+ */
+template<class node_t>
+struct dfs_frame{
+
+	node_t x;
+	node_t children[node_t::alphabet_t::sigma];
+	int t;				//number of children
+	int i;				//child being visited
+	node_flags<node_t> tmp_covered_children;
+	int out;			//frame whose tmp_covered_children receives the flags of x (-1 = result of the subtree)
+
+};
+
+//DFS depth never exceeds log2(n)+2: children but the last, the only ones that open a new frame,
+//have at most half the BWT interval of their parent. 128 frames are enough for any 64-bit input
+const int MAX_DFS_DEPTH = 128;
+
+/*
+ * DFS of one subtree, as a state machine: 'next' is the node that will be visited at the next 
+ * step, and its flags go to frame 'next_out'. Frames are preallocated, so that a step never 
+ * allocates; the whole stack takes MAX_DFS_DEPTH*sizeof(dfs_frame) bytes (about 45 KB).
+ */
+template<class node_t>
+struct dfs_cursor{
+
+	dfs_frame<node_t> stack[MAX_DFS_DEPTH];
+	int depth = 0;		//frames in use
+
+	node_t next;
+	int next_out = -1;
+	uint64_t result = 0; //result of the subtree being visited (interleaved traversal)
+	uint64_t root_depth = 0;  //recursion depth of the root of the subtree
+	bool active = false;
+
+	void start(node_t root, uint64_t root_rec_depth){
+
+		depth = 0;
+		next = root;
+		next_out = -1;
+		root_depth = root_rec_depth;
+		active = true;
+
+	}
+
+};
+
+//cursor c has just finished a child of its top frame (or its subtree): choose the next node to visit
+template<class node_t>
+inline void next_child(traversal_context& ctx, dfs_cursor<node_t>& c, subtree_result<node_t>& res){
+
+	if(c.depth == 0){
+
+		c.active = false;
+		return;
+
+	}
+
+	dfs_frame<node_t> & f = c.stack[c.depth-1];
+
+	if(f.i < f.t-1){
+
+		c.next = f.children[f.i];
+		c.next_out = c.depth-1;
+		return;
+
+	}
+
+	//all children but the last done: pay x and replace it with its last child
+	node_flags<node_t> & out = f.out < 0 ? res.covered : c.stack[f.out].tmp_covered_children;
+	res.rho += pay_right_extensions(ctx, f.x, f.children[f.t-1], f.tmp_covered_children, out);
+
+	c.next = f.children[f.t-1];
+	c.next_out = f.out;
+	c.depth--;
+
+}
+
+//one step of cursor c: visit c.next, adding its cost to res
+template<class bwt_t>
+inline void cursor_step(traversal_context& ctx, bwt_t& bwt, dfs_cursor<typename bwt_t::sa_node_t>& c, subtree_result<typename bwt_t::sa_node_t>& res, traversal_stats& st){
+
+	//frames on the stack are the activations above the one visiting c.next
+	st.max_rec_depth = std::max(st.max_rec_depth, c.root_depth + c.depth);
+	st.depth.store(c.root_depth + c.depth, std::memory_order_relaxed);
+
+	assert(c.depth < MAX_DFS_DEPTH);
+	auto & f = c.stack[c.depth];
+
+	//get (right-maximal) children of x in the Weiner tree, directly into the new frame
+	bwt.get_weiner_children(c.next, f.children, f.t);
+	relaxed_add(st.lf, bwt.lf_queries(c.next));
+
+	count_node(st, c.next, f.children, f.t);
+
+	if(f.t==0){
+
+		// no children in the Weiner tree: pay all the right extensions of string(x)
+
+		st.wl_leaves++;
+
+		auto & out = c.next_out < 0 ? res.covered : c.stack[c.next_out].tmp_covered_children;
+		res.rho += pay_leaf(ctx, c.next, out);
+
+		//the activation that reached this leaf is over: back to the child loop of its parent
+		if(c.depth > 0) c.stack[c.depth-1].i++;
+		next_child(ctx, c, res);
+		return;
+
+	}
+
+	f.i = 0;
+	f.x = c.next;
+	f.tmp_covered_children.reset();
+	f.out = c.next_out;
+	c.depth++;
+
+	next_child(ctx, c, res);
+
+}
+
+//processes node x and returns the cost of its subtree, i.e. total number of right-extensions that we pay.
+//Children are visited in increasing order of BWT interval length; the last one replaces x in its frame
+//instead of opening a new one, which keeps the stack logarithmic (see MAX_DFS_DEPTH).
+template<class bwt_t>
+uint64_t process_node(	traversal_context& ctx,
+						bwt_t& bwt,
+						typename bwt_t::sa_node_t& x, 
+						//The function "process_node" will add (OR) to this flag the 
+						//right-extensions that are covered on node x
+						node_flags<typename bwt_t::sa_node_t>& covered_from_wchildren,
+						traversal_stats& st
+						){ 
+
+	//allocated at the first call of each thread, not in its thread-local storage: the frames of the large byte
+	//alphabets take megabytes, that every thread would clear at its creation
+	static thread_local std::unique_ptr<dfs_cursor<typename bwt_t::sa_node_t> > cursor;
+
+	if(not cursor) cursor.reset(new dfs_cursor<typename bwt_t::sa_node_t>);
+
+	auto & c = *cursor;
+	subtree_result<typename bwt_t::sa_node_t> res;
+
+	c.start(x, st.rec_depth+1);
+
+	while(c.active) cursor_step(ctx, bwt, c, res, st);
+
+	merge_flags(covered_from_wchildren, res.covered);
+
+	return res.rho;
+
+}
+
+/*
+ * parallel version of process_node. Sibling subtrees interact only through the OR of their 
+ * covered right-extensions: children whose BWT interval is at least 'grain' are therefore handed 
+ * to the work-stealing pool with their own flags and cost, which are merged into those of x once 
+ * the child is done. Smaller subtrees are processed serially by process_node. 
+ * The result is identical to process_node.
+ */
+template<class bwt_t>
+uint64_t process_node_par(	traversal_context& ctx,
+							bwt_t& bwt,
+							typename bwt_t::sa_node_t& x, 
+							node_flags<typename bwt_t::sa_node_t>& covered_from_wchildren,
+							work_stealing_pool& pool,
+							stats_vector& stats
+							){ 
+
+	//a call runs entirely on the worker that starts it. While waiting for its tasks the worker runs other tasks,
+	//at other depths: these save and restore its rec_depth (see the tasks below)
+	traversal_stats& st = stats[pool.worker_id()];
+
+	st.rec_depth++;
+	st.max_rec_depth = std::max(st.max_rec_depth,st.rec_depth);
+	st.depth.store(st.rec_depth, std::memory_order_relaxed);
+
+	uint64_t rho = 0;
+
+	while(true){
+
+		if(node_size(x) < ctx.grain){
+
+			st.rec_depth--;
+			return rho + process_node(ctx, bwt, x, covered_from_wchildren, st);
+
+		}
+
+		//on the heap: nodes of large alphabets would fill the stack of the workers (few nodes are above grain)
+		int t = 0;
+		std::unique_ptr<typename bwt_t::sa_node_t[]> children(new typename bwt_t::sa_node_t[bwt_t::sigma]);
+		bwt.get_weiner_children(x, children.get(), t);
+		relaxed_add(st.lf, bwt.lf_queries(x));
+
+		count_node(st, x, children.get(), t);
+
+		if(t==0){ 
+
+			st.wl_leaves++;
+			rho += pay_leaf(ctx, x, covered_from_wchildren);
+
+			break;
+
+		}
+
+		node_flags<typename bwt_t::sa_node_t> tmp_covered_children;
+
+		//children (but the last) handed to the pool, with their own result
+		work_stealing_pool::task tasks[bwt_t::sigma-1];
+		node_flags<typename bwt_t::sa_node_t> task_covered[bwt_t::sigma-1];
+		uint64_t task_rho[bwt_t::sigma-1];
+		int n_tasks = 0;
+
+		try{
+
+			for(int i=0;i<t-1;++i){
+
+				if(node_size(children[i]) >= ctx.grain){
+
+					int k = n_tasks++;
+
+					task_covered[k].reset();
+					task_rho[k] = 0;
+
+					auto child = children[i];
+					uint64_t depth = st.rec_depth;
+
+					//the task starts at the depth of x, whichever worker runs it (an idle one, or one that is
+					//waiting in a frame of its own at another depth)
+					tasks[k].fn = [&ctx, &bwt, &pool, &stats, &task_covered, &task_rho, k, child, depth](){
+
+						traversal_stats& w = stats[pool.worker_id()];
+						uint64_t saved = w.rec_depth;
+
+						w.rec_depth = depth;
+
+						auto c = child;
+						task_rho[k] = process_node_par(ctx, bwt, c, task_covered[k], pool, stats);
+
+						w.rec_depth = saved;
+						w.depth.store(saved, std::memory_order_relaxed);
+
+					};
+
+					pool.spawn(tasks[k]);
+
+				}else{
+
+					rho += process_node(ctx, bwt,children[i],tmp_covered_children,st);
+
+				}
+
+			}
+
+		}catch(...){
+
+			//the spawned tasks live in this frame (the pool skips them once a task has failed)
+			for(int k=0;k<n_tasks;++k) pool.wait(tasks[k]);
+			throw;
+
+		}
+
+		for(int k=0;k<n_tasks;++k){
+
+			pool.wait(tasks[k]);
+
+			rho += task_rho[k];
+			merge_flags(tmp_covered_children, task_covered[k]);
+
+		}
+
+		rho += pay_right_extensions(ctx, x, children[t-1], tmp_covered_children, covered_from_wchildren);
+
+		x = children[t-1];
+
+	}
+
+	st.rec_depth--;
+	return rho;
+
+}
+
+/*
+ * Latency-hiding traversal. The Weiner tree is cut in a top part (nodes whose BWT interval is at 
+ * least 'grain') and a forest of small subtrees. The top part is visited first and only recorded; 
+ * the small subtrees are then visited by K independent DFS cursors per thread, advanced in rounds:
+ * at each round the blocks needed by the next node of every cursor are prefetched, then every cursor 
+ * visits its node. The K cache misses of a round thus overlap instead of being paid one after the 
+ * other. Finally, the recorded top part is paid bottom-up from the results of its subtrees. 
+ * The result is identical to process_node.
+ */
+
+//small subtree, visited by a cursor
+template<class node_t>
+struct subtree{
+
+	node_t root;
+	uint64_t result;	//index of its result
+	uint64_t depth;		//recursion depth of process_node on root
+
+};
+
+//internal node of the top part: its payment is delayed until the results of its children are known
+template<class node_t>
+struct top_node{
+
+	node_t x;
+	node_flags<node_t> last_ext;	//right-extensions of the last child of x
+	int t;				//number of children
+	uint64_t child[node_t::alphabet_t::sigma];	//results of the children
+	uint64_t out;		//result of x
+
+};
+
+/*
+ * visit the part of the tree above grain. Small subtrees are appended to 'subtrees', each with 
+ * its own entry in 'results'; internal nodes are appended to 'top' in preorder
+ */
+template<class bwt_t>
+void visit_top(	traversal_context& ctx,
+				bwt_t& bwt,
+				typename bwt_t::sa_node_t root, 
+				vector<subtree<typename bwt_t::sa_node_t> >& subtrees,
+				vector<top_node<typename bwt_t::sa_node_t> >& top,
+				vector<subtree_result<typename bwt_t::sa_node_t> >& results,
+				traversal_stats& st){
+
+	vector<subtree<typename bwt_t::sa_node_t> > stack {{root, 0, 1}};
+	results.push_back(subtree_result<typename bwt_t::sa_node_t>());
+
+	std::unique_ptr<typename bwt_t::sa_node_t[]> children(new typename bwt_t::sa_node_t[bwt_t::sigma]);
+
+	while(not stack.empty()){
+
+		auto x = stack.back().root;
+		uint64_t out = stack.back().result;
+		uint64_t depth = stack.back().depth;
+		stack.pop_back();
+
+		st.max_rec_depth = std::max(st.max_rec_depth, depth);
+		st.depth.store(depth, std::memory_order_relaxed);
+
+		int t = 0;
+		bwt.get_weiner_children(x, children.get(), t);
+		relaxed_add(st.lf, bwt.lf_queries(x));
+
+		count_node(st, x, children.get(), t);
+
+		if(t==0){
+
+			st.wl_leaves++;
+			results[out].rho += pay_leaf(ctx, x, results[out].covered);
+			continue;
+
+		}
+
+		top_node<typename bwt_t::sa_node_t> v;
+		v.x = x;
+		v.last_ext = right_extensions(children[t-1]);
+		v.t = t;
+		v.out = out;
+
+		for(int i=0;i<t;++i){
+
+			v.child[i] = results.size();
+			results.push_back(subtree_result<typename bwt_t::sa_node_t>());
+
+			//as in process_node, the last child continues the activation of x
+			subtree<typename bwt_t::sa_node_t> c {children[i], v.child[i], i < t-1 ? depth+1 : depth};
+
+			if(node_size(children[i]) >= ctx.grain) stack.push_back(c);
+			else subtrees.push_back(c);
+
+		}
+
+		top.push_back(v);
+
+	}
+
+}
+
+//pay the nodes of the top part. Children are recorded after their parent, so a reverse scan is bottom-up
+template<class node_t>
+uint64_t pay_top(traversal_context& ctx, vector<top_node<node_t> >& top, vector<subtree_result<node_t> >& results){
+
+	for(uint64_t j=top.size();j>0;--j){
+
+		top_node<node_t> & v = top[j-1];
+		subtree_result<node_t> & res = results[v.out];
+
+		node_flags<node_t> tmp_covered_children;
+
+		for(int i=0;i<v.t;++i){
+
+			subtree_result<node_t> & c = results[v.child[i]];
+			res.rho += c.rho;
+
+			if(i < v.t-1) merge_flags(tmp_covered_children, c.covered);
+
+		}
+
+		res.rho += pay_right_extensions(ctx, v.x, v.last_ext, tmp_covered_children, res.covered);
+
+		//the last child is the continuation of x (tail loop of process_node): its flags go to the same place
+		merge_flags(res.covered, results[v.child[v.t-1]].covered);
+
+	}
+
+	return results[0].rho;
+
+}
+
+/*
+ * visit the subtrees with 'interleave' cursors. Subtrees are taken from the shared counter 
+ * next_subtree, so several threads can run this function at the same time
+ */
+template<class bwt_t>
+void visit_interleaved(	traversal_context& ctx,
+						bwt_t& bwt,
+						vector<subtree<typename bwt_t::sa_node_t> >& subtrees,
+						vector<subtree_result<typename bwt_t::sa_node_t> >& results,
+						std::atomic<uint64_t>& next_subtree,
+						traversal_stats& st){
+
+	//default-initialized: the frames are not cleared, their memory is touched only when used
+	std::unique_ptr<dfs_cursor<typename bwt_t::sa_node_t>[]> cursors(new dfs_cursor<typename bwt_t::sa_node_t>[ctx.opt.interleave]);
+
+	bool any_active = true;
+
+	while(any_active){
+
+		any_active = false;
+
+		for(int i=0;i<ctx.opt.interleave;++i){
+
+			auto & c = cursors[i];
+
+			if(not c.active){
+
+				uint64_t s = next_subtree++;
+
+				if(s < subtrees.size()){
+
+					c.start(subtrees[s].root, subtrees[s].depth);
+					c.result = subtrees[s].result;
+
+				}
+
+			}
+
+			if(c.active) bwt.prefetch(c.next);
+
+		}
+
+		for(int i=0;i<ctx.opt.interleave;++i){
+
+			auto & c = cursors[i];
+
+			if(c.active){
+
+				cursor_step(ctx, bwt, c, results[c.result], st);
+				any_active = true;
+
+			}
+
+		}
+
+	}
+
+}
+
+/*
+ * Checkpointed traversal (option --checkpoint). The tree is split as for the interleaved traversal: the top part is
+ * visited first (it is small, and the same at every run with the same grain), then the subtrees below grain are
+ * visited by the threads in any order. Between two subtrees, the state of the traversal is the set of subtrees done
+ * with their results (cost and covered right-extensions), plus the counters: every checkpoint_every seconds the
+ * threads stop after their current subtree, and this state is written to the checkpoint file. A resumed run visits
+ * the top part again, reloads the results of the subtrees done and visits the others. The top part is paid once
+ * all the subtrees are done, so the result is identical to process_node.
+ *
+ * File layout (64-bit words): the header (see checkpoint_header), the counters (nodes, mass, Weiner tree leaves,
+ * maximum recursion depth), the length L of the depth histogram and its 3L words (nodes, letters, ending), the
+ * number of subtrees done and, for each of them, its index, its cost and its covered right-extensions (the bytes of
+ * node_flags). The file is written to path + ".tmp" and renamed, so a checkpoint is never left half-written.
+ */
+
+const uint64_t CHECKPOINT_MAGIC = 0x31544e494f504b43;	//"CKPOINT1"
+
+//subtrees of the checkpointed traversal: about n/CHECKPOINT_SUBTREES BWT positions each, whatever the number of
+//threads, so that a checkpoint can be resumed with another -p. A pause waits for the largest one
+const uint64_t CHECKPOINT_SUBTREES = 65536;
+
+//words identifying the traversal: a checkpoint is resumed only with the same index, representation and grain
+template<class bwt_t>
+vector<uint64_t> checkpoint_header(traversal_context& ctx, bwt_t& bwt, uint64_t subtrees, uint64_t top){
+
+	return {CHECKPOINT_MAGIC, bwt.size(), bwt.r(), sizeof(node_flags<typename bwt_t::sa_node_t>), ctx.grain, subtrees, top};
+
+}
+
+//grain stored in the checkpoint file (needed to split the tree as in the checkpointed run)
+uint64_t checkpoint_grain(traversal_context& ctx){
+
+	std::ifstream in(ctx.opt.checkpoint_path, std::ios::binary);
+
+	uint64_t header[5] = {};
+	in.read((char*)header, sizeof(header));
+
+	if(not in){
+
+		throw make_error("cannot read checkpoint file ", ctx.opt.checkpoint_path);
+
+	}
+
+	if(header[0] != CHECKPOINT_MAGIC or header[4] == 0){
+
+		throw make_error(ctx.opt.checkpoint_path, " is not a checkpoint file");
+
+	}
+
+	return header[4];
+
+}
+
+//write the subtrees done, their results and the counters of all threads. No thread may be visiting a subtree
+template<class node_t>
+void write_checkpoint(	traversal_context& ctx,
+						vector<uint64_t>& header,
+						vector<subtree<node_t> >& subtrees,
+						vector<subtree_result<node_t> >& results,
+						vector<char>& done,
+						stats_vector& stats){
+
+	string tmp_path = ctx.opt.checkpoint_path + ".tmp";
+	std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+
+	auto put = [&out](uint64_t x){ out.write((char*)&x, sizeof(x)); };
+
+	for(auto h : header) put(h);
+
+	uint64_t visited = 0, mass = 0, leaves = 0, depth = 0;
+	depth_histogram hist;
+
+	for(auto & st : stats){
+
+		visited += st.nodes.load(std::memory_order_relaxed);
+		mass += st.mass.load(std::memory_order_relaxed);
+		leaves += st.wl_leaves;
+		depth = std::max(depth, st.max_rec_depth);
+		hist.merge(st.hist);
+
+	}
+
+	put(visited);
+	put(mass);
+	put(leaves);
+	put(depth);
+
+	put(hist.nodes.size());
+	out.write((char*)hist.nodes.data(), hist.nodes.size()*sizeof(uint64_t));
+	out.write((char*)hist.letters.data(), hist.letters.size()*sizeof(uint64_t));
+	out.write((char*)hist.ending.data(), hist.ending.size()*sizeof(uint64_t));
+
+	put(std::count(done.begin(), done.end(), 1));
+
+	for(uint64_t s=0;s<subtrees.size();++s){
+
+		if(not done[s]) continue;
+
+		subtree_result<node_t> & res = results[subtrees[s].result];
+
+		put(s);
+		put(res.rho);
+		out.write((char*)&res.covered, sizeof(res.covered));
+
+	}
+
+	out.close();
+
+	if(not out or std::rename(tmp_path.c_str(), ctx.opt.checkpoint_path.c_str()) != 0){
+
+		throw make_error("cannot write checkpoint file ", ctx.opt.checkpoint_path);
+
+	}
+
+}
+
+//restore the subtrees done, their results and the counters (into st) from the checkpoint file
+template<class node_t>
+void read_checkpoint(	traversal_context& ctx,
+						vector<uint64_t>& header,
+						vector<subtree<node_t> >& subtrees,
+						vector<subtree_result<node_t> >& results,
+						vector<char>& done,
+						traversal_stats& st){
+
+	std::ifstream in(ctx.opt.checkpoint_path, std::ios::binary);
+
+	auto get = [&in](){ uint64_t x = 0; in.read((char*)&x, sizeof(x)); return x; };
+
+	for(auto h : header){
+
+		if(get() != h){
+
+			throw make_error("checkpoint file ", ctx.opt.checkpoint_path, " was not written by a run on this index");
+
+		}
+
+	}
+
+	st.nodes.store(get());
+	st.mass.store(get());
+	st.wl_leaves = get();
+	st.max_rec_depth = get();
+
+	uint64_t L = get();
+
+	if(not in or L > 2*ctx.n + 2){
+
+		throw make_error("corrupted checkpoint file ", ctx.opt.checkpoint_path);
+
+	}
+
+	st.hist.nodes = vector<uint64_t>(L);
+	st.hist.letters = vector<uint64_t>(L);
+	st.hist.ending = vector<uint64_t>(L);
+
+	in.read((char*)st.hist.nodes.data(), L*sizeof(uint64_t));
+	in.read((char*)st.hist.letters.data(), L*sizeof(uint64_t));
+	in.read((char*)st.hist.ending.data(), L*sizeof(uint64_t));
+
+	uint64_t d = get();
+
+	for(uint64_t j=0;j<d and in;++j){
+
+		uint64_t s = get();
+
+		if(s >= subtrees.size()){
+
+			throw make_error("corrupted checkpoint file ", ctx.opt.checkpoint_path);
+
+		}
+
+		subtree_result<node_t> & res = results[subtrees[s].result];
+
+		done[s] = 1;
+		res.rho = get();
+		in.read((char*)&res.covered, sizeof(res.covered));
+
+	}
+
+	if(not in){
+
+		throw make_error("truncated checkpoint file ", ctx.opt.checkpoint_path);
+
+	}
+
+}
+
+/*
+ * visit the tree with 'threads' threads, writing a checkpoint every checkpoint_every seconds (and resuming from
+ * the checkpoint file if resume is set). Returns rho; the counters of the visit are in stats
+ */
+template<class bwt_t>
+uint64_t visit_checkpointed(traversal_context& ctx, bwt_t& bwt, stats_vector& stats, uint64_t& checkpoints){
+
+	typedef typename bwt_t::sa_node_t node_t;
+
+	ctx.grain = ctx.opt.resume ? checkpoint_grain(ctx) : std::max(uint64_t(1), ctx.n/CHECKPOINT_SUBTREES);
+
+	vector<subtree<node_t> > subtrees;
+	vector<top_node<node_t> > top;
+	vector<subtree_result<node_t> > results;
+
+	//the counters of a resumed run are those of the checkpoint, which include the top part
+	traversal_stats top_stats;
+
+	visit_top(ctx, bwt, bwt.root(), subtrees, top, results, ctx.opt.resume ? top_stats : stats[0]);
+
+	vector<char> done(subtrees.size(), 0);
+	vector<uint64_t> header = checkpoint_header(ctx, bwt, subtrees.size(), top.size());
+
+	if(ctx.opt.resume){
+
+		read_checkpoint(ctx, header, subtrees, results, done, stats[0]);
+
+		log_out(ctx.opt) << "Resuming from " << ctx.opt.checkpoint_path << ": " << std::count(done.begin(), done.end(), 1) << " of " << subtrees.size() << " subtrees already visited." << endl;
+
+	}
+
+	vector<uint64_t> pending;
+	for(uint64_t s=0;s<subtrees.size();++s) if(not done[s]) pending.push_back(s);
+
+	std::atomic<uint64_t> next_subtree {0};
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool pause = false;	//threads must stop after their current subtree
+	int stopped = 0;	//threads paused or finished
+	int finished = 0;
+	std::exception_ptr error;	//first error of a thread or of a checkpoint: the threads stop after their subtree
+
+	auto worker = [&](int w){
+
+		traversal_stats & st = stats[w];
+
+		try{
+
+			while(true){
+
+				{
+
+					std::unique_lock<std::mutex> lock(mutex);
+
+					if(pause){
+
+						stopped++;
+						cv.notify_all();
+						cv.wait(lock, [&](){ return not pause; });
+						stopped--;
+
+					}
+
+					if(error) break;
+
+				}
+
+				uint64_t k = next_subtree++;
+
+				if(k >= pending.size()) break;
+
+				subtree<node_t> & s = subtrees[pending[k]];
+				subtree_result<node_t> & res = results[s.result];
+
+				//process_node starts from recursion depth st.rec_depth+1
+				st.rec_depth = s.depth - 1;
+				res.rho += process_node(ctx, bwt, s.root, res.covered, st);
+
+				done[pending[k]] = 1;
+
+			}
+
+		}catch(...){
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if(not error) error = std::current_exception();
+
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		stopped++;
+		finished++;
+		cv.notify_all();
+
+	};
+
+	vector<std::thread> workers;
+	for(int w=0;w<ctx.opt.threads;++w) workers.push_back(std::thread(worker, w));
+
+	{
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while(not cv.wait_for(lock, std::chrono::duration<double>(ctx.opt.checkpoint_every), [&](){ return finished == ctx.opt.threads; })){
+
+			pause = true;
+			cv.wait(lock, [&](){ return stopped == ctx.opt.threads; });
+
+			try{
+
+				write_checkpoint(ctx, header, subtrees, results, done, stats);
+				checkpoints++;
+
+			}catch(...){
+
+				if(not error) error = std::current_exception();
+
+			}
+
+			pause = false;
+			cv.notify_all();
+
+		}
+
+	}
+
+	for(auto & w : workers) w.join();
+
+	if(error) std::rethrow_exception(error);
+
+	return pay_top(ctx, top, results);
+
+}
+
+/*
+ * Level-synchronous traversal (option -e bfs). The Weiner tree is expanded one level (string depth) at a time:
+ * the rank queries of a batch of frontier nodes (all the boundaries of their intervals) are radix-sorted by BWT
+ * position and answered in one sweep over the blocks, split among the threads, so that the blocks are streamed
+ * instead of being accessed in the random order of the DFS. Frontiers larger than their memory buffer are spilled
+ * to temporary files (see frontier.hpp).
+ *
+ * Payments need the covered right-extensions of the children, so they are done in a second pass, bottom-up: the
+ * expansion records the right-extensions and the number of children of every node, level by level, and the
+ * children of the nodes of a level are the next level in the same order. Each level is then paid from the results
+ * of the level below, exactly as pay_top pays the top part of the tree. The result is identical to process_node.
+ */
+
+//what the payment of a node needs from the expansion
+template<class node_t>
+struct level_record{
+
+	node_flags<node_t> ext;		//right-extensions of the node
+	int t;				//number of children
+
+};
+
+//result of the payment of a node, used by the payment of its parent
+template<class node_t>
+struct level_result{
+
+	node_flags<node_t> ext;
+	node_flags<node_t> covered;	//what process_node would OR into the flags of the parent
+
+};
+
+//the rank queries of the level-synchronous traversal are answered by dna_bwt::parallel_rank_multi
+template<class bwt_t>
+uint64_t visit_levels(traversal_context&, bwt_t&, stats_vector&, uint64_t&){
+
+	throw make_error("the level-synchronous traversal (-e bfs) is available for the plain, 2bit and rle representations");
+
+}
+
+/*
+ * returns rho; levels = number of levels of the Weiner tree
+ */
+template<class str_type>
+uint64_t visit_levels(traversal_context& ctx, dna_bwt<str_type>& bwt, stats_vector& stats, uint64_t& levels){
+
+	typedef dna_bwt<str_type> bwt_t;
+	typedef typename bwt_t::sa_node_t node_t;
+	typedef typename bwt_t::rank_t rank_t;
+
+	const int B = bwt_t::sigma+2; //boundaries of a node
+
+	traversal_stats& st = stats[0];
+
+	//five frontier stores are alive at once (two frontiers, the records, two levels of results)
+	uint64_t buffer = ctx.frontier_memory/10;
+
+	frontier_store<node_t> frontier[2] {{buffer}, {buffer}};
+	frontier_store<level_record<node_t> > records(buffer);
+	vector<uint64_t> level_size;
+
+	//nodes per batch: the node, and for each boundary a query, its sorted copy and two ranks
+	uint64_t batch = std::max(uint64_t(1024), (ctx.frontier_memory/2) / (sizeof(node_t) + B*(2*sizeof(rank_query) + 2*sizeof(rank_t))));
+
+	vector<node_t> nodes;
+	vector<rank_query> q, tmp;
+	vector<uint64_t> pos;
+	vector<rank_t> ranks;
+	vector<rank_t> before;
+
+	node_t children[bwt_t::sigma];
+
+	int cur = 0;
+	frontier[cur].push_back(bwt.root());
+
+	while(frontier[cur].size() > 0){
+
+		frontier_store<node_t> & F = frontier[cur];
+		frontier_store<node_t> & next = frontier[1-cur];
+
+		level_size.push_back(F.size());
+
+		st.depth.store(level_size.size(), std::memory_order_relaxed);
+
+		for(uint64_t from = 0; from < F.size(); from += batch){
+
+			uint64_t m = std::min(batch, F.size() - from);
+
+			nodes.resize(m);
+			F.read(from, m, nodes.data());
+
+			q.resize(m*B);
+
+			for(uint64_t j = 0; j < m; ++j)
+				for(int b = 0; b < B; ++b) q[j*B + b] = {nodes[j].bounds[b], j*B + b};
+
+			radix_sort_queries(q, tmp, bwt.size());
+
+			pos.resize(q.size());
+			ranks.resize(q.size());
+			before.resize(q.size());
+
+			for(uint64_t i = 0; i < q.size(); ++i) pos[i] = q[i].pos;
+
+			//one sweep over the blocks: each thread answers a slice of the sorted queries
+			auto sweep = [&](int t){
+
+				uint64_t lo = q.size()*t/ctx.opt.threads;
+				uint64_t hi = q.size()*(t+1)/ctx.opt.threads;
+
+				for(uint64_t i = lo; i < hi; i += 65536){
+
+					int k = int(std::min(uint64_t(65536), hi - i));
+					bwt.parallel_rank_multi(pos.data() + i, k, ranks.data() + i);
+
+				}
+
+				for(uint64_t i = lo; i < hi; ++i) before[q[i].idx] = ranks[i];
+
+			};
+
+			run_threads(ctx.opt.threads, sweep);
+			relaxed_add(st.lf, q.size());
+
+			for(uint64_t j = 0; j < m; ++j){
+
+				int t = 0;
+				bwt.get_weiner_children(nodes[j], before.data() + j*B, children, t);
+
+				count_node(st, nodes[j], children, t);
+
+				if(t == 0) st.wl_leaves++;
+
+				records.push_back({right_extensions(nodes[j]), t});
+
+				for(int i = 0; i < t; ++i) next.push_back(children[i]);
+
+			}
+
+		}
+
+		F.clear();
+		cur = 1-cur;
+
+	}
+
+	levels = level_size.size();
+
+	//payments, from the deepest level up. The records of level k start at level_start
+	frontier_store<level_result<node_t> > results[2] {{buffer}, {buffer}};
+
+	uint64_t rho = 0;
+	uint64_t level_start = records.size();
+	vector<level_record<node_t> > rec;
+
+	int below = 0;
+
+	for(uint64_t k = levels; k > 0; --k){
+
+		level_start -= level_size[k-1];
+
+		frontier_reader<level_result<node_t> > children_res(results[below]);
+		frontier_store<level_result<node_t> > & out = results[1-below];
+
+		for(uint64_t from = 0; from < level_size[k-1]; from += batch){
+
+			uint64_t m = std::min(batch, level_size[k-1] - from);
+
+			rec.resize(m);
+			records.read(level_start + from, m, rec.data());
+
+			for(auto & r : rec){
+
+				level_result<node_t> res {r.ext, r.ext};
+
+				//a leaf pays all its right-extensions
+				node_flags<node_t> paid = r.ext;
+
+				if(r.t > 0){
+
+					node_flags<node_t> tmp_covered_children;
+
+					for(int i = 0; i < r.t-1; ++i) tmp_covered_children |= children_res.next().covered;
+
+					level_result<node_t> & last = children_res.next();
+
+					paid = r.ext & ~tmp_covered_children & ~last.ext;
+					res.covered = paid | last.covered;
+
+				}
+
+				rho += paid.count();
+				out.push_back(res);
+
+			}
+
+		}
+
+		results[below].clear();
+		below = 1-below;
+
+	}
+
+	return rho;
+
+}
+
+/*
+ * measures computed from the right-maximal substrings visited by the traversal (see depth_histogram): the maximum
+ * length of a right-maximal substring, the histogram of their lengths (to opt.output_histogram) and delta =
+ * max_k d_k/k, where d_k is the number of distinct substrings of length k (terminators excluded). Every substring
+ * X of length k is followed by one letter, by the terminator, or (if X is right-maximal) by several of them, so that
+ *
+ *     d_{k+1} = d_k + sum over the right-maximal X of length k of (letters following X - 1) - u_k
+ *
+ * where u_k is the number of substrings of length k followed only by terminators. With one terminator, u_k = 1
+ * unless the suffix of length k is right-maximal, and delta is exact. With several terminators, the substrings
+ * occurring only at the end of strings are not visited and u_k = 0 is used: delta is an upper bound (tight
+ * unless the strings share long suffixes found nowhere else).
+ */
+void compute_measures(traversal_context& ctx, depth_histogram & hist, rho_stats & s){
+
+	s.max_length = 0;
+
+	for(uint64_t k=0;k<hist.nodes.size();++k) if(hist.nodes[k] > 0) s.max_length = k;
+
+	s.delta_exact = s.terminators == 1;
+
+	//beyond the longest right-maximal substring d_k only decreases
+	uint64_t d_k = 1;
+
+	for(uint64_t k=0;k<=s.max_length and k<hist.nodes.size();++k){
+
+		uint64_t u_k = s.delta_exact ? 1 - hist.ending[k] : 0;
+
+		d_k = d_k + hist.letters[k] - hist.nodes[k] - u_k;
+
+		if(double(d_k)/(k+1) > s.delta){
+
+			s.delta = double(d_k)/(k+1);
+			s.delta_k = k+1;
+
+		}
+
+	}
+
+	if(ctx.opt.output_histogram.size()>0){
+
+		std::ofstream out(ctx.opt.output_histogram);
+
+		out << "length\tright-maximal substrings" << endl;
+		for(uint64_t k=0;k<=s.max_length and k<hist.nodes.size();++k) if(hist.nodes[k] > 0) out << k << "\t" << hist.nodes[k] << endl;
+
+		out.close();
+
+		if(not out){
+
+			throw make_error("cannot write histogram file ", ctx.opt.output_histogram);
+
+		}
+
+	}
+
+}
+
+/*
+ * build the index from the BWT streamed by the prefix-free parsing (only for the plain and 2bit representations)
+ */
+template<class bwt_t>
+void build_from_parse(bwt_t&, pfp_bwt&, const rho_options&){
+
+	throw make_error("option -f builds only the plain and 2bit representations of the BWT");
+
+}
+
+void build_from_parse(dna_bwt_n_t& bwt, pfp_bwt& pfp, const rho_options& opt){
+
+	bwt = dna_bwt_n_t(pfp.size(), [&pfp](char* buf, uint64_t len){ pfp.read(buf, len); }, opt.terminator, opt.threads);
+
+}
+
+void build_from_parse(dna_bwt_t& bwt, pfp_bwt& pfp, const rho_options& opt){
+
+	bwt = dna_bwt_t(pfp.size(), [&pfp](char* buf, uint64_t len){ pfp.read(buf, len); }, opt.terminator, opt.threads);
+
+}
+
+//alphabet of the byte representation (nothing to print for the DNA ones)
+template<class bwt_t>
+void print_alphabet(bwt_t&, std::ostream&){}
+
+template<class alphabet>
+void print_alphabet(byte_bwt<alphabet>& bwt, std::ostream& out){
+
+	out << "Alphabet: " << bwt.alphabet_size() << " letters (nodes for up to " << alphabet::sigma << "), wavelet matrix with " << bwt.levels() << " levels" << endl;
+
+}
+
+//semi-external mode (--mem-limit): half of the memory caches the blocks of the BWT, half goes to the traversal
+template<class bwt_t>
+void page_from_file(bwt_t&, const rho_options&){
+
+	throw make_error("option --mem-limit requires an index with the plain representation (built with -b plain -s)");
+
+}
+
+void page_from_file(dna_bwt_n_t& bwt, const rho_options& opt){
+
+	bwt.page_from_file(opt.input_index, opt.mem_limit/2, opt.verify_index);
+
+}
+
+template<class bwt_t>
+uint64_t pages_read(bwt_t&){
+	return 0;
+}
+
+uint64_t pages_read(dna_bwt_n_t& bwt){
+	return bwt.pages_read();
+}
+
+/*
+ * navigate the Weiner tree of bwt with the options opt (already checked). The counters, flags and output files of
+ * the navigation belong to its traversal_context, so navigations may run at the same time on the same index
+ */
+template<class bwt_t>
+rho_stats navigate(bwt_t& bwt, const rho_options& opt){
+
+	std::ostream & out = log_out(opt);
+
+	traversal_context ctx;
+	ctx.opt = opt;
+	ctx.n = bwt.size();
+
+	if(opt.mem_limit > 0) ctx.frontier_memory = opt.mem_limit/2;
+
+	rho_stats s;
+	s.n = ctx.n;
+
+	//terminators are the smallest letter: they prefix the suffixes of the first interval of the root
+	auto x = bwt.root();
+	s.terminators = x.bounds[1] - x.bounds[0];
+
+	//navigate suffix link tree
+
+	if(opt.output_suffixient.size()>0) ctx.suffixient = std::unique_ptr<suffixient_writer>(new suffixient_writer(opt.output_suffixient, ctx.n));
+
+	if(opt.engine == "dfs") out << "Starting DFS navigation of the Weiner tree." << endl;
+
+	node_flags<typename bwt_t::sa_node_t> tmp_covered_children;
+	uint64_t rho = 0;
+
+	stats_vector stats(opt.threads);
+
+	if(opt.threads > 1) out << "Using " << opt.threads << " threads." << endl;
+
+	std::unique_ptr<progress_reporter> reporter;
+
+	if(not opt.quiet){
+
+		reporter = std::unique_ptr<progress_reporter>(new progress_reporter([&stats](){
+
+			progress_reporter::sample s;
+
+			for(auto & st : stats){
+
+				s.nodes += st.nodes.load(std::memory_order_relaxed);
+				s.lf += st.lf.load(std::memory_order_relaxed);
+				s.mass += st.mass.load(std::memory_order_relaxed);
+				s.depth = std::max(s.depth, st.depth.load(std::memory_order_relaxed));
+
+			}
+
+			return s;
+
+		}, ctx.n, REPORT_INTERVAL));
+
+	}
+
+	if(opt.engine == "bfs"){
+
+		out << "Starting level-synchronous navigation of the Weiner tree (" << ctx.frontier_memory/(uint64_t(1)<<20) << " MB for the frontiers and the sorted queries)." << endl;
+
+		rho = visit_levels(ctx, bwt, stats, s.levels);
+
+		out << "Levels of the Weiner tree: " << s.levels << endl;
+
+		if(opt.mem_limit > 0){
+
+			s.pages_read = pages_read(bwt);
+			out << "BWT pages read from disk: " << s.pages_read << " (" << BLOCK_CACHE_PAGE/1024 << " KB each)" << endl;
+
+		}
+
+	}else if(opt.checkpoint_path.size()>0){
+
+		out << "Writing a checkpoint to " << opt.checkpoint_path << " every " << opt.checkpoint_every << " seconds." << endl;
+
+		rho = visit_checkpointed(ctx, bwt, stats, s.checkpoints);
+
+		//the traversal is complete: a later --resume would find nothing to do
+		std::remove(opt.checkpoint_path.c_str());
+
+		out << "Checkpoints written: " << s.checkpoints << endl;
+
+	}else if(opt.interleave > 1){
+
+		out << "Interleaving " << opt.interleave << " DFS cursors per thread." << endl;
+
+		//about 64 subtrees per cursor
+		ctx.grain = std::max(uint64_t(1), ctx.n/(uint64_t(opt.threads)*opt.interleave*64));
+
+		vector<subtree<typename bwt_t::sa_node_t> > subtrees;
+		vector<top_node<typename bwt_t::sa_node_t> > top;
+		vector<subtree_result<typename bwt_t::sa_node_t> > results;
+
+		visit_top(ctx, bwt, x, subtrees, top, results, stats[0]);
+
+		std::atomic<uint64_t> next_subtree {0};
+
+		run_threads(opt.threads, [&](int w){ visit_interleaved(ctx, bwt, subtrees, results, next_subtree, stats[w]); });
+
+		rho = pay_top(ctx, top, results);
+
+	}else if(opt.threads == 1){
+
+		rho = process_node(ctx, bwt, x, tmp_covered_children, stats[0]);
+
+	}else{
+
+		//about 256 tasks per thread: enough to balance the load, few enough to keep the pool overhead negligible
+		ctx.grain = std::max(uint64_t(1), ctx.n/(uint64_t(opt.threads)*256));
+
+		work_stealing_pool pool(opt.threads);
+		pool.run([&](){ rho = process_node_par(ctx, bwt, x, tmp_covered_children, pool, stats); });
+
+	}
+
+	if(reporter) reporter->stop();
+
+	depth_histogram hist;
+
+	for(auto & st : stats){
+
+		s.nodes += st.nodes;
+		s.wl_leaves += st.wl_leaves;
+		s.max_rec_depth = std::max(s.max_rec_depth, st.max_rec_depth);
+		hist.merge(st.hist);
+
+	}
+
+	s.rho = rho;
+	s.r = bwt.r();
+
+	compute_measures(ctx, hist, s);
+
+	if(ctx.suffixient){
+
+		out << "Writing the suffixient set to " << opt.output_suffixient << " ... " << endl;
+
+		s.suffixient = ctx.suffixient->close();
+		ctx.suffixient.reset();
+
+		out << "Suffixient set: " << s.suffixient << " distinct BWT positions." << endl;
+
+		if(opt.sa_rate > 0){
+
+			out << "Sampling the suffix array (rate " << opt.sa_rate << ") ... " << endl;
+
+			sa_sample<bwt_t> sa(bwt, opt.sa_rate);
+
+			out << "Done. " << sa.samples() << " samples (" << sa.bytes() << " bytes). Locating the suffixient set ... " << endl;
+
+			vector<uint64_t> pos = sa.locate(load_suffixient_set(opt.output_suffixient), opt.threads);
+			std::sort(pos.begin(), pos.end());
+
+			elias_fano_writer ef(opt.output_suffixient, ctx.n, pos.size());
+			for(auto p : pos) ef.add(p);
+			ef.close();
+
+			out << "Suffixient set written in text coordinates." << endl;
+
+		}
+
+	}
+
+	return s;
+
+}
+
+struct rho_context::index{
+
+	virtual ~index(){}
+
+	virtual rho_stats navigate(const rho_options& opt) = 0;
+
+	virtual uint64_t count(string P) = 0;
+	virtual uint64_t size() = 0;
+	virtual uint64_t r() = 0;
+	virtual uint64_t bytes() = 0;
+
+};
+
+/*
+ * index of a rho_context, in the representation bwt_t
+ */
+template<class bwt_t>
+struct bwt_index : rho_context::index{
+
+	/*
+	 * load or build the index described by opt (its representation is opt.backend). pfp is the prefix-free parsing
+	 * of opt.input_fasta, if given. The terminator of a loaded index is stored into opt
+	 */
+	bwt_index(rho_options& opt, std::unique_ptr<pfp_bwt>& pfp){
+
+		std::ostream & out = log_out(opt);
+
+		if(opt.input_index.size()>0){
+
+			out << "Input index file: " << opt.input_index << endl;
+
+			if(opt.verify_index) out << "Verifying the checksum of the whole index file ... " << endl;
+
+			if(opt.mem_limit > 0){
+
+				out << "Semi-external mode: " << opt.mem_limit/(uint64_t(1)<<20) << " MB for the cache of the BWT blocks and for the traversal." << endl;
+				page_from_file(bwt, opt);
+
+			}else{
+
+				bwt.map_from_file(opt.input_index, opt.verify_index);
+
+			}
+
+			opt.terminator = bwt.terminator();
+
+		}else{
+
+			if(pfp){
+
+				out << "Indexing the BWT of " << opt.input_fasta << " ... " << endl;
+
+				build_from_parse(bwt, *pfp, opt);
+				pfp.reset();
+
+			}else{
+
+				out << "Input BWT file: " << opt.input_bwt << endl;
+
+				out << "Loading and indexing BWT ... " << endl;
+
+				bwt = bwt_t(opt.input_bwt, opt.terminator, opt.threads);
+
+			}
+
+			if(opt.output_index.size()>0){
+
+				out << "Storing the index to " << opt.output_index << " ... " << endl;
+				bwt.save_to_file(opt.output_index);
+
+			}
+
+		}
+
+		out << "Done. Size of BWT: " << bwt.size() << endl;
+
+		auto root = bwt.root();
+		out << "Number of terminators (strings of the collection): " << root.bounds[1] - root.bounds[0] << endl;
+
+		out << "BWT representation: " << opt.backend << " (" << bwt.bytes() << " bytes)" << endl;
+
+		if(opt.backend == "plain") out << "In-block rank kernel: " << block_rank_kernel().name << endl;
+		if(opt.backend == "2bit") out << "In-block rank kernel: " << block_rank2_kernel().name << endl;
+		if(opt.backend == "byte") out << "In-block rank kernel: " << block_rank1_kernel().name << endl;
+
+		print_alphabet(bwt, out);
+
+	}
+
+	rho_stats navigate(const rho_options& opt){
+		return ::navigate(bwt, opt);
+	}
+
+	uint64_t count(string P){
+		return bwt.count(P);
+	}
+
+	uint64_t size(){
+		return bwt.size();
+	}
+
+	uint64_t r(){
+		return bwt.r();
+	}
+
+	uint64_t bytes(){
+		return bwt.bytes();
+	}
+
+	bwt_t bwt;
+
+};
+
+std::string check_options(rho_options& opt){
+
+	if(opt.input_bwt.size()==0 and opt.input_index.size()==0 and opt.input_fasta.size()==0)
+		return "no input: one of -i, -f and -l is required";
+
+	if(opt.input_index.size()>0 and (opt.input_bwt.size()>0 or opt.input_fasta.size()>0 or opt.output_index.size()>0))
+		return "option -l cannot be combined with -i, -f or -s";
+
+	if(opt.input_bwt.size()>0 and opt.input_fasta.size()>0)
+		return "options -i and -f cannot be combined";
+
+	if(opt.threads < 1)
+		return "invalid number of threads " + std::to_string(opt.threads);
+
+	if(opt.interleave < 1)
+		return "invalid interleaving width " + std::to_string(opt.interleave);
+
+	if(opt.sa_rate > 0 and opt.output_suffixient.size()==0)
+		return "option -a requires -o";
+
+	if(opt.engine != "dfs" and opt.engine != "bfs")
+		return "unknown traversal engine " + opt.engine + " (-e): use dfs or bfs";
+
+	//the payments of the level-synchronous traversal only know the right-extensions of the nodes, not their intervals
+	if(opt.engine == "bfs" and (opt.output_suffixient.size()>0 or opt.interleave > 1))
+		return "options -o and -k are not available with -e bfs";
+
+	if(opt.mem_limit > 0){
+
+		if(opt.input_index.size()==0)
+			return "option --mem-limit requires an index file (-l)";
+
+		if(opt.mem_limit < 2*BLOCK_CACHE_PAGE)
+			return "the memory limit must be at least " + std::to_string(2*BLOCK_CACHE_PAGE/1024) + "K";
+
+		//the blocks on disk are read in the order of the sorted queries of the level-synchronous traversal
+		opt.engine = "bfs";
+
+		if(opt.output_suffixient.size()>0 or opt.interleave > 1)
+			return "options -o and -k are not available with --mem-limit";
+
+	}
+
+	if(opt.verify_index and opt.input_index.size()==0)
+		return "option --verify requires an index file (-l)";
+
+	if(opt.checkpoint_path.size()==0 and opt.resume)
+		return "option --resume requires --checkpoint";
+
+	if(opt.checkpoint_every <= 0)
+		return "invalid checkpoint interval " + std::to_string(opt.checkpoint_every) + " (--every)";
+
+	//suffixient positions are written during the visit, and the other traversals have no state between subtrees
+	if(opt.checkpoint_path.size()>0 and (opt.output_suffixient.size()>0 or opt.interleave > 1 or opt.engine == "bfs"))
+		return "options -o, -k, -e bfs and --mem-limit are not available with --checkpoint";
+
+	if(opt.backend != "auto" and opt.backend != "plain" and opt.backend != "2bit" and opt.backend != "rle" and opt.backend != "byte")
+		return "unknown BWT representation " + opt.backend;
+
+	if(opt.input_fasta.size()>0 and opt.backend != "auto" and opt.backend != "plain" and opt.backend != "2bit")
+		return "option -f builds only the plain and 2bit representations of the BWT";
+
+	return "";
+
+}
+
+rho_context::rho_context(rho_options options) : opt(options){
+
+	string error = check_options(opt);
+
+	if(error.size()>0){
+
+		throw make_error(error);
+
+	}
+
+	std::ostream & out = log_out(opt);
+
+	//number of letters of the BWT (byte representation)
+	uint64_t sigma = 0;
+
+	if(opt.input_index.size()>0){
+
+		//the representation of a stored index is the one it was built with
+		uint64_t type = index_string_type(opt.input_index);
+
+		if(type == rle_string_n::type_id()) opt.backend = "rle";
+		else if(type == dna_string::type_id()) opt.backend = "2bit";
+		else if(type == byte_string::type_id()) opt.backend = "byte";
+		else opt.backend = "plain";
+
+		if(opt.backend == "byte") sigma = index_alphabet_size(opt.input_index);
+
+	}else if(opt.input_bwt.size()>0 and (opt.backend == "auto" or opt.backend == "byte")){
+
+		std::array<uint64_t, 256> counts = char_counts(opt.input_bwt);
+
+		bool containsN = counts['N'] > 0;
+		bool dna = true;
+
+		for(int c=0;c<256;++c){
+
+			if(counts[c] == 0 or c == uint8_t(opt.terminator)) continue;
+
+			sigma++;
+			dna = dna and (c == 'A' or c == 'C' or c == 'G' or c == 'N' or c == 'T');
+
+		}
+
+		if(counts[uint8_t(opt.terminator)] == 0)
+			cout << "Warning: the terminator (ASCII code " << int(uint8_t(opt.terminator)) << ") does not occur in the BWT (see option -t)." << endl;
+
+		//N-free DNA BWTs (the common case) use the 2-bit alphabet and the 4-letter nodes
+		if(opt.backend == "auto") opt.backend = not dna ? "byte" : (containsN ? "plain" : "2bit");
+
+	}
+
+	char TERM = opt.terminator;
+
+	if(opt.backend != "byte" and (TERM == 'A' or TERM == 'C' or TERM == 'G' or TERM == 'T' or TERM == 'N')){
+
+		throw make_error("invalid terminator '", TERM, "'");
+
+	}
+
+	if(sigma > 255){
+
+		throw make_error("the BWT contains all the 256 bytes: one of them must be the terminator (see option -t).");
+
+	}
+
+	std::unique_ptr<pfp_bwt> pfp; //prefix-free parsing of opt.input_fasta
+
+	if(opt.input_fasta.size()>0){
+
+		out << "Input FASTA file: " << opt.input_fasta << endl;
+		out << "Building the BWT by prefix-free parsing ... " << endl;
+
+		pfp = std::unique_ptr<pfp_bwt>(new pfp_bwt(opt.input_fasta, TERM, opt.threads));
+
+		out << "Sequences: " << pfp->sequences() << ". Parse: " << pfp->parse_length() << " phrases. Dictionary: " << pfp->dictionary_phrases() << " phrases, " << pfp->dictionary_length() << " characters." << endl;
+
+		//the representation is chosen as for an input BWT (the parse knows whether the sequences contain N)
+		if(opt.backend == "auto") opt.backend = pfp->contains_N() ? "plain" : "2bit";
+
+	}
+
+	//the smallest node type that fits the alphabet
+	if(opt.backend == "byte"){
+
+		if(sigma <= 31) idx.reset(new bwt_index<byte_bwt_31_t>(opt, pfp));
+		else if(sigma <= 127) idx.reset(new bwt_index<byte_bwt_127_t>(opt, pfp));
+		else idx.reset(new bwt_index<byte_bwt_255_t>(opt, pfp));
+
+	}else if(opt.backend == "rle") idx.reset(new bwt_index<rle_bwt_n_t>(opt, pfp));
+	else if(opt.backend == "2bit") idx.reset(new bwt_index<dna_bwt_t>(opt, pfp));
+	else idx.reset(new bwt_index<dna_bwt_n_t>(opt, pfp));
+
+}
+
+rho_context::~rho_context(){}
+
+rho_stats rho_context::compute_rho(){
+
+	return idx->navigate(opt);
+
+}
+
+rho_stats rho_context::compute_rho(rho_options job){
+
+	//the input is the one of the context
+	job.input_bwt = opt.input_bwt;
+	job.input_fasta = opt.input_fasta;
+	job.input_index = opt.input_index;
+	job.output_index = "";
+	job.backend = opt.backend;
+	job.terminator = opt.terminator;
+	job.mem_limit = opt.mem_limit;
+
+	string error = check_options(job);
+
+	if(error.size()>0){
+
+		throw make_error(error);
+
+	}
+
+	return idx->navigate(job);
+
+}
+
+uint64_t rho_context::count(std::string P){
+	return idx->count(P);
+}
+
+uint64_t rho_context::size(){
+	return idx->size();
+}
+
+uint64_t rho_context::r(){
+	return idx->r();
+}
+
+uint64_t rho_context::bytes(){
+	return idx->bytes();
+}
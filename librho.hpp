@@ -0,0 +1,130 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * librho.hpp
+ *
+ *  Library interface of rho (target librho). A rho_context holds the index of one BWT (indexed from a BWT file,
+ *  built from a FASTA file or loaded from an index file) and the options of the computation; compute_rho()
+ *  navigates the Weiner tree and returns rho and the other measures in a rho_stats. The state of a navigation
+ *  (counters, flags, output files) is local to the call: several contexts, and several calls on the same context,
+ *  can run at the same time in one process. The rho executable (rho.cpp) is a wrapper around this interface.
+ *
+ *  Errors (invalid options, unreadable files, invalid indexes, ...) are reported by throwing std::runtime_error, whose
+ *  message is that printed by the executable after "Error: ". check_options validates the options beforehand.
+ *
+ */
+
+#ifndef LIBRHO_HPP_
+#define LIBRHO_HPP_
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+struct rho_options{
+
+	std::string input_bwt;			//BWT file (-i)
+	std::string input_fasta;		//FASTA file, whose BWT is built by prefix-free parsing (-f)
+	std::string input_index;		//index file, memory-mapped (-l)
+	bool verify_index = false;		//with -l: verify the checksum of the whole index file, blocks included (--verify)
+	std::string output_index;		//store the index to this file (-s)
+	std::string backend = "auto";	//representation of the BWT: plain, 2bit, rle, byte or auto (-b)
+	char terminator = '#';			//terminator of the input BWT (-t)
+
+	std::string output_suffixient;	//write the suffixient set to this file (-o)
+	uint64_t sa_rate = 0;			//if > 0, the suffixient set is written in text coordinates (-a)
+	std::string output_histogram;	//write the histogram of the lengths of the right-maximal substrings (-d)
+
+	int threads = 1;				//-p
+	int interleave = 1;				//DFS cursors per thread (-k)
+	std::string engine = "dfs";		//traversal: dfs or bfs (-e)
+	uint64_t mem_limit = 0;			//if > 0, semi-external mode (--mem-limit)
+
+	std::string checkpoint_path;	//--checkpoint
+	double checkpoint_every = 600;	//--every
+	bool resume = false;			//--resume
+
+	bool quiet = false;				//no progress report (-q)
+	bool verbose = true;			//print the steps of the computation
+
+};
+
+struct rho_stats{
+
+	uint64_t n = 0;					//BWT length
+	uint64_t terminators = 0;		//strings of the collection
+	uint64_t rho = 0;
+	uint64_t r = 0;					//BWT runs
+
+	uint64_t nodes = 0;				//visited nodes: right-maximal substrings
+	uint64_t wl_leaves = 0;			//Weiner tree leaves
+	uint64_t max_length = 0;		//of a right-maximal substring
+
+	double delta = 0;				//max_k d_k/k
+	uint64_t delta_k = 0;			//k of the maximum
+	bool delta_exact = true;		//false for collections (several terminators): delta is an upper bound
+
+	uint64_t max_rec_depth = 0;		//dfs
+	uint64_t levels = 0;			//bfs: levels of the Weiner tree
+	uint64_t pages_read = 0;		//semi-external mode: pages of the index read from disk
+	uint64_t checkpoints = 0;		//checkpoints written
+	uint64_t suffixient = 0;		//distinct positions of the suffixient set, if written
+
+};
+
+/*
+ * validate the options, and complete them (--mem-limit implies -e bfs). Returns an error message, empty if the
+ * options are valid
+ */
+std::string check_options(rho_options& opt);
+
+class rho_context{
+
+public:
+
+	/*
+	 * build, or load, the index described by opt
+	 */
+	rho_context(rho_options opt);
+	~rho_context();
+
+	rho_context(const rho_context&) = delete;
+	rho_context& operator=(const rho_context&) = delete;
+
+	/*
+	 * navigate the Weiner tree of the index with the options of the context. Thread-safe
+	 */
+	rho_stats compute_rho();
+
+	/*
+	 * same, with the options of the navigation (threads, engine, outputs, checkpoints, ...) taken from opt; those of
+	 * the input are ignored. Thread-safe
+	 */
+	rho_stats compute_rho(rho_options opt);
+
+	const rho_options & options(){
+		return opt;
+	}
+
+	/*
+	 * number of occurrences of P in the text, by backward search (0 if P contains other letters than those of
+	 * the BWT). Thread-safe
+	 */
+	uint64_t count(std::string P);
+
+	uint64_t size();		//BWT length
+	uint64_t r();			//BWT runs
+	uint64_t bytes();		//of the index
+
+	struct index;			//the BWT, in the representation chosen by the options
+
+private:
+
+	rho_options opt;
+	std::unique_ptr<index> idx;
+
+};
+
+#endif /* LIBRHO_HPP_ */
@@ -3,229 +3,161 @@
 // by a MIT license that can be found in the LICENSE file.
 
 /*
+ * rho.cpp
+ *
+ *  Command line interface of librho (see librho.hpp): parses the options, builds or loads the index and prints
+ *  the measures computed by the navigation.
  *
  *  Created on: Dec 11, 2023
  *      Author: Nicola Prezza
  */
 
-
 #include <iostream>
-#include <unistd.h>
-#include "internal/dna_bwt_n.hpp"
-#include <stack>
-#include <algorithm>
-#include <sdsl/construct_bwt.hpp>
-#include <sdsl/suffix_arrays.hpp>
+#include <cstdlib>
+#include <stdexcept>
+#include <getopt.h>
+#include "librho.hpp"
 
 using namespace std;
-using namespace sdsl;
-
-string input_bwt;
-dna_bwt_n_t bwt;
-vector<bool> suffixient_bwt; //marks set of nexessary+suffixient BWT positions
 
-int_vector_buffer<> sa;
+//size in bytes, with an optional suffix K, M or G (powers of 1024)
+uint64_t parse_size(string s){
 
-bool containsN = false;
-uint64_t nodes=0; // number of visited nodes
+	char* end = NULL;
+	uint64_t x = strtoull(s.c_str(), &end, 10);
 
-uint64_t wl_leaves=0; // number of Weiner tree leaves
-
-int last_perc = -1;
-int perc = 0;
-uint64_t n=0;
+	switch(*end){
+		case 'K': case 'k': x <<= 10; break;
+		case 'M': case 'm': x <<= 20; break;
+		case 'G': case 'g': x <<= 30; break;
+	}
 
-uint64_t rec_depth = 0;
-uint64_t max_rec_depth = 0;
+	return x;
 
-char TERM = '#';
+}
 
 void help(){
 
 	cout << "rho [options]" << endl <<
-	"Input: BWT of a DNA dataset (alphabet: A,C,G,T,N,#). Output: value of the rho repetitiveness measure and related statistics." << endl <<
+	"Input: BWT of a DNA dataset (alphabet: A,C,G,T,N,#) or, with the byte representation, of any dataset (proteins, text, ...)." << endl <<
+	"Output: value of the rho repetitiveness measure and, from the same traversal, r, delta and the number of right-maximal" << endl <<
+	"substrings." << endl <<
 	"Options:" << endl <<
-	"-i <arg>    Input BWT (REQUIRED)" << endl <<
-	"-t          ASCII code of the terminator. Default:" << int('#') << " (#). Cannot be the code for A,C,G,T,N." << endl;
+	"-i <arg>    Input BWT (REQUIRED, unless -l or -f is used)" << endl <<
+	"-f <arg>    Input FASTA file, instead of -i: the BWT of the collection of its sequences (one terminator per sequence," << endl <<
+	"            characters other than A,C,G,T become N) is built by prefix-free parsing and indexed as it is produced." << endl <<
+	"            Plain or 2bit representation." << endl <<
+	"-s <arg>    Store the index built from the input BWT to this file." << endl <<
+	"-l <arg>    Load (memory-map) the index from this file, created with -s, instead of indexing an input BWT." << endl <<
+	"-o <arg>    Write to this file the suffixient set: the BWT positions of the paid right-extensions (for each, the first" << endl <<
+	"            suffix prefixed by the extended string), as an Elias-Fano bitvector (see internal/suffixient_set.hpp)." << endl <<
+	"-a <arg>    With -o: write the suffixient set in text coordinates (the starting positions of those suffixes), located" << endl <<
+	"            with a sample of the suffix array taken every <arg> text positions (n bits + 64 bits per sample)." << endl <<
+	"-d <arg>    Write to this file the histogram of the lengths of the right-maximal substrings (nodes of the Weiner tree)." << endl <<
+	"-t          ASCII code of the terminator. Default:" << int('#') << " (#). Cannot be the code for A,C,G,T,N, except with -b byte." << endl <<
+	"            The BWT of a string collection has one terminator per string: all of them are the same letter, so no" << endl <<
+	"            context crosses the end of a string." << endl <<
+	"-p <arg>    Number of threads used to index the BWT and to navigate the Weiner tree. Default: 1." << endl <<
+	"-k <arg>    Interleave the DFS of <arg> independent subtrees per thread, prefetching the BWT blocks of all of them" << endl <<
+	"            before visiting any (hides memory latency on large inputs). Default: 1 (no interleaving)." << endl <<
+	"-e <arg>    Traversal of the Weiner tree: dfs (depth-first) or bfs (level by level: the rank queries of each level are" << endl <<
+	"            sorted and answered in one sweep over the BWT, and large levels are spilled to temporary files; for" << endl <<
+	"            indexes that do not fit in the cache, or in RAM when memory-mapped with -l). Default: dfs." << endl <<
+	"-b <arg>    Representation of the BWT: plain (4.38 bits per character), 2bit (2.67 bits per character, fastest; only" << endl <<
+	"            for BWTs without N), rle (run-length encoded: space proportional to the number of BWT runs, for very" << endl <<
+	"            repetitive inputs; built serially, -p does not speed up its construction), byte (wavelet matrix on the bytes of the BWT, for any alphabet of at most 255 letters:" << endl <<
+	"            proteins, text, ...), or auto (2bit if the BWT contains only A,C,G,T, plain if it also contains N, byte" << endl <<
+	"            otherwise). Default: auto." << endl <<
+	"-q          Quiet: do not report progress during the navigation of the Weiner tree." << endl <<
+	"--mem-limit <arg>  Semi-external mode, with -l: the blocks of the BWT are not loaded but read from the index file" << endl <<
+	"            through a cache, and the Weiner tree is navigated by -e bfs; the cache and the traversal use at most" << endl <<
+	"            about <arg> bytes (suffixes K, M, G accepted). The index must have the plain representation (-b plain)." << endl <<
+	"--verify    With -l: verify the checksum of the whole index file (blocks included), which reads it once. By" << endl <<
+	"            default only the metadata of the index are verified, in negligible time." << endl <<
+	"--checkpoint <arg>  Save the state of the navigation (subtrees visited, their cost and covered right-extensions," << endl <<
+	"            counters) to this file at regular intervals, so that an interrupted run can be resumed. The file is" << endl <<
+	"            removed when the navigation completes." << endl <<
+	"--every <arg>  With --checkpoint: seconds between two checkpoints. Default: 600." << endl <<
+	"--resume    With --checkpoint: continue the navigation from the checkpoint file (same index, any -p). The result" << endl <<
+	"            is identical to that of an uninterrupted run." << endl;
 	exit(0);
 }
 
-//recursively processes node and return cost of its subtree, i.e. total number of 
-//right-extensions that we pay
-uint64_t process_node(	typename dna_bwt_n_t::sa_node_t& x, 
-						//The function "process_node" will add (OR) to this flag the 
-						//right-extensions that are covered on node x
-						flags& covered_from_wchildren
-						){ 
-
-	rec_depth++;
-	max_rec_depth = std::max(max_rec_depth,rec_depth);
-
-	uint64_t rho = 0;
-
-	//we recurse on all but the last child of x. On the last child, we cycle in this while loop, 
-	//replacing x with its last child. Since we process recursively children in decreasing order of
-	//BWT interval length, this guarantees that the recursion depth is logarithmic.
-	while(true){
-
-		nodes++;
-		perc = (100*nodes)/n;
-
-		if(perc > last_perc){
-
-			cout << perc << "%." << endl;
-			last_perc = perc;
-
-		}
-
-		//get (right-maximal) children of x in the Weiner tree
-		int t = 0;
-		auto children = vector<typename dna_bwt_n_t::sa_node_t>(5); 
-		bwt.get_weiner_children(x, children, t);
-
-		if(t==0){ 
-
-			// no children in the Weiner tree: pay all the right extensions of string(x)
-
-			wl_leaves++;
-
-			rho += has_right_ext_TERM(x);
-			rho += has_right_ext_A(x);
-			rho += has_right_ext_C(x);
-			rho += has_right_ext_G(x);
-			rho += has_right_ext_N(x);
-			rho += has_right_ext_T(x);
-
-			covered_from_wchildren.TM |= has_right_ext_TERM(x);
-			covered_from_wchildren.A  |= has_right_ext_A(x);
-			covered_from_wchildren.C  |= has_right_ext_C(x);
-			covered_from_wchildren.G  |= has_right_ext_G(x);
-			covered_from_wchildren.N  |= has_right_ext_N(x);
-			covered_from_wchildren.T  |= has_right_ext_T(x);
-
-			break;
-
-		}else{
-
-			flags tmp_covered_children {false,false,false,false,false,false};
-
-			//scan all children but the last
-			for(int i=0;i<t-1;++i)
-				rho += process_node(children[i],tmp_covered_children);
-			
-
-			if(	has_right_ext_TERM(x) and 
-				(not tmp_covered_children.TM) and 
-				not has_right_ext_TERM(children[t-1])){
-
-				//TERM has to be covered on node x
-				covered_from_wchildren.TM = true;
-				rho++;
-
-			}
-
-			if(	has_right_ext_A(x) and 
-				(not tmp_covered_children.A) and 
-				not has_right_ext_A(children[t-1])){
-
-				//A has to be covered on node x
-				covered_from_wchildren.A = true;
-				rho++;
-
-			}
-
-			if(	has_right_ext_C(x) and 
-				(not tmp_covered_children.C) and 
-				not has_right_ext_C(children[t-1])){
-
-				//C has to be covered on node x
-				covered_from_wchildren.C = true;
-				rho++;
-
-			}
-
-			if(	has_right_ext_G(x) and 
-				(not tmp_covered_children.G) and 
-				not has_right_ext_G(children[t-1])){
-
-				//G has to be covered on node x
-				covered_from_wchildren.G = true;
-				rho++;
-
-			}
-
-			if(	has_right_ext_N(x) and 
-				(not tmp_covered_children.N) and 
-				not has_right_ext_N(children[t-1])){
-
-				//N has to be covered on node x
-				covered_from_wchildren.N = true;
-				rho++;
-
-			}
-
-			if(	has_right_ext_T(x) and 
-				(not tmp_covered_children.T) and 
-				not has_right_ext_T(children[t-1])){
-
-				//T has to be covered on node x
-				covered_from_wchildren.T = true;
-				rho++;
-
-			}
-
-			x = children[t-1];
-
-		}
-	
-	}
-
-	rec_depth--;
-	return rho;
-
-}
-
-//input: string s, not containing 0 symbol
-//output: BWT of s
-string build_bwt(string& s){
-
-	cache_config cc;
-	int_vector<8> text(s.size());
-
-	for(uint64_t i=0;i<s.size();++i) text[i] = (uint8_t)s[i];
-	
-	append_zero_symbol(text);
-	store_to_cache(text, conf::KEY_TEXT, cc);
-	construct_sa<8>(cc);
-	sa = int_vector_buffer<>(cache_file_name(conf::KEY_SA, cc));
-
-	string bwt(s.size()+1,0);
-
-	for(uint64_t i = 0;i<s.size()+1;++i) bwt[i] = sa[i]==0 ? '#' : s[sa[i]-1];
-
-	sdsl::remove(cache_file_name(conf::KEY_TEXT, cc));
-	sdsl::remove(cache_file_name(conf::KEY_SA, cc));
-	sdsl::remove(cache_file_name(conf::KEY_BWT, cc));
-
-	return bwt;
-
-}
-
 int main(int argc, char** argv){
 
 	if(argc < 3) help();
 
-	int opt;
-	while ((opt = getopt(argc, argv, "hi:o:l:t:")) != -1){
-		switch (opt){
+	rho_options opt;
+
+	//long options without a short form are given codes above 255
+	static struct option long_options[] = {
+		{"mem-limit", required_argument, NULL, 256},
+		{"checkpoint", required_argument, NULL, 257},
+		{"every", required_argument, NULL, 258},
+		{"resume", no_argument, NULL, 259},
+		{"verify", no_argument, NULL, 260},
+		{NULL, 0, NULL, 0}
+	};
+
+	int c;
+	while ((c = getopt_long(argc, argv, "hi:f:o:a:d:l:s:t:p:k:e:qb:", long_options, NULL)) != -1){
+		switch (c){
 			case 'h':
 				help();
 			break;
 			case 'i':
-				input_bwt = string(optarg);
+				opt.input_bwt = string(optarg);
+			break;
+			case 'f':
+				opt.input_fasta = string(optarg);
+			break;
+			case 'l':
+				opt.input_index = string(optarg);
+			break;
+			case 's':
+				opt.output_index = string(optarg);
+			break;
+			case 'o':
+				opt.output_suffixient = string(optarg);
+			break;
+			case 'a':
+				opt.sa_rate = atoll(optarg);
+			break;
+			case 'd':
+				opt.output_histogram = string(optarg);
 			break;
 			case 't':
-				TERM = atoi(optarg);
+				opt.terminator = atoi(optarg);
+			break;
+			case 'p':
+				opt.threads = atoi(optarg);
+			break;
+			case 'k':
+				opt.interleave = atoi(optarg);
+			break;
+			case 'e':
+				opt.engine = string(optarg);
+			break;
+			case 'q':
+				opt.quiet = true;
+			break;
+			case 'b':
+				opt.backend = string(optarg);
+			break;
+			case 256:
+				opt.mem_limit = parse_size(optarg);
+			break;
+			case 257:
+				opt.checkpoint_path = string(optarg);
+			break;
+			case 258:
+				opt.checkpoint_every = atof(optarg);
+			break;
+			case 259:
+				opt.resume = true;
+			break;
+			case 260:
+				opt.verify_index = true;
 			break;
 			default:
 				help();
@@ -233,39 +165,39 @@ int main(int argc, char** argv){
 		}
 	}
 
-	if(TERM == 'A' or TERM == 'C' or TERM == 'G' or TERM == 'T' or TERM == 'N'){
-
-		cout << "Error: invalid terminator '" << TERM << "'" << endl;
-		help();
-
-	}
+	if(opt.input_bwt.size()==0 and opt.input_index.size()==0 and opt.input_fasta.size()==0) help();
 
-	if(input_bwt.size()==0) help();
+	string error = check_options(opt);
 
-	cout << "Input BWT file: " << input_bwt << endl;
+	if(error.size()>0){
 
-	cout << "Loading and indexing BWT ... " << endl;
+		cout << "Error: " << error << endl;
+		help();
 
-	bwt = dna_bwt_n_t(input_bwt, TERM);
+	}
 
-	n = bwt.size();
+	std::unique_ptr<rho_context> ctx;
+	rho_stats s;
 
-	cout << "Done. Size of BWT: " << n << endl;
+	//the library reports invalid inputs and I/O errors by exceptions
+	try{
 
-	//navigate suffix link tree
+		ctx = std::unique_ptr<rho_context>(new rho_context(opt));
+		s = ctx->compute_rho();
 
-	cout << "Starting DFS navigation of the Weiner tree." << endl;
+	}catch(const std::exception & e){
 
-	auto x = bwt.root();
+		cout << "Error: " << e.what() << endl;
+		exit(1);
 
-	flags tmp_covered_children {false,false,false,false,false,false};
-	uint64_t rho = process_node(x, tmp_covered_children);
+	}
 
-	cout << "Processed " << nodes << " suffix tree nodes." << endl;
-	cout << "rho = " << rho << endl;
-	cout << "r = " << bwt.r() << endl;
-	cout << "Number of Weiner tree leaves: " << wl_leaves << endl;
-	cout << "Maximum recursion depth = " << max_rec_depth << endl;
+	cout << "Processed " << s.nodes << " suffix tree nodes." << endl;
+	cout << "rho = " << s.rho << endl;
+	cout << "r = " << s.r << endl;
+	cout << "Right-maximal substrings: " << s.nodes << " (maximum length " << s.max_length << ")" << endl;
+	cout << "delta " << (s.delta_exact ? "= " : "<= ") << std::fixed << s.delta << std::defaultfloat << " (d_k/k for k = " << s.delta_k << ")" << endl;
+	cout << "Number of Weiner tree leaves: " << s.wl_leaves << endl;
+	if(ctx->options().engine == "dfs") cout << "Maximum recursion depth = " << s.max_rec_depth << endl;
 
 }
-
@@ -0,0 +1,446 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * rho_bench.cpp
+ *
+ *  Microbenchmarks of the primitives of dna_string_n and dna_bwt_n (operator[], parallel_rank,
+ *  LF(range_t), LF(sa_node_n), get_weiner_children) on a synthetic random BWT, with random and
+ *  sequential access patterns. Reports ns/op and, when hardware performance counters are available
+ *  (Linux perf_event_open), last-level cache misses per op. Results are printed as JSON.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "internal/dna_bwt_n.hpp"
+
+using namespace std;
+
+uint64_t n = 100000000;		//BWT length
+double n_density = 0.001;	//fraction of N characters
+uint64_t ops = 10000000;	//operations per benchmark
+uint64_t max_nodes = 1000000;	//distinct suffix tree nodes used by the node benchmarks
+uint64_t seed = 42;
+int threads = 1;			//used to build the index
+string tmp_dir = "/tmp";
+string output;				//JSON output file (default: standard output)
+
+void help(){
+
+	cout << "rho_bench [options]" << endl <<
+	"Benchmarks the primitives of the BWT index on a random DNA BWT. Output: JSON." << endl <<
+	"Options:" << endl <<
+	"-n <arg>    Length of the synthetic BWT. Default: " << n << "." << endl <<
+	"-N <arg>    Fraction of N characters in the BWT. Default: " << n_density << "." << endl <<
+	"-q <arg>    Number of operations per benchmark. Default: " << ops << "." << endl <<
+	"-r <arg>    Random seed. Default: " << seed << "." << endl <<
+	"-p <arg>    Number of threads used to build the index. Default: " << threads << "." << endl <<
+	"-d <arg>    Directory where the synthetic BWT is written (and then deleted). Default: " << tmp_dir << "." << endl <<
+	"-o <arg>    Write the JSON results to this file instead of the standard output." << endl;
+	exit(0);
+}
+
+/*
+ * last-level cache misses of this thread, through perf_event_open. If the counter cannot be
+ * opened (not Linux, no permission, virtual machine without PMU) available() is false.
+ */
+class cache_miss_counter{
+
+public:
+
+	cache_miss_counter(){
+
+		struct perf_event_attr pe = {};
+
+		pe.type = PERF_TYPE_HARDWARE;
+		pe.size = sizeof(pe);
+		pe.config = PERF_COUNT_HW_CACHE_MISSES;
+		pe.disabled = 1;
+		pe.exclude_kernel = 1;
+		pe.exclude_hv = 1;
+
+		fd = int(syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0));
+
+	}
+
+	~cache_miss_counter(){
+
+		if(fd >= 0) close(fd);
+
+	}
+
+	bool available(){
+		return fd >= 0;
+	}
+
+	void start(){
+
+		if(fd < 0) return;
+
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+	}
+
+	uint64_t stop(){
+
+		if(fd < 0) return 0;
+
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+		uint64_t count = 0;
+		if(read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+
+		return count;
+
+	}
+
+private:
+
+	int fd = -1;
+
+};
+
+struct bench_result{
+
+	string name;
+	string access;
+	uint64_t ops;
+	double ns_per_op;
+	double misses_per_op; //negative if not available
+
+};
+
+cache_miss_counter misses;
+vector<bench_result> results;
+
+//the checksums of all benchmarks are printed, so that the compiler cannot drop the work
+uint64_t sink = 0;
+
+/*
+ * run body (which performs n_ops operations and returns a checksum of their results) and record its cost
+ */
+template<class F>
+void measure(string name, string access, uint64_t n_ops, F body){
+
+	cerr << "Running " << name << " (" << access << ") ... " << flush;
+
+	misses.start();
+	auto t0 = chrono::steady_clock::now();
+
+	sink += body();
+
+	auto t1 = chrono::steady_clock::now();
+	uint64_t miss = misses.stop();
+
+	double ns = chrono::duration<double, nano>(t1 - t0).count();
+
+	bench_result r {name, access, n_ops, ns/n_ops, misses.available() ? double(miss)/n_ops : -1};
+	results.push_back(r);
+
+	cerr << r.ns_per_op << " ns/op" << endl;
+
+}
+
+/*
+ * random BWT with one terminator: each other character is N with probability n_density,
+ * otherwise A,C,G,T uniformly
+ */
+void write_random_bwt(string path){
+
+	mt19937_64 gen(seed);
+	uniform_real_distribution<double> coin(0,1);
+
+	const char dna[4] = {'A','C','G','T'};
+
+	uint64_t term_pos = gen()%n;
+
+	ofstream out(path, ios::binary);
+
+	if(not out.good()){
+
+		cout << "Error: cannot write " << path << endl;
+		exit(1);
+
+	}
+
+	string buf;
+	const uint64_t BUF_SIZE = 1<<20;
+
+	for(uint64_t i=0;i<n;++i){
+
+		if(i == term_pos) buf.push_back('#');
+		else if(coin(gen) < n_density) buf.push_back('N');
+		else buf.push_back(dna[gen()%4]);
+
+		if(buf.size() == BUF_SIZE or i == n-1){
+
+			out.write(buf.data(), buf.size());
+			buf.clear();
+
+		}
+
+	}
+
+}
+
+/*
+ * up to max_nodes right-maximal nodes, in breadth-first order from the root
+ */
+vector<sa_node_n> collect_nodes(dna_bwt_n_t & bwt){
+
+	vector<sa_node_n> nodes {bwt.root()};
+	sa_node_n children[5];
+
+	for(uint64_t i=0;i<nodes.size() and nodes.size()<max_nodes;++i){
+
+		int t = 0;
+		bwt.get_weiner_children(nodes[i], children, t);
+
+		for(int j=0;j<t and nodes.size()<max_nodes;++j) nodes.push_back(children[j]);
+
+	}
+
+	return nodes;
+
+}
+
+void print_json(ostream & out){
+
+	out << "{" << endl;
+	out << "  \"n\": " << n << "," << endl;
+	out << "  \"n_density\": " << n_density << "," << endl;
+	out << "  \"ops\": " << ops << "," << endl;
+	out << "  \"seed\": " << seed << "," << endl;
+	out << "  \"rank_kernel\": \"" << block_rank_kernel().name << "\"," << endl;
+	out << "  \"perf_counters\": " << (misses.available() ? "true" : "false") << "," << endl;
+	out << "  \"checksum\": " << sink << "," << endl;
+	out << "  \"benchmarks\": [" << endl;
+
+	for(uint64_t i=0;i<results.size();++i){
+
+		auto & r = results[i];
+
+		out << "    {\"name\": \"" << r.name << "\", \"access\": \"" << r.access << "\", \"ops\": " << r.ops <<
+		", \"ns_per_op\": " << r.ns_per_op << ", \"cache_misses_per_op\": ";
+
+		if(r.misses_per_op >= 0) out << r.misses_per_op;
+		else out << "null";
+
+		out << "}" << (i+1 < results.size() ? "," : "") << endl;
+
+	}
+
+	out << "  ]" << endl;
+	out << "}" << endl;
+
+}
+
+int main(int argc, char** argv){
+
+	int opt;
+	while ((opt = getopt(argc, argv, "hn:N:q:r:p:d:o:")) != -1){
+		switch (opt){
+			case 'h':
+				help();
+			break;
+			case 'n':
+				n = strtoull(optarg, NULL, 10);
+			break;
+			case 'N':
+				n_density = atof(optarg);
+			break;
+			case 'q':
+				ops = strtoull(optarg, NULL, 10);
+			break;
+			case 'r':
+				seed = strtoull(optarg, NULL, 10);
+			break;
+			case 'p':
+				threads = atoi(optarg);
+			break;
+			case 'd':
+				tmp_dir = string(optarg);
+			break;
+			case 'o':
+				output = string(optarg);
+			break;
+			default:
+				help();
+			return -1;
+		}
+	}
+
+	if(n < 2 or ops == 0 or threads < 1 or n_density < 0 or n_density > 1){
+
+		cout << "Error: invalid arguments" << endl;
+		help();
+
+	}
+
+	string path = tmp_dir + "/rho_bench_" + to_string(getpid()) + ".bwt";
+
+	cerr << "Generating a random BWT of length " << n << " ... " << endl;
+	write_random_bwt(path);
+
+	cerr << "Indexing ... " << endl;
+	dna_bwt_n_t bwt(path, '#', threads);
+	std::remove(path.c_str());
+
+	if(not misses.available()) cerr << "Hardware performance counters not available: cache misses are not reported." << endl;
+
+	//query positions
+	mt19937_64 gen(seed+1);
+
+	vector<uint64_t> random_pos(ops);
+	for(auto & p : random_pos) p = gen()%n;
+
+	vector<range_t> random_ranges(ops);
+	vector<range_t> sequential_ranges(ops);
+
+	for(uint64_t i=0;i<ops;++i){
+
+		uint64_t len = gen()%256;
+		uint64_t l = gen()%(n-len);
+
+		random_ranges[i] = {l, l+len};
+
+		l = (i*64)%(n-len);
+		sequential_ranges[i] = {l, l+len};
+
+	}
+
+	vector<sa_node_n> nodes = collect_nodes(bwt);
+	vector<sa_node_n> sorted_nodes = nodes;
+
+	shuffle(nodes.begin(), nodes.end(), gen);
+	sort(sorted_nodes.begin(), sorted_nodes.end(), [](const sa_node_n & a, const sa_node_n & b){ return a.key() < b.key(); });
+
+	uint64_t m = nodes.size();
+
+	//operator[]
+
+	measure("access", "random", ops, [&](){
+
+		uint64_t s = 0;
+		for(uint64_t i=0;i<ops;++i) s += uint8_t(bwt[random_pos[i]]);
+		return s;
+
+	});
+
+	measure("access", "sequential", ops, [&](){
+
+		uint64_t s = 0;
+		for(uint64_t i=0;i<ops;++i) s += uint8_t(bwt[i%n]);
+		return s;
+
+	});
+
+	//parallel_rank
+
+	measure("parallel_rank", "random", ops, [&](){
+
+		uint64_t s = 0;
+		for(uint64_t i=0;i<ops;++i) s += bwt.parallel_rank(random_pos[i])[dna_n_alphabet::G];
+		return s;
+
+	});
+
+	measure("parallel_rank", "sequential", ops, [&](){
+
+		uint64_t s = 0;
+		for(uint64_t i=0;i<ops;++i) s += bwt.parallel_rank(i%n)[dna_n_alphabet::G];
+		return s;
+
+	});
+
+	//LF(range_t)
+
+	measure("LF_range", "random", ops, [&](){
+
+		uint64_t s = 0;
+		for(uint64_t i=0;i<ops;++i) s += bwt.LF(random_ranges[i])[dna_n_alphabet::C].second;
+		return s;
+
+	});
+
+	measure("LF_range", "sequential", ops, [&](){
+
+		uint64_t s = 0;
+		for(uint64_t i=0;i<ops;++i) s += bwt.LF(sequential_ranges[i])[dna_n_alphabet::C].second;
+		return s;
+
+	});
+
+	//LF(sa_node_n) and get_weiner_children, on random nodes and on nodes sorted by position
+
+	measure("LF_node", "random", ops, [&](){
+
+		uint64_t s = 0;
+		for(uint64_t i=0;i<ops;++i) s += bwt.LF(nodes[i%m])[dna_n_alphabet::G].last();
+		return s;
+
+	});
+
+	measure("LF_node", "sequential", ops, [&](){
+
+		uint64_t s = 0;
+		for(uint64_t i=0;i<ops;++i) s += bwt.LF(sorted_nodes[i%m])[dna_n_alphabet::G].last();
+		return s;
+
+	});
+
+	measure("get_weiner_children", "random", ops, [&](){
+
+		uint64_t s = 0;
+		sa_node_n children[5];
+
+		for(uint64_t i=0;i<ops;++i){
+
+			int t = 0;
+			bwt.get_weiner_children(nodes[i%m], children, t);
+			s += t;
+
+		}
+
+		return s;
+
+	});
+
+	measure("get_weiner_children", "sequential", ops, [&](){
+
+		uint64_t s = 0;
+		sa_node_n children[5];
+
+		for(uint64_t i=0;i<ops;++i){
+
+			int t = 0;
+			bwt.get_weiner_children(sorted_nodes[i%m], children, t);
+			s += t;
+
+		}
+
+		return s;
+
+	});
+
+	if(output.size() > 0){
+
+		ofstream out(output);
+		print_json(out);
+
+	}else{
+
+		print_json(cout);
+
+	}
+
+}
@@ -0,0 +1,641 @@
+// Copyright (c) 2023, Nicola Prezza.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ * rho_server.cpp
+ *
+ *  Resident server of librho: keeps the indexes it has loaded (index files built with rho -s, memory-mapped, so
+ *  their pages are also shared with the other processes mapping them) and serves requests on a Unix domain socket.
+ *  The latency of a job is then the time of its computation only, without loading or indexing the BWT.
+ *
+ *  Protocol: a client connects, writes one request (a line) and reads one response (a line), then the connection
+ *  is closed. Requests (fields separated by spaces, options as key=value):
+ *
+ *      rho <index> [p=<threads>] [k=<cursors>] [e=dfs|bfs]     rho, r, delta and the other measures
+ *      r <index>                                               number of BWT runs
+ *      count <index> <pattern>                                 occurrences of the pattern in the text
+ *      suffixient <index> <file> [a=<rate>] [p=<threads>]      write the suffixient set to file (as rho -o, -a), a
+ *                                                              relative path in the output directory (-o)
+ *      load <index>                                            load the index, without computing
+ *      status                                                  counters of the server
+ *      shutdown                                                stop accepting jobs, finish the queued ones, exit
+ *
+ *  Responses are "ok" followed by key=value fields, or "error <message>". The fields of every job include its
+ *  metrics: queue_ms (wait for a worker), load_ms (loading of the index, 0 if resident) and run_ms (computation).
+ *
+ *  Connections are queued (at most -Q; beyond, the client gets "error busy") and served by a fixed number of
+ *  workers (-j). A job uses at most -p threads. At most -m indexes are resident: loading one more evicts the least
+ *  recently used (the jobs running on it keep it until they end).
+ *
+ *  Created on: Dec 11, 2023
+ *      Author: Nicola Prezza
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "librho.hpp"
+
+using namespace std;
+
+string socket_path;
+
+int workers = 1;		//jobs running at the same time
+int max_threads = 1;	//threads of a job
+uint64_t max_queue = 64;	//connections waiting for a worker
+uint64_t max_indexes = 8;	//resident indexes
+
+bool quiet = false;		//no log of the jobs
+
+string output_dir;		//directory of the files written by the jobs (suffixient sets); none if empty
+
+//seconds given to a client to send its request
+const int REQUEST_TIMEOUT = 10;
+
+typedef std::chrono::steady_clock clock_type;
+
+//milliseconds since t
+inline double ms_since(clock_type::time_point t){
+	return std::chrono::duration<double, std::milli>(clock_type::now() - t).count();
+}
+
+/*
+ * resident index: loaded once, by the first job that needs it (the others wait for it)
+ */
+struct resident_index{
+
+	std::mutex mutex;
+	std::shared_ptr<rho_context> ctx;
+
+	uint64_t last_used = 0;	//tick of the last request on the index (protected by indexes_mutex)
+
+};
+
+std::mutex indexes_mutex;
+std::map<string, std::shared_ptr<resident_index> > indexes;
+uint64_t tick = 0;
+
+/*
+ * the index stored in path, loaded if it is not resident. load_ms = time spent loading it. Returns NULL (and an
+ * error message) if the index cannot be loaded: it is then not resident, and the next request tries again. The
+ * caller's reference keeps the index alive if it is evicted meanwhile
+ */
+std::shared_ptr<rho_context> get_index(string path, double & load_ms, string & error){
+
+	std::shared_ptr<resident_index> x;
+
+	{
+
+		std::lock_guard<std::mutex> lock(indexes_mutex);
+
+		auto & e = indexes[path];
+		if(not e) e = std::shared_ptr<resident_index>(new resident_index);
+
+		x = e;
+		x->last_used = ++tick;
+
+	}
+
+	std::lock_guard<std::mutex> lock(x->mutex);
+
+	load_ms = 0;
+
+	if(not x->ctx){
+
+		auto start = clock_type::now();
+
+		rho_options opt;
+		opt.input_index = path;
+		opt.quiet = true;
+		opt.verbose = false;
+
+		try{
+
+			x->ctx = std::shared_ptr<rho_context>(new rho_context(opt));
+
+		}catch(const std::exception & e){
+
+			std::lock_guard<std::mutex> lock(indexes_mutex);
+
+			auto it = indexes.find(path);
+			if(it != indexes.end() and it->second == x) indexes.erase(it);
+
+			error = e.what();
+			return NULL;
+
+		}
+
+		load_ms = ms_since(start);
+
+		//a new resident index: evict the least recently used ones beyond max_indexes (only once the load has
+		//succeeded, so that failing requests do not evict anything)
+		std::lock_guard<std::mutex> lock(indexes_mutex);
+
+		while(indexes.size() > max_indexes){
+
+			auto lru = indexes.begin();
+
+			for(auto it = indexes.begin(); it != indexes.end(); ++it)
+				if(it->second->last_used < lru->second->last_used) lru = it;
+
+			indexes.erase(lru);
+
+		}
+
+	}
+
+	return x->ctx;
+
+}
+
+//counters of the server (status request)
+struct server_counters{
+
+	std::atomic<uint64_t> jobs {0};		//served, including failed
+	std::atomic<uint64_t> failed {0};
+	std::atomic<uint64_t> rejected {0};	//queue full
+	std::atomic<uint64_t> run_us {0};	//total computation time
+
+} counters;
+
+//response to a failed request: "error" and the message, on one line
+string error_response(string message){
+
+	std::replace(message.begin(), message.end(), '\n', ' ');
+
+	return "error " + message;
+
+}
+
+/*
+ * value of option key=value of a request, an integer in [lo, hi]. Returns false if it is not one
+ */
+bool parse_option(string value, long long lo, long long hi, long long & x){
+
+	errno = 0;
+	char* end = NULL;
+
+	x = strtoll(value.c_str(), &end, 10);
+
+	return value.size() > 0 and *end == 0 and errno == 0 and x >= lo and x <= hi;
+
+}
+
+/*
+ * path of the output file named by a client: name must be relative and stay inside output_dir. Returns an empty
+ * string (and an error message) otherwise
+ */
+string output_path(string name, string & error){
+
+	if(output_dir.size() == 0){
+
+		error = "the server writes no files (no output directory, see -o)";
+		return "";
+
+	}
+
+	bool valid = name.size() > 0 and name[0] != '/';
+
+	//no component may be ".."
+	for(size_t from = 0; valid and from <= name.size();){
+
+		size_t to = std::min(name.find('/', from), name.size());
+
+		valid = name.compare(from, to - from, "..") != 0;
+		from = to + 1;
+
+	}
+
+	if(not valid){
+
+		error = "invalid output file " + name + " (a relative path without .. is required)";
+		return "";
+
+	}
+
+	return output_dir + "/" + name;
+
+}
+
+/*
+ * execute one request. Returns the response (without the final newline)
+ */
+string execute(string request, double queue_ms){
+
+	std::istringstream in(request);
+
+	string cmd;
+	in >> cmd;
+
+	vector<string> args;
+	std::map<string, string> kv;
+
+	for(string w; in >> w;){
+
+		size_t eq = w.find('=');
+
+		if(args.size() > 0 and eq != string::npos and eq > 0) kv[w.substr(0, eq)] = w.substr(eq + 1);
+		else args.push_back(w);
+
+	}
+
+	std::ostringstream out;
+	out.precision(3);
+	out << std::fixed;
+
+	if(cmd == "status"){
+
+		std::lock_guard<std::mutex> lock(indexes_mutex);
+
+		out << "ok jobs=" << counters.jobs << " failed=" << counters.failed << " rejected=" << counters.rejected << " run_ms=" << counters.run_us/1000 << " indexes=" << indexes.size() << "/" << max_indexes;
+		for(auto & e : indexes) out << " " << e.first;
+
+		return out.str();
+
+	}
+
+	if(cmd != "rho" and cmd != "r" and cmd != "count" and cmd != "suffixient" and cmd != "load") return "error unknown request " + cmd;
+
+	if(args.size() == 0) return "error missing index file";
+
+	size_t needed = cmd == "count" or cmd == "suffixient" ? 2 : 1;
+	if(args.size() != needed) return "error wrong number of arguments for " + cmd;
+
+	string error;
+	string output;
+
+	if(cmd == "suffixient"){
+
+		output = output_path(args[1], error);
+
+		if(output.size() == 0) return error_response(error);
+
+	}
+
+	double load_ms = 0;
+
+	std::shared_ptr<rho_context> ctx = get_index(args[0], load_ms, error);
+
+	if(ctx == NULL) return error_response(error);
+
+	rho_options job = ctx->options();
+	job.quiet = true;
+	job.verbose = false;
+	job.threads = 1;
+
+	//numeric options: threads (at most -p), DFS cursors per thread, SA sampling rate
+	long long x = 0;
+
+	if(kv.count("p")){
+
+		if(not parse_option(kv["p"], 1, max_threads, x)) return "error invalid option p=" + kv["p"] + " (1 to " + std::to_string(max_threads) + ")";
+		job.threads = int(x);
+
+	}
+
+	if(kv.count("k")){
+
+		if(not parse_option(kv["k"], 1, INT_MAX, x)) return "error invalid option k=" + kv["k"];
+		job.interleave = int(x);
+
+	}
+
+	if(kv.count("a")){
+
+		if(not parse_option(kv["a"], 0, LLONG_MAX, x)) return "error invalid option a=" + kv["a"];
+		job.sa_rate = uint64_t(x);
+
+	}
+
+	auto start = clock_type::now();
+
+	out << "ok";
+
+	//invalid options and I/O errors (e.g. an unwritable suffixient file) fail the job, not the server
+	try{
+
+		if(cmd == "rho" or cmd == "suffixient"){
+
+			if(kv.count("e")) job.engine = kv["e"];
+
+			if(cmd == "suffixient") job.output_suffixient = output;
+
+			rho_stats s = ctx->compute_rho(job);
+
+			out << " rho=" << s.rho << " r=" << s.r << " n=" << s.n << " nodes=" << s.nodes << " leaves=" << s.wl_leaves;
+			out << " delta=" << s.delta << " delta_k=" << s.delta_k << " delta_exact=" << s.delta_exact;
+
+			if(cmd == "suffixient") out << " positions=" << s.suffixient;
+
+		}else if(cmd == "r"){
+
+			out << " r=" << ctx->r();
+
+		}else if(cmd == "count"){
+
+			out << " count=" << ctx->count(args[1]);
+
+		}else{
+
+			out << " n=" << ctx->size() << " bytes=" << ctx->bytes();
+
+		}
+
+	}catch(const std::exception & e){
+
+		return error_response(e.what());
+
+	}
+
+	double run_ms = ms_since(start);
+	counters.run_us += uint64_t(run_ms*1000);
+
+	out << " queue_ms=" << queue_ms << " load_ms=" << load_ms << " run_ms=" << run_ms;
+
+	return out.str();
+
+}
+
+//connection accepted, waiting for a worker
+struct job_t{
+
+	int fd;
+	clock_type::time_point accepted;
+
+};
+
+std::mutex queue_mutex;
+std::condition_variable queue_cv;
+std::deque<job_t> queue;
+bool stopping = false;
+
+int listen_fd = -1;
+
+//read one line from fd (at most 64 KB)
+string read_line(int fd){
+
+	string line;
+	char c;
+
+	while(line.size() < 65536 and read(fd, &c, 1) == 1 and c != '\n') line.push_back(c);
+
+	if(line.size() > 0 and line.back() == '\r') line.pop_back();
+
+	return line;
+
+}
+
+void write_line(int fd, string line){
+
+	line.push_back('\n');
+
+	for(size_t done = 0; done < line.size();){
+
+		//MSG_NOSIGNAL: a client gone before its response must not kill the server with SIGPIPE
+		ssize_t w = send(fd, line.data() + done, line.size() - done, MSG_NOSIGNAL);
+		if(w <= 0) break;
+		done += w;
+
+	}
+
+}
+
+void worker(int id){
+
+	while(true){
+
+		job_t job;
+
+		{
+
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_cv.wait(lock, [](){ return stopping or not queue.empty(); });
+
+			if(queue.empty()) return;
+
+			job = queue.front();
+			queue.pop_front();
+
+		}
+
+		double queue_ms = ms_since(job.accepted);
+
+		string request = read_line(job.fd);
+		string response;
+
+		if(request == "shutdown"){
+
+			response = "ok";
+
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex);
+				stopping = true;
+			}
+
+			queue_cv.notify_all();
+
+			//wake up the acceptor
+			shutdown(listen_fd, SHUT_RDWR);
+
+		}else{
+
+			response = execute(request, queue_ms);
+
+		}
+
+		counters.jobs++;
+		if(response.compare(0, 5, "error") == 0) counters.failed++;
+
+		write_line(job.fd, response);
+		close(job.fd);
+
+		if(not quiet) cout << "[worker " << id << "] " << request << " -> " << response << endl;
+
+	}
+
+}
+
+void help(){
+
+	cout << "rho_server [options] [index files]" << endl <<
+	"Keeps indexes built with rho -s resident (memory-mapped) and serves requests on a Unix domain socket: rho, r," << endl <<
+	"count, suffixient, load, status, shutdown (protocol in rho_server.cpp). The index files given are loaded at start;" << endl <<
+	"the others are loaded by the first request using them." << endl <<
+	"Options:" << endl <<
+	"-s <arg>    Path of the socket (REQUIRED). An existing file at this path is replaced." << endl <<
+	"-j <arg>    Number of jobs running at the same time. Default: 1." << endl <<
+	"-p <arg>    Maximum number of threads of a job (requested with p=<threads>). Default: 1." << endl <<
+	"-Q <arg>    Maximum number of connections waiting for a job slot; beyond, requests are rejected. Default: 64." << endl <<
+	"-m <arg>    Maximum number of resident indexes; loading one more evicts the least recently used. Default: 8." << endl <<
+	"-o <arg>    Directory of the suffixient set files written by the jobs: a request names a relative path in it" << endl <<
+	"            (absolute paths and .. are rejected). Without -o, suffixient requests are refused." << endl <<
+	"-q          Quiet: do not log the jobs." << endl;
+	exit(0);
+}
+
+int main(int argc, char** argv){
+
+	if(argc < 3) help();
+
+	int opt;
+	while ((opt = getopt(argc, argv, "hs:j:p:Q:m:o:q")) != -1){
+		switch (opt){
+			case 'h':
+				help();
+			break;
+			case 's':
+				socket_path = string(optarg);
+			break;
+			case 'j':
+				workers = atoi(optarg);
+			break;
+			case 'p':
+				max_threads = atoi(optarg);
+			break;
+			case 'Q':
+				max_queue = atoll(optarg);
+			break;
+			case 'm':
+				max_indexes = atoll(optarg);
+			break;
+			case 'o':
+				output_dir = string(optarg);
+			break;
+			case 'q':
+				quiet = true;
+			break;
+			default:
+				help();
+			return -1;
+		}
+	}
+
+	if(socket_path.size()==0) help();
+
+	if(workers < 1 or max_threads < 1 or max_queue < 1 or max_indexes < 1){
+
+		cout << "Error: -j, -p, -Q and -m must be at least 1" << endl;
+		help();
+
+	}
+
+	struct stat st;
+
+	if(output_dir.size() > 0 and (stat(output_dir.c_str(), &st) != 0 or not S_ISDIR(st.st_mode))){
+
+		cout << "Error: output directory " << output_dir << " does not exist" << endl;
+		exit(1);
+
+	}
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if(socket_path.size() >= sizeof(addr.sun_path)){
+
+		cout << "Error: socket path too long: " << socket_path << endl;
+		exit(1);
+
+	}
+
+	strcpy(addr.sun_path, socket_path.c_str());
+
+	for(int i = optind; i < argc; ++i){
+
+		double load_ms = 0;
+		string error;
+
+		if(get_index(argv[i], load_ms, error) == NULL){
+
+			cout << "Error: " << error << endl;
+			exit(1);
+
+		}
+
+		cout << "Loaded " << argv[i] << " in " << load_ms << " ms." << endl;
+
+	}
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	unlink(socket_path.c_str());
+
+	if(listen_fd < 0 or bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 or listen(listen_fd, 128) != 0){
+
+		cout << "Error: cannot listen on socket " << socket_path << ": " << strerror(errno) << endl;
+		exit(1);
+
+	}
+
+	cout << "Listening on " << socket_path << " (" << workers << " workers, up to " << max_threads << " threads per job)." << endl;
+
+	vector<std::thread> pool;
+	for(int w = 0; w < workers; ++w) pool.push_back(std::thread(worker, w));
+
+	while(true){
+
+		int fd = accept(listen_fd, NULL, NULL);
+
+		if(fd < 0){
+
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			if(stopping) break;
+
+			continue;
+
+		}
+
+		std::unique_lock<std::mutex> lock(queue_mutex);
+
+		if(stopping or queue.size() >= max_queue){
+
+			lock.unlock();
+
+			counters.rejected++;
+			write_line(fd, stopping ? "error shutting down" : "error busy");
+			close(fd);
+
+			continue;
+
+		}
+
+		//a client that does not send its request does not hold a worker for long
+		timeval timeout {REQUEST_TIMEOUT, 0};
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		queue.push_back({fd, clock_type::now()});
+		lock.unlock();
+
+		queue_cv.notify_one();
+
+	}
+
+	for(auto & w : pool) w.join();
+
+	close(listen_fd);
+	unlink(socket_path.c_str());
+
+	cout << "Served " << counters.jobs << " jobs (" << counters.failed << " failed, " << counters.rejected << " rejected)." << endl;
+
+}